@@ -0,0 +1,47 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <bfbenchmark.h>
+#include <bfbitmanip.h>
+
+int
+main(int argc, const char *argv[])
+{
+    uint64_t val = 0;
+
+    benchmark_print(benchmark_run("set_bit", [&] {
+        benchmark_do_not_optimize(val = set_bit(val, val & 0x3F));
+    }));
+
+    benchmark_print(benchmark_run("clear_bit", [&] {
+        benchmark_do_not_optimize(val = clear_bit(~val, val & 0x3F));
+    }));
+
+    benchmark_print(benchmark_run("num_bits_set", [&] {
+        benchmark_do_not_optimize(val += num_bits_set(val));
+    }));
+
+    benchmark_print(benchmark_run("set_bits", [&] {
+        benchmark_do_not_optimize(val = set_bits(val, 0x00FF00FF00FF00FFULL, ~val));
+    }));
+
+    return benchmark_dump_json(argc > 1 ? argv[1] : nullptr);
+}
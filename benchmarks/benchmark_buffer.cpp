@@ -0,0 +1,136 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <bfbenchmark.h>
+#include <bfbuffer.h>
+
+template<typename F>
+void
+run(const char *title, F func)
+{
+    benchmark_print(benchmark_run(title, func));
+
+    clear_memory_stats();
+    func();
+    print_memory_stats();
+}
+
+int
+main(int argc, const char *argv[])
+{
+    bfn::buffer lhs(0x1000);
+    bfn::buffer rhs(0x1000);
+
+    for (auto size : {0x10U, 0x1000U, 0x100000U}) {
+        bfdebug_brk2(0);
+        bfdebug_nhex(0, "size", size);
+
+        run("buffer(size)", [&] {
+            bfn::buffer buf(size);
+            benchmark_do_not_optimize(buf.data());
+        });
+
+        run("small_buffer(size)", [&] {
+            bfn::small_buffer buf(size);
+            benchmark_do_not_optimize(buf.data());
+        });
+
+        run("buffer(size) + resize(size * 2)", [&] {
+            bfn::buffer buf(size);
+            buf.resize(size * 2);
+            benchmark_do_not_optimize(buf.data());
+        });
+    }
+
+    bfdebug_brk2(0);
+    run("buffer(1M)", [&] {
+        bfn::buffer buf(0x100000);
+        benchmark_do_not_optimize(buf.data());
+    });
+
+    run("make_uninitialised(1M)", [&] {
+        auto buf = bfn::buffer::make_uninitialised(0x100000);
+        benchmark_do_not_optimize(buf.data());
+    });
+
+    // Appends 4k chunks of 16 bytes. The first is how a buffer had to be
+    // grown before it had a capacity (allocate, copy and free on every
+    // append), which is quadratic.
+
+    std::array<char, 16> chunk{};
+
+    bfdebug_brk2(0);
+    run("append 16 bytes x 4k (exact resize)", [&] {
+        bfn::buffer buf;
+
+        for (auto i = 0; i < 0x1000; i++) {
+            auto size = buf.size();
+            auto tmp = bfn::buffer::make_uninitialised(size + chunk.size());
+
+            if (size != 0) {
+                memcpy(tmp.data(), buf.data(), size);
+            }
+
+            memcpy(tmp.data() + size, chunk.data(), chunk.size());
+            buf = std::move(tmp);
+        }
+
+        benchmark_do_not_optimize(buf.data());
+    });
+
+    run("append 16 bytes x 4k (append)", [&] {
+        bfn::buffer buf;
+
+        for (auto i = 0; i < 0x1000; i++) {
+            buf.append(chunk.data(), chunk.size());
+        }
+
+        benchmark_do_not_optimize(buf.data());
+    });
+
+    run("append 16 bytes x 4k (reserve + append)", [&] {
+        bfn::buffer buf;
+        buf.reserve(0x1000 * chunk.size());
+
+        for (auto i = 0; i < 0x1000; i++) {
+            buf.append(chunk.data(), chunk.size());
+        }
+
+        benchmark_do_not_optimize(buf.data());
+    });
+
+    run("append 16 bytes x 4k (std::vector)", [&] {
+        std::vector<char> buf;
+
+        for (auto i = 0; i < 0x1000; i++) {
+            buf.insert(buf.end(), chunk.begin(), chunk.end());
+        }
+
+        benchmark_do_not_optimize(buf.data());
+    });
+
+    bfdebug_brk2(0);
+    run("operator== (4k)", [&] {
+        benchmark_do_not_optimize(lhs == rhs);
+    });
+
+    return benchmark_dump_json(argc > 1 ? argv[1] : nullptr);
+}
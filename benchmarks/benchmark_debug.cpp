@@ -0,0 +1,66 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <bfbenchmark.h>
+#include <bfdebug.h>
+
+template<typename F>
+void
+run(const char *title, F func)
+{
+    benchmark_print(benchmark_run(title, func));
+
+    clear_memory_stats();
+    func();
+    print_memory_stats();
+}
+
+int
+main(int argc, const char *argv[])
+{
+    uint64_t val = 0;
+    std::string msg;
+
+    msg.reserve(0x1000);
+
+    bfdebug_brk2(0);
+    run("bfdebug_nhex (msg)", [&] {
+        msg.clear();
+        bfdebug_nhex(0, "value", val++, &msg);
+        benchmark_do_not_optimize(msg.data());
+    });
+
+    bfdebug_brk2(0);
+    run("bfdebug_ndec (msg)", [&] {
+        msg.clear();
+        bfdebug_ndec(0, "value", val++, &msg);
+        benchmark_do_not_optimize(msg.data());
+    });
+
+    bfdebug_brk2(0);
+    run("bfdebug_text (msg)", [&] {
+        msg.clear();
+        bfdebug_text(0, "title", "text", &msg);
+        benchmark_do_not_optimize(msg.data());
+    });
+
+    return benchmark_dump_json(argc > 1 ? argv[1] : nullptr);
+}
@@ -0,0 +1,134 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <bfbenchmark.h>
+#include <bfdebugringinterface.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// The original, byte at a time implementation of debug_ring_read, kept here
+// as the baseline that the segmented version is compared against.
+
+uint64_t
+debug_ring_read_reference(struct debug_ring_resources_t *drr, char *str, uint64_t len)
+{
+    uint64_t i;
+    uint64_t spos;
+    uint64_t content;
+
+    if (drr == 0 || str == 0 || len == 0)
+    { return 0; }
+
+    spos = drr->spos % DEBUG_RING_SIZE;
+    content = drr->epos - drr->spos;
+
+    for (i = 0; i < content && i < len - 1; i++) {
+        if (spos == DEBUG_RING_SIZE)
+        { spos = 0; }
+
+        if (drr->buf[spos] != '\0')
+        { str[i] = drr->buf[spos]; }
+        else {
+            i--;
+            content--;
+        }
+
+        spos++;
+    }
+
+    str[i] = '\0';
+
+    return content;
+}
+
+template<typename F>
+void
+run(const char *title, debug_ring_resources_t *drr, F func)
+{
+    std::vector<char> str(DEBUG_RING_SIZE + 1);
+
+    benchmark_print(benchmark_run(title, [&] {
+        benchmark_do_not_optimize(func(drr, str.data(), str.size()));
+    }));
+}
+
+void
+fill(debug_ring_resources_t *drr, uint64_t nul_every)
+{
+    for (uint64_t i = 0; i < DEBUG_RING_SIZE; i++) {
+        drr->buf[i] = (nul_every != 0 && i % nul_every == 0) ? '\0' : static_cast<char>('a' + i % 26);
+    }
+
+    drr->spos = DEBUG_RING_SIZE * 3 + DEBUG_RING_SIZE / 2;
+    drr->epos = drr->spos + DEBUG_RING_SIZE;
+}
+
+// Simulates a reader that polls a full debug ring, where only a single
+// message has been written between each poll.
+
+template<typename F>
+void
+poll(const char *title, debug_ring_resources_t *drr, F func)
+{
+    std::vector<char> str(DEBUG_RING_SIZE + 1);
+    std::string msg(64, 'x');
+
+    benchmark_print(benchmark_run(title, [&] {
+        debug_ring_write(drr, msg.c_str(), msg.size());
+        benchmark_do_not_optimize(func(drr, str.data(), str.size()));
+    }));
+}
+
+int
+main(int argc, const char *argv[])
+{
+    auto drr = std::make_unique<debug_ring_resources_t>();
+    debug_ring_init(drr.get());
+
+    bfdebug_brk2(0);
+    fill(drr.get(), 0);
+    run("full ring, no nulls: reference", drr.get(), debug_ring_read_reference);
+    run("full ring, no nulls: debug_ring_read", drr.get(), debug_ring_read);
+
+    bfdebug_brk2(0);
+    fill(drr.get(), 4096);
+    run("full ring, null every 4k: reference", drr.get(), debug_ring_read_reference);
+    run("full ring, null every 4k: debug_ring_read", drr.get(), debug_ring_read);
+
+    bfdebug_brk2(0);
+    fill(drr.get(), 64);
+    run("full ring, null every 64: reference", drr.get(), debug_ring_read_reference);
+    run("full ring, null every 64: debug_ring_read", drr.get(), debug_ring_read);
+
+    bfdebug_brk2(0);
+    fill(drr.get(), 0);
+    drr->rpos = drr->epos;
+    poll("poll, 64 new bytes: debug_ring_read", drr.get(), debug_ring_read);
+
+    uint64_t cursor = drr->epos;
+    poll("poll, 64 new bytes: debug_ring_read_cursor", drr.get(), [&](auto ring, auto str, auto len) {
+        return debug_ring_read_cursor(ring, &cursor, str, len, nullptr);
+    });
+
+    return benchmark_dump_json(argc > 1 ? argv[1] : nullptr);
+}
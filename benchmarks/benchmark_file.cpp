@@ -0,0 +1,215 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <bfbenchmark.h>
+#include <bffile.h>
+
+file g_file;
+std::string g_filename{"benchmark_file.bin"};
+
+// Touches one byte in every page, so that the pages of a mapping are
+// faulted in and the cost of doing so is measured.
+
+uint64_t
+touch(const char *data, std::size_t size)
+{
+    uint64_t sum = 0;
+
+    for (std::size_t i = 0; i < size; i += 0x1000) {
+        sum += static_cast<unsigned char>(data[i]);
+    }
+
+    return sum;
+}
+
+// How read_text used to read a file, which zeroes the string before
+// reading into it.
+
+std::string
+read_text_zeroed(const std::string &filename)
+{
+    std::fstream handle(filename, std::ios_base::in | std::ios_base::binary);
+    handle.seekg(0, std::ios::end);
+    auto size = handle.tellg();
+
+    if (size <= 0) {
+        return {};
+    }
+
+    handle.seekg(0, std::ios::beg);
+    std::string buffer(static_cast<std::string::size_type>(size), 0);
+
+    handle.read(&buffer.front(), size);
+    return buffer;
+}
+
+template<typename F>
+void
+run(const char *title, std::size_t size, F func)
+{
+    benchmark_options options;
+
+    if (size >= 0x1000000) {
+        options.num_samples = 5;
+    }
+
+    auto result = benchmark_run(title, func, options);
+    benchmark_print(result);
+
+    if (size != 0 && result.median_ns != 0.0) {
+        bfdebug_subndec(0, "MB/s", static_cast<uint64_t>(static_cast<double>(size) * 1000.0 / result.median_ns));
+    }
+}
+
+int
+main(int argc, const char *argv[])
+{
+    // The files are written first, so they are in the page cache, and
+    // these measure the cost of getting a file's contents from the page
+    // cache into memory that can be used.
+
+    for (std::size_t size : {0x400U, 0x10000U, 0x40000U, 0x100000U, 0x1000000U, 0x10000000U, 0x40000000U}) {
+        {
+            auto buf = bfn::buffer::make_uninitialised(size);
+
+            for (std::size_t i = 0; i < size; i++) {
+                buf.data()[i] = static_cast<char>(i);
+            }
+
+            g_file.write_binary(g_filename, buf);
+        }
+
+        bfdebug_brk2(0);
+        bfdebug_nhex(0, "size", size);
+
+        run("read_binary", size, [&] {
+            auto buf = g_file.read_binary(g_filename);
+            benchmark_do_not_optimize(touch(buf.data(), buf.size()));
+        });
+
+        run("read_mapped (normal)", size, [&] {
+            auto view = g_file.read_mapped(g_filename, file::advise_normal);
+            benchmark_do_not_optimize(touch(view.data(), view.size()));
+        });
+
+        run("read_mapped (sequential)", size, [&] {
+            auto view = g_file.read_mapped(g_filename, file::advise_sequential);
+            benchmark_do_not_optimize(touch(view.data(), view.size()));
+        });
+
+        run("read_mapped (sequential | willneed)", size, [&] {
+            auto view = g_file.read_mapped(g_filename, file::advise_sequential | file::advise_willneed);
+            benchmark_do_not_optimize(touch(view.data(), view.size()));
+        });
+
+        run("read_stream (1M chunks)", size, [&] {
+            uint64_t sum = 0;
+
+            auto reader = g_file.read_stream(g_filename);
+            reader.for_each([&](auto chunk) {
+                sum += touch(chunk.data(), static_cast<std::size_t>(chunk.size()));
+            });
+
+            benchmark_do_not_optimize(sum);
+        });
+
+        auto binary_stats = measure_allocations([&] {
+            auto buf = g_file.read_binary(g_filename);
+            benchmark_do_not_optimize(buf.data());
+        });
+
+        auto stream_stats = measure_allocations([&] {
+            auto reader = g_file.read_stream(g_filename);
+            reader.for_each([&](auto chunk) {
+                benchmark_do_not_optimize(chunk.data());
+            });
+        });
+
+        bfdebug_info(0, "peak memory");
+        bfdebug_subnhex(0, "read_binary", binary_stats.peak_bytes);
+        bfdebug_subnhex(0, "read_stream", stream_stats.peak_bytes);
+
+        run("read_text (fstream, zeroed string)", size, [&] {
+            auto str = read_text_zeroed(g_filename);
+            benchmark_do_not_optimize(touch(str.data(), str.size()));
+        });
+
+        run("read_text", size, [&] {
+            auto str = g_file.read_text(g_filename);
+            benchmark_do_not_optimize(touch(str.data(), str.size()));
+        });
+    }
+
+    std::remove(g_filename.c_str());
+
+#if defined(NATIVE) && defined(__unix__)
+
+    // Locates MAX_NUM_MODULES modules that are all in the last of 4 search
+    // paths, which is the worst case for find_files. The first is how
+    // find_files used to check each file in each path.
+
+    file::path_list_type files;
+    file::path_list_type paths{"benchmark_dir0", "benchmark_dir1", "benchmark_dir2", "benchmark_dir3"};
+
+    for (const auto &path : paths) {
+        ::mkdir(path.c_str(), 0755);
+    }
+
+    for (auto i = 0; i < MAX_NUM_MODULES; i++) {
+        files.push_back("module" + std::to_string(i) + ".so");
+        g_file.write_text(paths.back() + '/' + files.back(), "module");
+    }
+
+    bfdebug_brk2(0);
+    run("find_files (ifstream per file and path)", 0, [&] {
+        file::path_list_type results;
+
+        for (const auto &filename : files) {
+            for (const auto &path : paths) {
+                std::ifstream handle{path + '/' + filename};
+
+                if (handle.good()) {
+                    results.push_back(path + '/' + filename);
+                    break;
+                }
+            }
+        }
+
+        benchmark_do_not_optimize(results.data());
+    });
+
+    run("find_files", 0, [&] {
+        auto results = g_file.find_files(files, paths);
+        benchmark_do_not_optimize(results.data());
+    });
+
+    for (const auto &filename : files) {
+        std::remove((paths.back() + '/' + filename).c_str());
+    }
+
+    for (const auto &path : paths) {
+        ::rmdir(path.c_str());
+    }
+
+#endif
+
+    return benchmark_dump_json(argc > 1 ? argv[1] : nullptr);
+}
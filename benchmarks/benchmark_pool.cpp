@@ -0,0 +1,96 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <bfbenchmark.h>
+#include <bfpool.h>
+
+#include <random>
+
+void
+print(const char *title, const bfn::pool_stats &stats)
+{
+    bfdebug_info(0, title);
+    bfdebug_subnhex(0, "size", stats.size);
+    bfdebug_subnhex(0, "used bytes", stats.used_bytes);
+    bfdebug_subnhex(0, "high water", stats.high_water);
+    bfdebug_subnhex(0, "largest free block", stats.largest_free);
+    bfdebug_subndec(0, "external fragmentation (%)", static_cast<uint64_t>(stats.external_fragmentation() * 100));
+    bfdebug_subndec(0, "internal fragmentation (%)", static_cast<uint64_t>(stats.internal_fragmentation() * 100));
+    bfdebug_subndec(0, "failed allocations", stats.failures);
+}
+
+// Fills the pool with randomly sized allocations until it is the provided
+// percentage full, and then frees every other allocation, so that the
+// free memory is fragmented.
+
+std::vector<void *>
+pressure(bfn::buddy_pool &pool, std::size_t max_size, std::size_t percent)
+{
+    std::vector<void *> ptrs;
+    std::mt19937 gen;
+    std::uniform_int_distribution<std::size_t> dist(1, max_size);
+
+    while (pool.stats().used_bytes < pool.stats().size / 100 * percent) {
+        if (auto ptr = pool.alloc(dist(gen))) {
+            ptrs.push_back(ptr);
+        }
+    }
+
+    for (std::size_t i = 0; i < ptrs.size(); i += 2) {
+        pool.free(ptrs.at(i));
+        ptrs.at(i) = nullptr;
+    }
+
+    return ptrs;
+}
+
+template<typename A, typename F>
+void
+run(const char *title, A alloc, F free)
+{
+    benchmark_print(benchmark_run(title, [&] {
+        auto ptr = alloc();
+        benchmark_do_not_optimize(ptr);
+        free(ptr);
+    }));
+}
+
+int
+main(int argc, const char *argv[])
+{
+    bfn::buddy_pool heap(MAX_HEAP_POOL, 4);
+    bfn::buddy_pool page(MAX_PAGE_POOL, MAX_PAGE_SHIFT);
+
+    run("alloc/free 32 bytes (malloc)", [] { return malloc(32); }, [](void *ptr) { free(ptr); });
+    run("alloc/free 32 bytes (empty heap pool)", [&] { return heap.alloc(32); }, [&](void *ptr) { heap.free(ptr); });
+    run("alloc/free 4k (empty page pool)", [&] { return page.alloc(0x1000); }, [&](void *ptr) { page.free(ptr); });
+
+    auto heap_ptrs = pressure(heap, 0x200, 90);
+    auto page_ptrs = pressure(page, 0x10000, 90);
+
+    run("alloc/free 32 bytes (heap pool under pressure)", [&] { return heap.alloc(32); }, [&](void *ptr) { heap.free(ptr); });
+    run("alloc/free 4k (page pool under pressure)", [&] { return page.alloc(0x1000); }, [&](void *ptr) { page.free(ptr); });
+
+    print("heap pool under pressure", heap.stats());
+    print("page pool under pressure", page.stats());
+
+    return benchmark_dump_json(argc > 1 ? argv[1] : nullptr);
+}
@@ -0,0 +1,130 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <bfbenchmark.h>
+#include <bfsearch.h>
+
+#include <random>
+#include <string>
+#include <algorithm>
+
+const char *
+level_name(bfn::simd_level level)
+{
+    switch (level) {
+        case bfn::simd_level::avx2:
+            return "avx2";
+
+        case bfn::simd_level::sse2:
+            return "sse2";
+
+        default:
+            return "scalar";
+    }
+}
+
+template<typename F>
+void
+run(const std::string &title, std::size_t size, F func)
+{
+    benchmark_options options;
+
+    if (size >= 0x400000) {
+        options.num_samples = 11;
+    }
+
+    auto result = benchmark_run(title, func, options);
+    benchmark_print(result);
+
+    if (result.median_ns != 0.0) {
+        bfdebug_subndec(0, "MB/s", static_cast<uint64_t>(static_cast<double>(size) * 1000.0 / result.median_ns));
+    }
+}
+
+int
+main(int argc, const char *argv[])
+{
+    std::vector<bfn::simd_level> levels;
+
+    for (auto level : {bfn::simd_level::scalar, bfn::simd_level::sse2, bfn::simd_level::avx2}) {
+        if (level <= bfn::simd_supported()) {
+            levels.push_back(level);
+        }
+    }
+
+    // The data is random lower case letters and the pattern is not in it,
+    // so find has to look at every byte. The pattern's first and last
+    // letters still match every few hundred bytes.
+
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int> dist('a', 'z');
+
+    auto lhs = bfn::buffer::make_uninitialised(0x4000000);
+    auto all = lhs.span();
+    std::generate(all.begin(), all.end(), [&] { return static_cast<char>(dist(gen)); });
+
+    auto rhs = bfn::buffer::make_uninitialised(lhs.size());
+    memcpy(rhs.data(), lhs.data(), lhs.size());
+
+    std::string pattern{"signature"};
+    auto pspan = gsl::span<const char>(pattern.data(), static_cast<std::ptrdiff_t>(pattern.size()));
+
+    for (std::size_t size : {0x40U, 0x1000U, 0x40000U, 0x400000U, 0x4000000U}) {
+        auto lspan = gsl::span<const char>(lhs.data(), static_cast<std::ptrdiff_t>(size));
+        auto rspan = gsl::span<const char>(rhs.data(), static_cast<std::ptrdiff_t>(size));
+
+        bfdebug_brk2(0);
+        bfdebug_nhex(0, "size", size);
+
+        run("std::search", size, [&] {
+            benchmark_do_not_optimize(std::search(lspan.begin(), lspan.end(), pattern.begin(), pattern.end()));
+        });
+
+        for (auto level : levels) {
+            bfn::set_simd_level(level);
+            run(std::string("find (") + level_name(level) + ")", size, [&] {
+                benchmark_do_not_optimize(bfn::find(lspan, pspan));
+            });
+        }
+
+        run("memcmp", size, [&] {
+            benchmark_do_not_optimize(memcmp(lspan.data(), rspan.data(), size));
+        });
+
+        for (auto level : levels) {
+            bfn::set_simd_level(level);
+            run(std::string("mismatch (") + level_name(level) + ")", size, [&] {
+                benchmark_do_not_optimize(bfn::mismatch(lspan, rspan));
+            });
+        }
+
+        for (auto level : levels) {
+            bfn::set_simd_level(level);
+            run(std::string("hash (") + level_name(level) + ")", size, [&] {
+                benchmark_do_not_optimize(bfn::hash(lspan));
+            });
+        }
+
+        bfn::set_simd_level(bfn::simd_supported());
+    }
+
+    return benchmark_dump_json(argc > 1 ? argv[1] : nullptr);
+}
@@ -0,0 +1,44 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <bfbenchmark.h>
+#include <bfshuffle.h>
+
+#include <numeric>
+
+int
+main(int argc, const char *argv[])
+{
+    for (auto size : {0x10U, 0x1000U, 0x100000U}) {
+        std::vector<uint64_t> list(size);
+        std::iota(list.begin(), list.end(), 0);
+
+        bfdebug_brk2(0);
+        bfdebug_nhex(0, "size", size);
+
+        benchmark_print(benchmark_run("shuffle", [&] {
+            bfn::shuffle(list);
+            benchmark_do_not_optimize(list.data());
+        }));
+    }
+
+    return benchmark_dump_json(argc > 1 ? argv[1] : nullptr);
+}
@@ -0,0 +1,146 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <bfbenchmark.h>
+#include <bfslab.h>
+#include <bfstring.h>
+
+#include <thread>
+
+// The baseline allocator, which is what the default bfnewdelete.h does for
+// anything that is not a multiple of a page.
+
+template<typename T>
+struct malloc_allocator {
+    using value_type = T;
+
+    malloc_allocator() noexcept = default;
+
+    template<typename U>
+    malloc_allocator(const malloc_allocator<U> &) noexcept
+    { }
+
+    T *
+    allocate(std::size_t num)
+    {
+        if (auto ptr = malloc(num * sizeof(T))) {
+            return static_cast<T *>(ptr);
+        }
+
+        throw std::bad_alloc();
+    }
+
+    void
+    deallocate(T *ptr, std::size_t) noexcept
+    { free(ptr); }
+};
+
+template<typename T, typename U>
+bool operator==(const malloc_allocator<T> &, const malloc_allocator<U> &) noexcept
+{ return true; }
+
+template<typename T, typename U>
+bool operator!=(const malloc_allocator<T> &, const malloc_allocator<U> &) noexcept
+{ return false; }
+
+// A workload that mimics the SDK's debug code: build a debug line out of
+// a few small strings, keep a bounded log of them, and throw them away.
+
+template<template<typename> class A>
+struct workload {
+    using string_type = std::basic_string<char, std::char_traits<char>, A<char>>;
+    using list_type = std::vector<string_type, A<string_type>>;
+
+    list_type log;
+    uint64_t val{0};
+
+    void
+    operator()()
+    {
+        string_type title("vcpuid", A<char>());
+        string_type line("[0] DEBUG: ", A<char>());
+
+        line += title;
+        line += string_type(52 - title.size(), ' ', A<char>());
+        line += bfn::to_string(val += 0x1234567, 16).c_str();
+        line += '\n';
+
+        log.push_back(std::move(line));
+
+        if (log.size() > 0x100) {
+            log.erase(log.begin(), log.begin() + 0x80);
+        }
+    }
+};
+
+template<typename W>
+void
+run(const char *title, W work)
+{
+    benchmark_print(benchmark_run(title, [&] {
+        work();
+    }));
+}
+
+template<typename W>
+void
+run_threads(const char *title, W work, std::size_t num_threads)
+{
+    benchmark_print(benchmark_run(title, [&] {
+        std::vector<std::thread> threads;
+
+        for (std::size_t t = 0; t < num_threads; t++) {
+            threads.emplace_back([work]() mutable {
+                for (auto i = 0; i < 0x1000; i++) {
+                    work();
+                }
+            });
+        }
+
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }));
+}
+
+int
+main(int argc, const char *argv[])
+{
+    run("debug strings (malloc)", workload<malloc_allocator>());
+    run("debug strings (slab)", workload<bfn::slab_allocator>());
+
+    run_threads("debug strings, 4 threads (malloc)", workload<malloc_allocator>(), 4);
+    run_threads("debug strings, 4 threads (slab)", workload<bfn::slab_allocator>(), 4);
+
+    run("alloc/free 32 bytes (malloc)", [] {
+        auto ptr = malloc(32);
+        benchmark_do_not_optimize(ptr);
+        free(ptr);
+    });
+
+    run("alloc/free 32 bytes (slab)", [] {
+        auto ptr = bfn::slab_alloc(32);
+        benchmark_do_not_optimize(ptr);
+        bfn::slab_free(ptr);
+    });
+
+    return benchmark_dump_json(argc > 1 ? argv[1] : nullptr);
+}
@@ -0,0 +1,105 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <bfbenchmark.h>
+#include <bfstring.h>
+
+#include <iomanip>
+#include <sstream>
+
+// The original stringstream based implementation of bfn::to_string, kept
+// here as the baseline that the allocation free version is compared against.
+
+template<typename T>
+std::string
+to_string_stream(const T val, const int base)
+{
+    std::stringstream stream;
+
+    switch (base) {
+        case 8:
+            stream << "0";
+            break;
+
+        case 16:
+            stream << "0x";
+            stream << std::setfill('0') << std::setw(16);
+            break;
+
+        default:
+            break;
+    };
+
+    stream << std::setbase(base) << std::uppercase << val;
+    return stream.str();
+}
+
+template<typename F>
+void
+run(const char *title, F func)
+{
+    uint64_t val = 0;
+
+    auto result = benchmark_run(title, [&] {
+        benchmark_do_not_optimize(func(val += 0x1234567));
+    });
+
+    bfdebug_brk2(0);
+    benchmark_print(result);
+
+    clear_memory_stats();
+    benchmark_do_not_optimize(func(val));
+    print_memory_stats();
+}
+
+int
+main(int argc, const char *argv[])
+{
+    run("hex: stringstream", [](uint64_t val) {
+        return to_string_stream(val, 16).size();
+    });
+
+    run("hex: bfn::to_string", [](uint64_t val) {
+        return bfn::to_string(val, 16).size();
+    });
+
+    run("hex: bfn::to_string (caller storage)", [](uint64_t val) {
+        std::array<char, bfn::to_string_max_size> str;
+        auto ret = bfn::to_string(str.data(), str.data() + str.size(), val, 16);
+        return static_cast<uint64_t>(ret.ptr - str.data());
+    });
+
+    run("dec: stringstream", [](uint64_t val) {
+        return to_string_stream(val, 10).size();
+    });
+
+    run("dec: bfn::to_string", [](uint64_t val) {
+        return bfn::to_string(val, 10).size();
+    });
+
+    run("dec: bfn::to_string (caller storage)", [](uint64_t val) {
+        std::array<char, bfn::to_string_max_size> str;
+        auto ret = bfn::to_string(str.data(), str.data() + str.size(), val, 10);
+        return static_cast<uint64_t>(ret.ptr - str.data());
+    });
+
+    return benchmark_dump_json(argc > 1 ? argv[1] : nullptr);
+}
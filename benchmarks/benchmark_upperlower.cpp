@@ -0,0 +1,39 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <bfbenchmark.h>
+#include <bfupperlower.h>
+
+int
+main(int argc, const char *argv[])
+{
+    uintptr_t val = 0x123456789ABCDEF;
+
+    benchmark_print(benchmark_run("lower", [&] {
+        benchmark_do_not_optimize(bfn::lower(val++));
+    }));
+
+    benchmark_print(benchmark_run("upper", [&] {
+        benchmark_do_not_optimize(bfn::upper(val++));
+    }));
+
+    return benchmark_dump_json(argc > 1 ? argv[1] : nullptr);
+}
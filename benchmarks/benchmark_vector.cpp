@@ -0,0 +1,52 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <bfbenchmark.h>
+#include <bfvector.h>
+
+#include <numeric>
+
+int
+main(int argc, const char *argv[])
+{
+    std::vector<uint64_t> list(0x1000);
+    std::iota(list.begin(), list.end(), 0);
+
+    std::ptrdiff_t index = 0;
+
+    benchmark_print(benchmark_run("find", [&] {
+        benchmark_do_not_optimize(*bfn::find(list, index++ & 0xFFF));
+    }));
+
+    benchmark_print(benchmark_run("cfind", [&] {
+        benchmark_do_not_optimize(*bfn::cfind(list, index++ & 0xFFF));
+    }));
+
+    benchmark_print(benchmark_run("take + push_back (front)", [&] {
+        list.push_back(bfn::take(list, 0));
+    }));
+
+    benchmark_print(benchmark_run("take + push_back (back)", [&] {
+        list.push_back(bfn::take(list, 0xFFF));
+    }));
+
+    return benchmark_dump_json(argc > 1 ? argv[1] : nullptr);
+}
@@ -26,10 +26,28 @@
 #pragma GCC system_header
 #endif
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
 
 #include <bfdebug.h>
+#include <bfjson.h>
+
+#if defined(__has_include)
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#define BFBENCHMARK_EXECINFO
+#endif
+#endif
 
 template<typename T>
 uint64_t benchmark(T func)
@@ -41,36 +59,600 @@ uint64_t benchmark(T func)
     return static_cast<uint64_t>((e - s).count());
 }
 
-size_t g_page_allocs = 0;
-size_t g_nonpage_allocs = 0;
+// -----------------------------------------------------------------------------
+// Statistical Benchmarks
+// -----------------------------------------------------------------------------
+
+/// Do Not Optimize
+///
+/// Tells the compiler that val is used (and might be modified), so that the
+/// work that produced it cannot be optimized away, without adding any
+/// instructions to the code being measured.
+///
+/// @param val the value to keep
+///
+template<typename T>
+inline void
+benchmark_do_not_optimize(T &&val)
+{
+#if defined(__clang__) || defined(__GNUC__)
+    asm volatile("" : : "r"(&val) : "memory");
+#else
+    static volatile const void *sink;
+    sink = &val;
+#endif
+}
+
+/// Clobber Memory
+///
+/// Tells the compiler that all memory might have been read or written, so
+/// that stores made by the code being measured cannot be optimized away.
+///
+inline void
+benchmark_clobber_memory()
+{
+#if defined(__clang__) || defined(__GNUC__)
+    asm volatile("" : : : "memory");
+#endif
+}
+
+/// Read TSC (Start)
+///
+/// Reads the TSC at the start of a measurement. The lfence before rdtsc
+/// ensures that earlier instructions have completed, and the lfence after
+/// ensures that the code being measured does not start before the TSC
+/// is read.
+///
+/// @return the TSC, or 0 if the TSC is not supported
+///
+inline uint64_t
+benchmark_rdtsc_start()
+{
+#if (defined(__clang__) || defined(__GNUC__)) && defined(__x86_64__)
+    uint32_t lo;
+    uint32_t hi;
+
+    asm volatile("lfence; rdtsc; lfence" : "=a"(lo), "=d"(hi) : : "memory");
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+#else
+    return 0;
+#endif
+}
+
+/// Read TSC (End)
+///
+/// Reads the TSC at the end of a measurement. rdtscp waits for the code
+/// being measured to complete, and the lfence after ensures that later
+/// instructions do not start before the TSC is read.
+///
+/// @return the TSC, or 0 if the TSC is not supported
+///
+inline uint64_t
+benchmark_rdtsc_end()
+{
+#if (defined(__clang__) || defined(__GNUC__)) && defined(__x86_64__)
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t aux;
+
+    asm volatile("rdtscp; lfence" : "=a"(lo), "=d"(hi), "=c"(aux) : : "memory");
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+#else
+    return 0;
+#endif
+}
+
+/// Benchmark Options
+///
+/// Controls how benchmark_run measures a function.
+///
+struct benchmark_options {
+    uint64_t warmup_ns{10000000};       ///< how long to run before measuring
+    uint64_t min_sample_ns{1000000};    ///< the minimum duration of a sample
+    uint64_t num_samples{31};           ///< the number of samples to take
+    uint64_t max_iterations{1ULL << 30};    ///< max iterations per sample
+    bool cycles{false};                 ///< also measure TSC cycles
+};
+
+/// Benchmark Result
+///
+/// The statistics collected by benchmark_run. All times are per iteration
+/// (i.e. per call to the function being measured).
+///
+struct benchmark_result {
+    std::string name;                   ///< the name of the benchmark
+    uint64_t iterations{0};             ///< iterations per sample
+    uint64_t samples{0};                ///< number of samples
+    double min_ns{0};                   ///< fastest sample
+    double median_ns{0};                ///< median sample
+    double p99_ns{0};                   ///< 99th percentile sample
+    double mean_ns{0};                  ///< mean of all samples
+    double stddev_ns{0};                ///< standard deviation of all samples
+    double min_cycles{0};               ///< fastest sample (if cycles)
+    double median_cycles{0};            ///< median sample (if cycles)
+};
+
+/// @cond
+
+template<typename F>
+uint64_t
+__benchmark_sample(F &func, uint64_t iterations)
+{
+    auto s = std::chrono::steady_clock::now();
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        func();
+        benchmark_clobber_memory();
+    }
+
+    auto e = std::chrono::steady_clock::now();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(e - s).count());
+}
+
+inline double
+__benchmark_percentile(const std::vector<double> &sorted, double p)
+{
+    auto index = static_cast<std::size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+    return sorted.at(index == 0 ? 0 : index - 1);
+}
+
+inline std::vector<benchmark_result> &
+__benchmark_results()
+{
+    static std::vector<benchmark_result> s_results;
+    return s_results;
+}
+
+/// @endcond
+
+/// Run Benchmark
+///
+/// Measures func as follows:
+/// - func is called repeatedly for options.warmup_ns to warm up caches,
+///   branch predictors and the CPU's frequency.
+/// - The number of iterations per sample is doubled until a sample takes at
+///   least options.min_sample_ns, so that the resolution of the clock does
+///   not matter, no matter how fast func is.
+/// - options.num_samples samples are taken, and min, median, p99, mean and
+///   standard deviation are computed from the per iteration time of each.
+///
+/// To keep the work being done in func from being optimized away, pass its
+/// result to benchmark_do_not_optimize. The result is also recorded so
+/// that it can be output using benchmark_dump_json.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param name the name of the benchmark
+/// @param func the function to measure
+/// @param options controls how func is measured
+/// @return the statistics that were collected
+///
+template<typename F>
+benchmark_result
+benchmark_run(const std::string &name, F func, const benchmark_options &options = {})
+{
+    benchmark_result result;
+    result.name = name;
+
+    auto warmup = std::chrono::steady_clock::now() + std::chrono::nanoseconds(options.warmup_ns);
+    while (std::chrono::steady_clock::now() < warmup) {
+        func();
+        benchmark_clobber_memory();
+    }
+
+    uint64_t iterations = 1;
+    while (iterations < options.max_iterations && __benchmark_sample(func, iterations) < options.min_sample_ns) {
+        iterations *= 2;
+    }
+
+    std::vector<double> ns;
+    std::vector<double> cycles;
+
+    ns.reserve(options.num_samples);
+    cycles.reserve(options.cycles ? options.num_samples : 0);
+
+    for (uint64_t i = 0; i < options.num_samples; i++) {
+        uint64_t tsc = 0;
+
+        if (options.cycles) {
+            tsc = benchmark_rdtsc_start();
+        }
+
+        auto time = __benchmark_sample(func, iterations);
+
+        if (options.cycles) {
+            tsc = benchmark_rdtsc_end() - tsc;
+            cycles.push_back(static_cast<double>(tsc) / static_cast<double>(iterations));
+        }
+
+        ns.push_back(static_cast<double>(time) / static_cast<double>(iterations));
+    }
+
+    std::sort(ns.begin(), ns.end());
+    std::sort(cycles.begin(), cycles.end());
+
+    result.iterations = iterations;
+    result.samples = ns.size();
+
+    if (!ns.empty()) {
+        double sum = 0;
+        double sq = 0;
+
+        for (auto val : ns) {
+            sum += val;
+        }
+
+        result.mean_ns = sum / static_cast<double>(ns.size());
+
+        for (auto val : ns) {
+            sq += (val - result.mean_ns) * (val - result.mean_ns);
+        }
+
+        if (ns.size() > 1) {
+            result.stddev_ns = std::sqrt(sq / static_cast<double>(ns.size() - 1));
+        }
+
+        result.min_ns = ns.front();
+        result.median_ns = __benchmark_percentile(ns, 0.5);
+        result.p99_ns = __benchmark_percentile(ns, 0.99);
+    }
+
+    if (!cycles.empty()) {
+        result.min_cycles = cycles.front();
+        result.median_cycles = __benchmark_percentile(cycles, 0.5);
+    }
+
+    __benchmark_results().push_back(result);
+    return result;
+}
+
+/// Benchmark Result to JSON
+///
+/// @expects none
+/// @ensures none
+///
+/// @param result the result to convert
+/// @return result as a JSON object
+///
+inline json
+benchmark_to_json(const benchmark_result &result)
+{
+    json obj = {
+        {"name", result.name},
+        {"iterations", result.iterations},
+        {"samples", result.samples},
+        {"min_ns", result.min_ns},
+        {"median_ns", result.median_ns},
+        {"p99_ns", result.p99_ns},
+        {"mean_ns", result.mean_ns},
+        {"stddev_ns", result.stddev_ns}
+    };
+
+    if (result.min_cycles != 0.0) {
+        obj["min_cycles"] = result.min_cycles;
+        obj["median_cycles"] = result.median_cycles;
+    }
+
+    return obj;
+}
+
+/// Print Benchmark Result
+///
+/// Prints a human readable version of a benchmark's result using bfdebug.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param result the result to print
+///
+inline void
+benchmark_print(const benchmark_result &result)
+{
+    bfdebug_info(0, result.name.c_str());
+    bfdebug_subndec(0, "iterations", result.iterations);
+    bfdebug_subndec(0, "min (ns)", static_cast<uint64_t>(result.min_ns));
+    bfdebug_subndec(0, "median (ns)", static_cast<uint64_t>(result.median_ns));
+    bfdebug_subndec(0, "p99 (ns)", static_cast<uint64_t>(result.p99_ns));
+    bfdebug_subndec(0, "stddev (ns)", static_cast<uint64_t>(result.stddev_ns));
+
+    if (result.min_cycles != 0.0) {
+        bfdebug_subndec(0, "min (cycles)", static_cast<uint64_t>(result.min_cycles));
+    }
+}
+
+/// Dump Benchmark Results as JSON
+///
+/// Outputs the results of every call to benchmark_run as a JSON array.
+/// If path is provided, the JSON is written to that file, otherwise it is
+/// written to std::cout.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param path the file to write to, or nullptr for std::cout
+/// @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+///
+inline int
+benchmark_dump_json(const char *path = nullptr)
+{
+    auto results = json::array();
+
+    for (const auto &result : __benchmark_results()) {
+        results.push_back(benchmark_to_json(result));
+    }
+
+    if (path == nullptr) {
+        std::cout << results.dump(4) << '\n';
+        return EXIT_SUCCESS;
+    }
+
+    std::ofstream file(path);
+    file << results.dump(4) << '\n';
+
+    return file.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// -----------------------------------------------------------------------------
+// Allocation Profiler
+// -----------------------------------------------------------------------------
+
+/// Number of Size Classes
+///
+/// Allocations are counted in a histogram of power of two size classes.
+/// Class 0 counts allocations of 0 or 1 bytes, and class n counts
+/// allocations of (2^(n-1), 2^n] bytes. The last class also counts
+/// everything larger.
+///
+constexpr const std::size_t memory_stats_classes = 32;
+
+/// Memory Stats
+///
+/// A snapshot of the allocation profiler's counters (see get_memory_stats),
+/// or the difference between two snapshots (see memory_stats_scope).
+///
+struct memory_stats {
+    std::size_t page_bytes{0};          ///< bytes allocated in multiples of 4k
+    std::size_t nonpage_bytes{0};       ///< all other bytes allocated
+    std::size_t allocs{0};              ///< number of allocations
+    std::size_t frees{0};               ///< number of frees
+    std::size_t live_bytes{0};          ///< bytes currently allocated
+    std::size_t peak_bytes{0};          ///< high-water mark of live_bytes
+    std::array<std::size_t, memory_stats_classes> histogram{};  ///< allocations per size class
+};
+
+std::atomic<std::size_t> g_page_allocs{0};
+std::atomic<std::size_t> g_nonpage_allocs{0};
+std::atomic<std::size_t> g_num_allocs{0};
+std::atomic<std::size_t> g_num_frees{0};
+std::atomic<std::size_t> g_live_bytes{0};
+std::atomic<std::size_t> g_peak_bytes{0};
+std::array<std::atomic<std::size_t>, memory_stats_classes> g_alloc_histogram{};
+
+/// @cond
+
+// Each allocation is prefixed with a header that stores its size, so that
+// unsized deletes can still update the live byte count. The header is 16
+// bytes so that the memory returned keeps malloc's alignment.
+
+constexpr const std::size_t __memory_header_size = 16;
+
+inline std::size_t
+__memory_size_class(std::size_t size) noexcept
+{
+    std::size_t cls = 0;
+
+    while (cls < memory_stats_classes - 1 && (1ULL << cls) < size) {
+        cls++;
+    }
+
+    return cls;
+}
+
+/// @endcond
+
+// -----------------------------------------------------------------------------
+// Allocation Call Sites
+// -----------------------------------------------------------------------------
+
+/// Call Site Depth
+///
+/// The max number of return addresses recorded for each call site.
+///
+constexpr const std::size_t memory_callsite_depth = 4;
+
+/// Call Site Table Size
+///
+/// The number of unique call sites that can be tracked. Once the table is
+/// full, allocations from new call sites are counted in
+/// memory_callsites_dropped().
+///
+constexpr const std::size_t memory_callsite_table_size = 4096;
+
+/// Memory Call Site
+///
+/// The allocations made from a single call site (i.e. a unique stack of
+/// return addresses, starting with the caller of operator new).
+///
+struct memory_callsite {
+    std::array<void *, memory_callsite_depth> frames{};     ///< return addresses
+    std::size_t depth{0};                                   ///< number of valid frames
+    std::size_t allocs{0};                                  ///< number of allocations
+    std::size_t bytes{0};                                   ///< bytes allocated
+};
+
+/// @cond
+
+// The call site table is a fixed size, open addressing hash table so that
+// recording a call site never calls back into the allocator. An entry is
+// claimed by swapping its key from 0 to the hash of the stack, and the
+// stack is published with "ready" once it has been written.
+
+struct __memory_callsite_entry {
+    std::atomic<uint64_t> key;
+    std::atomic<bool> ready;
+    std::size_t depth;
+    std::array<void *, memory_callsite_depth> frames;
+    std::atomic<std::size_t> allocs;
+    std::atomic<std::size_t> bytes;
+};
+
+/// @endcond
+
+std::atomic<bool> g_memory_callsites_enabled{false};
+std::atomic<std::size_t> g_memory_callsites_dropped{0};
+std::array<__memory_callsite_entry, memory_callsite_table_size> g_memory_callsites{};
+
+/// @cond
+
+inline std::size_t
+__memory_callsite_capture(void *caller, std::array<void *, memory_callsite_depth> &frames) noexcept
+{
+    if (caller == nullptr) {
+        return 0;
+    }
+
+#ifdef BFBENCHMARK_EXECINFO
+
+    // backtrace() also returns the frames of the allocator itself, which
+    // depend on what the compiler inlined, so the stack is trimmed to start
+    // at the caller of operator new.
+
+    std::array<void *, memory_callsite_depth + 8> stack;
+    auto num = static_cast<std::size_t>(backtrace(stack.data(), static_cast<int>(stack.size())));
+
+    for (std::size_t i = 0; i < num; i++) {
+        if (stack.at(i) == caller) {
+            auto depth = std::min(num - i, memory_callsite_depth);
+            std::copy_n(stack.begin() + static_cast<std::ptrdiff_t>(i), depth, frames.begin());
+
+            return depth;
+        }
+    }
+
+#endif
+
+    frames.at(0) = caller;
+    return 1;
+}
+
+inline void
+__memory_callsite_record(void *caller, std::size_t size) noexcept
+{
+    std::array<void *, memory_callsite_depth> frames{};
+    auto depth = __memory_callsite_capture(caller, frames);
+
+    if (depth == 0) {
+        return;
+    }
+
+    uint64_t key = 0xcbf29ce484222325ULL;
+    for (std::size_t i = 0; i < depth; i++) {
+        key = (key ^ reinterpret_cast<uint64_t>(frames.at(i))) * 0x100000001b3ULL;
+    }
+
+    key = key == 0 ? 1 : key;
+
+    for (std::size_t probe = 0; probe < memory_callsite_table_size; probe++) {
+        auto &entry = g_memory_callsites.at((key + probe) & (memory_callsite_table_size - 1));
+        auto current = entry.key.load(std::memory_order_acquire);
+
+        if (current == 0) {
+            if (entry.key.compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+                entry.depth = depth;
+                entry.frames = frames;
+                entry.ready.store(true, std::memory_order_release);
+
+                current = key;
+            }
+        }
+
+        if (current == key) {
+            entry.allocs.fetch_add(1, std::memory_order_relaxed);
+            entry.bytes.fetch_add(size, std::memory_order_relaxed);
+
+            return;
+        }
+    }
+
+    g_memory_callsites_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+/// @endcond
 
 static void *
-custom_new(std::size_t size)
+custom_new(std::size_t size, void *caller)
 {
+    if (size > SIZE_MAX - __memory_header_size) {
+        throw std::bad_alloc();
+    }
+
+    auto ptr = static_cast<char *>(malloc(size + __memory_header_size));
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    // Only allocations that succeed are counted, as a failed allocation is
+    // never freed, and would otherwise stay in the live bytes forever.
+
     if ((size & 0xFFF) == 0) {
-        g_page_allocs += size;
+        g_page_allocs.fetch_add(size, std::memory_order_relaxed);
     }
     else {
-        g_nonpage_allocs += size;
+        g_nonpage_allocs.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    g_num_allocs.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_histogram.at(__memory_size_class(size)).fetch_add(1, std::memory_order_relaxed);
+
+    if (g_memory_callsites_enabled.load(std::memory_order_relaxed)) {
+        __memory_callsite_record(caller, size);
     }
 
-    return malloc(size);
+    auto live = g_live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    auto peak = g_peak_bytes.load(std::memory_order_relaxed);
+
+    while (live > peak && !g_peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    { }
+
+    *reinterpret_cast<std::size_t *>(ptr) = size;
+    return ptr + __memory_header_size;
 }
 
 static void
 custom_delete(void *ptr, std::size_t size)
 {
     bfignored(size);
-    free(ptr);
+
+    if (ptr == nullptr) {
+        return;
+    }
+
+    auto real = static_cast<char *>(ptr) - __memory_header_size;
+
+    g_num_frees.fetch_add(1, std::memory_order_relaxed);
+    g_live_bytes.fetch_sub(*reinterpret_cast<std::size_t *>(real), std::memory_order_relaxed);
+
+    free(real);
 }
 
+/// @cond
+
+#if defined(__clang__) || defined(__GNUC__)
+#define __MEMORY_CALLER __builtin_return_address(0)
+#else
+#define __MEMORY_CALLER nullptr
+#endif
+
+/// @endcond
+
 void *
 operator new[](std::size_t size)
-{ return custom_new(size); }
+{ return custom_new(size, __MEMORY_CALLER); }
 
 void *
 operator new (std::size_t size)
-{ return custom_new(size); }
+{ return custom_new(size, __MEMORY_CALLER); }
 
 void
 operator delete (void *ptr, std::size_t size) throw()
@@ -88,22 +670,413 @@ void
 operator delete[](void *ptr) throw()
 { custom_delete(ptr, 0); }
 
-#endif
+// The nothrow versions are also replaced, as not every implementation
+// forwards them to the versions above (e.g. sanitizers), and memory from
+// any of them can be freed by any of the deletes.
 
+void *
+operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    try {
+        return custom_new(size, __MEMORY_CALLER);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+void *
+operator new (std::size_t size, const std::nothrow_t &) noexcept
+{
+    try {
+        return custom_new(size, __MEMORY_CALLER);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+void
+operator delete (void *ptr, const std::nothrow_t &) noexcept
+{ custom_delete(ptr, 0); }
+
+void
+operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{ custom_delete(ptr, 0); }
+
+/// Get Memory Stats
+///
+/// @expects none
+/// @ensures none
+///
+/// @return a snapshot of the allocation profiler's counters
+///
+inline memory_stats
+get_memory_stats() noexcept
+{
+    memory_stats stats;
+
+    stats.page_bytes = g_page_allocs.load();
+    stats.nonpage_bytes = g_nonpage_allocs.load();
+    stats.allocs = g_num_allocs.load();
+    stats.frees = g_num_frees.load();
+    stats.live_bytes = g_live_bytes.load();
+    stats.peak_bytes = g_peak_bytes.load();
+
+    for (std::size_t i = 0; i < memory_stats_classes; i++) {
+        stats.histogram.at(i) = g_alloc_histogram.at(i).load();
+    }
+
+    return stats;
+}
+
+/// Memory Stats Scope
+///
+/// Takes a snapshot of the allocation profiler's counters when it is
+/// created, so that the allocations made by a code path can be measured
+/// (and asserted on):
+///
+/// @code
+/// memory_stats_scope scope;
+/// func();
+/// CHECK(scope.stats().allocs == 1);
+/// @endcode
+///
+/// Since there is only one peak counter, creating a scope resets the peak
+/// to the current number of live bytes, and the peak of the scope is how
+/// far it rose above that. Scopes should therefore not be nested if
+/// peak_bytes is used.
+///
+class memory_stats_scope
+{
+public:
+
+    /// Default Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    memory_stats_scope() noexcept
+    {
+        g_peak_bytes.store(g_live_bytes.load());
+        m_start = get_memory_stats();
+    }
+
+    /// Stats
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the difference between the allocation profiler's counters
+    ///     now and when this scope was created. live_bytes is the number of
+    ///     bytes allocated in this scope that have not been freed (which
+    ///     can wrap if more was freed than allocated), and peak_bytes is the
+    ///     most that live_bytes reached.
+    ///
+    memory_stats
+    stats() const noexcept
+    {
+        auto now = get_memory_stats();
+
+        now.page_bytes -= m_start.page_bytes;
+        now.nonpage_bytes -= m_start.nonpage_bytes;
+        now.allocs -= m_start.allocs;
+        now.frees -= m_start.frees;
+        now.live_bytes -= m_start.live_bytes;
+        now.peak_bytes -= m_start.live_bytes;
+
+        for (std::size_t i = 0; i < memory_stats_classes; i++) {
+            now.histogram.at(i) -= m_start.histogram.at(i);
+        }
+
+        return now;
+    }
+
+private:
+    memory_stats m_start;
+};
+
+/// Measure Allocations
+///
+/// @expects none
+/// @ensures none
+///
+/// @param func the code path to measure
+/// @return the allocations made while func was executed
+///
+template<typename F>
+memory_stats
+measure_allocations(F func)
+{
+    memory_stats_scope scope;
+    func();
+
+    return scope.stats();
+}
+
+/// Print Memory Stats
+///
+/// @expects none
+/// @ensures none
+///
+/// @param stats the stats to print
+///
 inline void
-print_memory_stats()
+print_memory_stats(const memory_stats &stats)
 {
-    auto page_allocs = g_page_allocs;
-    auto nonpage_allocs = g_nonpage_allocs;
+    // The number macros keep their title per call site when
+    // DEBUG_BINARY_LOG is defined (see bfdebug.h), so one call site cannot
+    // print a different title for each size class. Instead, the titles come
+    // from this table, and the counts are printed as text, which is
+    // formatted right away and does not allocate.
 
-    bfdebug_nhex(0, "bytes allocated", page_allocs + nonpage_allocs);
-    bfdebug_subnhex(0, "page aligned bytes allocated", page_allocs);
-    bfdebug_subnhex(0, "non-page aligned bytes allocated", nonpage_allocs);
+    static constexpr const std::array<cstr_t, memory_stats_classes> s_titles{{
+        "allocations <= 1 bytes",
+        "allocations <= 2 bytes",
+        "allocations <= 4 bytes",
+        "allocations <= 8 bytes",
+        "allocations <= 16 bytes",
+        "allocations <= 32 bytes",
+        "allocations <= 64 bytes",
+        "allocations <= 128 bytes",
+        "allocations <= 256 bytes",
+        "allocations <= 512 bytes",
+        "allocations <= 1024 bytes",
+        "allocations <= 2048 bytes",
+        "allocations <= 4096 bytes",
+        "allocations <= 8192 bytes",
+        "allocations <= 16384 bytes",
+        "allocations <= 32768 bytes",
+        "allocations <= 65536 bytes",
+        "allocations <= 131072 bytes",
+        "allocations <= 262144 bytes",
+        "allocations <= 524288 bytes",
+        "allocations <= 1048576 bytes",
+        "allocations <= 2097152 bytes",
+        "allocations <= 4194304 bytes",
+        "allocations <= 8388608 bytes",
+        "allocations <= 16777216 bytes",
+        "allocations <= 33554432 bytes",
+        "allocations <= 67108864 bytes",
+        "allocations <= 134217728 bytes",
+        "allocations <= 268435456 bytes",
+        "allocations <= 536870912 bytes",
+        "allocations <= 1073741824 bytes",
+        "allocations > 1073741824 bytes"
+    }};
+
+    bfdebug_nhex(0, "bytes allocated", stats.page_bytes + stats.nonpage_bytes);
+    bfdebug_subnhex(0, "page aligned bytes allocated", stats.page_bytes);
+    bfdebug_subnhex(0, "non-page aligned bytes allocated", stats.nonpage_bytes);
+    bfdebug_subndec(0, "allocations", stats.allocs);
+    bfdebug_subndec(0, "frees", stats.frees);
+    bfdebug_subnhex(0, "live bytes", stats.live_bytes);
+    bfdebug_subnhex(0, "peak bytes", stats.peak_bytes);
+
+    for (std::size_t i = 0; i < memory_stats_classes; i++) {
+        if (stats.histogram.at(i) != 0) {
+            std::array<char, bfn::to_string_max_size + 1> str{};
+            bfn::to_string(str.data(), str.data() + bfn::to_string_max_size, stats.histogram.at(i), 10);
+
+            bfdebug_subtext(0, s_titles.at(i), str.data());
+        }
+    }
 }
 
+/// Print Memory Stats
+///
+/// Prints the allocation profiler's counters.
+///
+/// @expects none
+/// @ensures none
+///
+inline void
+print_memory_stats()
+{
+    auto stats = get_memory_stats();
+    print_memory_stats(stats);
+}
+
+/// Clear Memory Stats
+///
+/// Resets the allocation profiler's counters. live_bytes is not reset, as
+/// memory that is currently allocated is still live, and the peak is reset
+/// to live_bytes.
+///
+/// @expects none
+/// @ensures none
+///
 inline void
 clear_memory_stats()
 {
     g_page_allocs = 0;
     g_nonpage_allocs = 0;
+    g_num_allocs = 0;
+    g_num_frees = 0;
+    g_peak_bytes = g_live_bytes.load();
+
+    for (auto &cls : g_alloc_histogram) {
+        cls = 0;
+    }
+}
+
+/// Enable Memory Call Sites
+///
+/// When enabled, every allocation is attributed to its call site (see
+/// memory_callsite), which is useful for finding which code path is
+/// allocating. This is disabled by default as capturing a stack on each
+/// allocation is expensive.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param enable true to enable call site tracking, false to disable it
+///
+inline void
+enable_memory_callsites(bool enable = true)
+{
+#ifdef BFBENCHMARK_EXECINFO
+
+    // The first call to backtrace() loads the unwinder, which can allocate,
+    // so it is done here and not from inside operator new.
+
+    std::array<void *, 1> stack;
+    backtrace(stack.data(), static_cast<int>(stack.size()));
+
+#endif
+
+    g_memory_callsites_enabled.store(enable);
+}
+
+/// Get Memory Call Sites
+///
+/// @expects none
+/// @ensures none
+///
+/// @return the call sites that have been recorded, sorted by the number of
+///     bytes allocated (largest first)
+///
+inline std::vector<memory_callsite>
+get_memory_callsites()
+{
+    std::vector<memory_callsite> sites;
+
+    for (const auto &entry : g_memory_callsites) {
+        if (!entry.ready.load(std::memory_order_acquire)) {
+            continue;
+        }
+
+        memory_callsite site;
+        site.frames = entry.frames;
+        site.depth = entry.depth;
+        site.allocs = entry.allocs.load(std::memory_order_relaxed);
+        site.bytes = entry.bytes.load(std::memory_order_relaxed);
+
+        sites.push_back(site);
+    }
+
+    std::sort(sites.begin(), sites.end(), [](const auto & lhs, const auto & rhs) {
+        return lhs.bytes > rhs.bytes;
+    });
+
+    return sites;
 }
+
+/// Memory Call Sites Dropped
+///
+/// @expects none
+/// @ensures none
+///
+/// @return the number of allocations that were not attributed to a call
+///     site because the call site table was full
+///
+inline std::size_t
+memory_callsites_dropped() noexcept
+{ return g_memory_callsites_dropped.load(); }
+
+/// Clear Memory Call Sites
+///
+/// Removes all of the recorded call sites. This must not be called while
+/// other threads are allocating with call site tracking enabled.
+///
+/// @expects none
+/// @ensures none
+///
+inline void
+clear_memory_callsites() noexcept
+{
+    for (auto &entry : g_memory_callsites) {
+        entry.ready = false;
+        entry.allocs = 0;
+        entry.bytes = 0;
+        entry.key = 0;
+    }
+
+    g_memory_callsites_dropped = 0;
+}
+
+/// @cond
+
+inline void
+__print_memory_callsites(const char *title, const std::vector<memory_callsite> &sites, std::size_t num)
+{
+    bfdebug_info(0, title);
+
+    for (std::size_t i = 0; i < std::min(num, sites.size()); i++) {
+        const auto &site = sites.at(i);
+
+        bfdebug_brk2(0);
+        bfdebug_subnhex(0, "bytes allocated", site.bytes);
+        bfdebug_subndec(0, "allocations", site.allocs);
+
+#ifdef BFBENCHMARK_EXECINFO
+
+        auto symbols = backtrace_symbols(site.frames.data(), static_cast<int>(site.depth));
+        if (symbols != nullptr) {
+            for (std::size_t f = 0; f < site.depth; f++) {
+                bfdebug_subtext(0, "frame", symbols[f]);
+            }
+
+            free(symbols);
+            continue;
+        }
+
+#endif
+
+        for (std::size_t f = 0; f < site.depth; f++) {
+            bfdebug_subnhex(0, "frame", site.frames.at(f));
+        }
+    }
+}
+
+/// @endcond
+
+/// Print Memory Call Sites
+///
+/// Prints the top call sites by bytes allocated, and by number of
+/// allocations. Frames can be resolved using addr2line if the binary was
+/// not linked with -rdynamic.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param num the number of call sites to print for each list
+///
+inline void
+print_memory_callsites(std::size_t num = 10)
+{
+    auto sites = get_memory_callsites();
+    __print_memory_callsites("top allocation call sites by bytes", sites, num);
+
+    std::stable_sort(sites.begin(), sites.end(), [](const auto & lhs, const auto & rhs) {
+        return lhs.allocs > rhs.allocs;
+    });
+
+    __print_memory_callsites("top allocation call sites by count", sites, num);
+
+    if (auto dropped = memory_callsites_dropped()) {
+        bfdebug_subndec(0, "allocations not attributed", dropped);
+    }
+}
+
+#endif
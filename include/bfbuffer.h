@@ -26,20 +26,203 @@
 #ifndef BFBUFFER_H
 #define BFBUFFER_H
 
+#include <atomic>
+#include <limits>
+#include <new>
+#include <vector>
+
 #include <bfgsl.h>
 #include <bfdebug.h>
+#include <bfconstants.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#if defined(NATIVE) && defined(__linux__)
+#include <sys/mman.h>
+#endif
 
 namespace bfn
 {
 
-/// Buffer
+/// Small Buffer Size
+///
+/// The number of bytes that a bfn::small_buffer stores inline (i.e. without
+/// allocating memory).
+///
+constexpr const std::size_t small_buffer_size = 64;
+
+/// Huge Page Size
+///
+/// The size (and alignment) of a buffer allocated using
+/// buffer_policy::huge_page.
+///
+constexpr const std::size_t huge_page_size = 0x200000;
+
+/// Buffer Policy
+///
+/// Defines how a buffer allocates its memory. Buffers that are given to the
+/// VMM (e.g. using VMCALL_DATA or IOCTL_ADD_MODULE) are mapped by the VMM a
+/// page at a time, so buffers that are page aligned need fewer pages to be
+/// mapped, and do not expose neighbouring data.
+///
+enum class buffer_policy {
+    standard,       ///< allocated using new[] (or stored inline)
+    page,           ///< page aligned, and rounded up to a multiple of a page
+    huge_page       ///< 2M aligned, rounded up to a multiple of 2M, with a transparent huge page hint
+};
+
+/// @cond
+
+struct __buffer_deleter {
+    buffer_policy policy{buffer_policy::standard};
+
+    void
+    operator()(char *ptr) const noexcept
+    {
+        if (policy == buffer_policy::standard) {
+            delete[] ptr;
+            return;
+        }
+
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        free(ptr);
+#endif
+    }
+};
+
+// Allocates count bytes (without initialising them) using the provided
+// policy. Aligned allocations are rounded up to a multiple of their
+// alignment, and count is updated to the size that was allocated.
+
+inline char *
+__buffer_alloc(buffer_policy policy, std::size_t &count)
+{
+    if (policy == buffer_policy::standard) {
+        return new char[count];
+    }
+
+    auto align = policy == buffer_policy::page ? MAX_PAGE_SIZE : huge_page_size;
+
+    if (count > std::numeric_limits<std::size_t>::max() - align) {
+        throw std::bad_alloc();
+    }
+
+    count = count == 0 ? align : (count + align - 1) & ~(align - 1);
+
+#ifdef _WIN32
+    auto ptr = static_cast<char *>(_aligned_malloc(count, align));
+#else
+    auto ptr = static_cast<char *>(aligned_alloc(align, count));
+#endif
+
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+
+#if defined(NATIVE) && defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (policy == buffer_policy::huge_page) {
+        madvise(ptr, count, MADV_HUGEPAGE);
+    }
+#endif
+
+    return ptr;
+}
+
+template<std::size_t N>
+class __buffer_inline
+{
+protected:
+
+    char *
+    inline_data() noexcept
+    { return m_inline_used ? m_inline.data() : nullptr; }
+
+    const char *
+    inline_data() const noexcept
+    { return m_inline_used ? m_inline.data() : nullptr; }
+
+    char *
+    inline_use() noexcept
+    {
+        m_inline_used = true;
+        return m_inline.data();
+    }
+
+    void
+    inline_clear() noexcept
+    { m_inline_used = false; }
+
+    void
+    inline_swap(__buffer_inline &other) noexcept
+    {
+        std::swap(m_inline, other.m_inline);
+        std::swap(m_inline_used, other.m_inline_used);
+    }
+
+private:
+
+    std::array<char, N> m_inline;
+    bool m_inline_used{false};
+};
+
+template<>
+class __buffer_inline<0>
+{
+protected:
+
+    char *
+    inline_data() noexcept
+    { return nullptr; }
+
+    const char *
+    inline_data() const noexcept
+    { return nullptr; }
+
+    char *
+    inline_use() noexcept
+    { return nullptr; }
+
+    void
+    inline_clear() noexcept
+    { }
+
+    void
+    inline_swap(__buffer_inline &) noexcept
+    { }
+};
+
+/// @endcond
+
+/// Basic Buffer
 ///
 /// Simple character buffer class that stores both a buffer and its size.
 /// This class is a hybrid between std::array, and std::unique_ptr. It's
 /// dynamic, doesn't have support for iterators or random memory access,
 /// and cannot be copied.
 ///
-class buffer
+/// Buffers of up to N bytes are stored inline (i.e. in the buffer object
+/// itself) and do not allocate memory. Note that for an inline buffer,
+/// data() points into the buffer object, and is therefore invalidated by
+/// a move or swap.
+///
+/// bfn::buffer (N == 0) always allocates, and bfn::small_buffer stores
+/// small_buffer_size bytes inline.
+///
+/// Like std::vector, a buffer has a capacity, and growing a buffer (using
+/// resize, reserve or append) only reallocates when its capacity is
+/// exceeded, in which case the capacity is at least doubled, so that
+/// appending is amortised O(1).
+///
+/// A buffer can also be given an allocation policy (see buffer_policy),
+/// which is kept when the buffer is reallocated. Buffers with a policy
+/// other than buffer_policy::standard are never stored inline.
+///
+template<std::size_t N>
+class basic_buffer : private __buffer_inline<N>
 {
 public:
 
@@ -51,7 +234,7 @@ public:
     /// @expects none
     /// @ensures none
     ///
-    buffer() = default;
+    basic_buffer() = default;
 
     /// Allocate Buffer Constructor
     ///
@@ -59,14 +242,19 @@ public:
     /// @ensures none
     ///
     /// @param size the size of the buffer to allocate
+    /// @param policy how the buffer's memory is allocated
     ///
     /// @throws std::bad_alloc if this constructor is unable to allocate memory for the buffer
     ///
-    buffer(size_type size) :
-        m_size(size),
-        m_data(std::make_unique<data_type[]>(m_size))
+    basic_buffer(size_type size, buffer_policy policy = buffer_policy::standard) :
+        m_data(nullptr, __buffer_deleter{policy})
     {
         expects(size != 0);
+
+        this->grow(size);
+        m_size = size;
+
+        memset(this->data(), 0, size);
     }
 
     /// Pre-Allocated Buffer Constructor
@@ -80,8 +268,9 @@ public:
     /// @param data a pointer to the buffer to store.
     /// @param size the size of the provided buffer
     ///
-    buffer(void *data, size_type size) :
+    basic_buffer(void *data, size_type size) :
         m_size(size),
+        m_capacity(size),
         m_data(static_cast<data_type *>(data))
     {
         expects(size != 0 || data == nullptr);
@@ -97,10 +286,17 @@ public:
     ///
     /// @throws std::bad_alloc if this constructor is unable to allocate memory for the buffer
     ///
-    buffer(std::initializer_list<data_type> list) :
-        m_size(list.size()),
-        m_data(std::make_unique<data_type[]>(m_size))
+    basic_buffer(std::initializer_list<data_type> list) :
+        m_size(list.size())
     {
+        if (N != 0 && m_size <= N) {
+            this->inline_use();
+        }
+        else {
+            m_data.reset(new data_type[m_size]);
+            m_capacity = m_size;
+        }
+
         gsl::span<const data_type> list_span(list);
         gsl::copy(list_span, span());
     }
@@ -110,7 +306,34 @@ public:
     /// @expects none
     /// @ensures none
     ///
-    ~buffer() = default;
+    ~basic_buffer() = default;
+
+    /// Make Uninitialised
+    ///
+    /// Same as basic_buffer(size), but the contents of the buffer are not
+    /// initialised, which is faster for buffers that are about to be
+    /// overwritten (e.g. reading a file).
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param size the size of the buffer to allocate
+    /// @param policy how the buffer's memory is allocated
+    /// @return a buffer of size bytes, with undefined contents
+    ///
+    /// @throws std::bad_alloc if this function is unable to allocate memory for the buffer
+    ///
+    static basic_buffer
+    make_uninitialised(size_type size, buffer_policy policy = buffer_policy::standard)
+    {
+        basic_buffer buffer;
+
+        buffer.m_data.get_deleter().policy = policy;
+        buffer.grow(size);
+        buffer.m_size = size;
+
+        return buffer;
+    }
 
     /// Get Data
     ///
@@ -120,7 +343,7 @@ public:
     /// @return returns a pointer to the buffer
     ///
     data_type *get() noexcept
-    { return m_data.get(); }
+    { return this->data(); }
 
     /// Get Data
     ///
@@ -130,7 +353,7 @@ public:
     /// @return returns a pointer to the buffer
     ///
     data_type *data() noexcept
-    { return m_data.get(); }
+    { return m_data ? m_data.get() : this->inline_data(); }
 
     /// Get Data
     ///
@@ -140,7 +363,7 @@ public:
     /// @return returns a pointer to the buffer
     ///
     const data_type *data() const noexcept
-    { return m_data.get(); }
+    { return m_data ? m_data.get() : this->inline_data(); }
 
     /// Is Empty
     ///
@@ -157,7 +380,7 @@ public:
     /// @return returns true if the buffer is valid, false otherwise
     ///
     operator bool() const noexcept
-    { return m_data.operator bool(); }
+    { return this->data() != nullptr; }
 
     /// Size
     ///
@@ -169,8 +392,51 @@ public:
     size_type size() const noexcept
     { return m_size; }
 
+    /// Capacity
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return returns the number of bytes that the buffer can grow to
+    ///     without reallocating
+    ///
+    size_type capacity() const noexcept
+    {
+        if (m_data) {
+            return m_capacity;
+        }
+
+        return this->policy() == buffer_policy::standard ? N : 0;
+    }
+
+    /// Policy
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return returns how the buffer's memory is allocated
+    ///
+    buffer_policy policy() const noexcept
+    { return m_data.get_deleter().policy; }
+
+    /// Is Inline
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return returns true if the buffer is stored inline (i.e. no memory
+    ///     was allocated), false otherwise
+    ///
+    bool is_inline() const noexcept
+    { return !m_data && this->inline_data() != nullptr; }
+
     /// Release
     ///
+    /// Gives up ownership of the buffer, which must then be freed by the
+    /// caller using delete[] (or free() if the buffer's policy is not
+    /// buffer_policy::standard). An inline buffer is not owned by anyone,
+    /// and is simply discarded.
+    ///
     /// @expects none
     /// @ensures none
     ///
@@ -178,7 +444,10 @@ public:
     release() noexcept
     {
         m_size = 0;
+        m_capacity = 0;
         m_data.release();
+
+        this->inline_clear();
     }
 
     /// Swap
@@ -189,10 +458,13 @@ public:
     /// @param other the other buffer to swap with
     ///
     void
-    swap(buffer &other) noexcept
+    swap(basic_buffer &other) noexcept
     {
         std::swap(m_size, other.m_size);
+        std::swap(m_capacity, other.m_capacity);
         std::swap(m_data, other.m_data);
+
+        this->inline_swap(other);
     }
 
     /// Span
@@ -204,13 +476,18 @@ public:
     ///
     gsl::span<data_type>
     span() const
-    { return gsl::make_span(m_data, gsl::narrow_cast<std::ptrdiff_t>(m_size)); }
+    {
+        auto ptr = const_cast<data_type *>(this->data());
+        return gsl::make_span(ptr, gsl::narrow_cast<std::ptrdiff_t>(m_size));
+    }
 
     /// Resize
     ///
     /// Resize the buffer. If count is smaller than the original size, the
     /// data is truncated. If count is larger than the original size, the
-    /// remaining data is undefined.
+    /// remaining data is undefined. The buffer is only reallocated if count
+    /// is larger than capacity(), in which case the capacity is at least
+    /// doubled.
     ///
     /// @expects none
     /// @ensures none
@@ -222,67 +499,904 @@ public:
     void
     resize(size_type count)
     {
-        auto new_data = std::make_unique<data_type[]>(count);
-        memcpy(new_data.get(), m_data.get(), std::min(m_size, count));
+        if (count > this->capacity()) {
+            this->grow(std::max(count, this->capacity() * 2));
+        }
+        else {
+            this->storage();
+        }
 
         m_size = count;
+    }
+
+    /// Reserve
+    ///
+    /// Increases the capacity of the buffer to at least count bytes, so that
+    /// the buffer can grow to count bytes without reallocating. The size of
+    /// the buffer is not changed.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param count the number of bytes to reserve
+    ///
+    /// @throws std::bad_alloc if this method is unable to allocate memory for the buffer
+    ///
+    void
+    reserve(size_type count)
+    {
+        if (count > this->capacity()) {
+            this->grow(count);
+        }
+    }
+
+    /// Append
+    ///
+    /// Adds len bytes from data to the end of the buffer, growing the buffer
+    /// geometrically if needed.
+    ///
+    /// @expects data != nullptr || len == 0
+    /// @ensures none
+    ///
+    /// @param data the data to append
+    /// @param len the number of bytes to append
+    ///
+    /// @throws std::bad_alloc if this method is unable to allocate memory for the buffer
+    ///
+    void
+    append(const void *data, size_type len)
+    {
+        expects(data != nullptr || len == 0);
+
+        if (len == 0) {
+            return;
+        }
+
+        auto size = m_size;
+
+        this->resize(m_size + len);
+        memcpy(this->data() + size, data, len);
+    }
+
+    /// Shrink To Fit
+    ///
+    /// Reduces the capacity of the buffer to its size, moving the buffer
+    /// inline if it fits.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @throws std::bad_alloc if this method is unable to allocate memory for the buffer
+    ///
+    void
+    shrink_to_fit()
+    {
+        if (!m_data || m_capacity == m_size) {
+            return;
+        }
+
+        if (N != 0 && m_size <= N && this->policy() == buffer_policy::standard) {
+            memcpy(this->inline_use(), m_data.get(), m_size);
+
+            m_data.reset();
+            m_capacity = 0;
+
+            return;
+        }
+
+        auto size = m_size;
+
+        basic_buffer tmp;
+        tmp.m_data.get_deleter().policy = this->policy();
+        tmp.grow(size);
+        tmp.m_size = size;
+
+        memcpy(tmp.data(), this->data(), size);
+        this->swap(tmp);
+    }
+
+private:
+
+    // Returns the storage of the buffer, using the inline storage if the
+    // buffer has not allocated.
+
+    data_type *
+    storage() noexcept
+    {
+        if (m_data) {
+            return m_data.get();
+        }
+
+        return this->policy() == buffer_policy::standard ? this->inline_use() : nullptr;
+    }
+
+    // Moves the buffer to storage with a capacity of at least count bytes
+    // (without initialising it), which is inline if it fits.
+
+    void
+    grow(size_type count)
+    {
+        auto policy = this->policy();
+
+        if (N != 0 && count <= N && policy == buffer_policy::standard) {
+            this->storage();
+            return;
+        }
+
+        auto ptr = __buffer_alloc(policy, count);
+        auto new_data = std::unique_ptr<data_type[], __buffer_deleter>(ptr, __buffer_deleter{policy});
+
+        if (auto size = std::min(m_size, count)) {
+            memcpy(new_data.get(), this->data(), size);
+        }
+
+        m_capacity = count;
         m_data = std::move(new_data);
+
+        this->inline_clear();
     }
 
 private:
 
     size_type m_size{0};
-    std::unique_ptr<data_type[]> m_data;
+    size_type m_capacity{0};
+    std::unique_ptr<data_type[], __buffer_deleter> m_data;
 
 public:
 
-    buffer(buffer &&) noexcept = default;               ///< Default move construction
-    buffer &operator=(buffer &&) noexcept = default;    ///< Default move operator
+    /// Move Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param other the buffer to move
+    ///
+    basic_buffer(basic_buffer &&other) noexcept
+    { this->swap(other); }
+
+    /// Move Operator
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param other the buffer to move
+    /// @return *this
+    ///
+    basic_buffer &operator=(basic_buffer &&other) noexcept
+    {
+        basic_buffer tmp(std::move(other));
+        this->swap(tmp);
+
+        return *this;
+    }
 
-    buffer(const buffer &) = delete;                    ///< Default copy construction
-    buffer &operator=(const buffer &) = delete;         ///< Default copy operator
+    basic_buffer(const basic_buffer &) = delete;                ///< Default copy construction
+    basic_buffer &operator=(const basic_buffer &) = delete;     ///< Default copy operator
 };
 
-/// Swap
-///
-/// @expects none
-/// @ensures none
+/// Buffer
 ///
-/// @param lhs buffer to swap
-/// @param rhs buffer to swap
+/// A buffer that always allocates its memory (see basic_buffer).
 ///
-inline void
-swap(buffer &lhs, buffer &rhs) noexcept
-{ lhs.swap(rhs); }
+using buffer = basic_buffer<0>;
 
-/// Equals
-///
-/// @expects none
-/// @ensures none
+/// Small Buffer
 ///
-/// @param lhs buffer to compare
-/// @param rhs buffer to compare
+/// A buffer that stores up to small_buffer_size bytes inline (see
+/// basic_buffer), for small payloads that should not allocate.
 ///
-inline bool
-operator==(const buffer &lhs, const buffer &rhs) noexcept
+using small_buffer = basic_buffer<small_buffer_size>;
+
+/// @cond
+
+// The reference count is stored in a header that is part of the same
+// allocation as the data where possible:
+//
+// - When raw bytes are copied, the header and the data are allocated
+//   together, and the data immediately follows the header (buf is empty).
+// - When a buffer is adopted, the header is placed in the buffer's spare
+//   capacity (after its data) if it fits, and buf owns the memory that the
+//   header lives in (in_buf is true).
+// - Otherwise (a buffer without enough spare capacity), the header is
+//   allocated on its own, which costs one allocation of
+//   sizeof(__shared_buffer_block) bytes, and a pointer hop to reach the
+//   data (which a view caches anyway).
+
+struct __shared_buffer_block {
+    std::atomic<std::size_t> refs;
+    buffer buf;
+    bool in_buf;
+
+    __shared_buffer_block(buffer &&b, bool i) noexcept :
+        refs(1),
+        buf(std::move(b)),
+        in_buf(i)
+    { }
+};
+
+inline __shared_buffer_block *
+__shared_buffer_adopt(buffer &&buf)
 {
-    if (lhs.size() != rhs.size()) {
-        return false;
+    auto align = alignof(__shared_buffer_block);
+    auto used = (buf.size() + align - 1) & ~(align - 1);
+
+    if (!buf.is_inline() && buf.capacity() >= used + sizeof(__shared_buffer_block)) {
+        return new (buf.data() + used) __shared_buffer_block(std::move(buf), true);
     }
 
-    return memcmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+    auto mem = ::operator new (sizeof(__shared_buffer_block));
+    return new (mem) __shared_buffer_block(std::move(buf), false);
 }
 
-/// Not Equals
+inline __shared_buffer_block *
+__shared_buffer_copy(const void *data, std::size_t size)
+{
+    if (size > std::numeric_limits<std::size_t>::max() - sizeof(__shared_buffer_block)) {
+        throw std::bad_alloc();
+    }
+
+    auto mem = ::operator new (sizeof(__shared_buffer_block) + size);
+    auto block = new (mem) __shared_buffer_block(buffer(), false);
+
+    memcpy(reinterpret_cast<char *>(block + 1), data, size);
+    return block;
+}
+
+inline void
+__shared_buffer_release(__shared_buffer_block *block) noexcept
+{
+    if (block->in_buf) {
+        buffer buf(std::move(block->buf));
+        block->~__shared_buffer_block();
+
+        return;
+    }
+
+    block->~__shared_buffer_block();
+    ::operator delete (block);
+}
+
+/// @endcond
+
+/// Shared Buffer Header Size
 ///
-/// @expects none
-/// @ensures none
+/// The amount of spare capacity (in bytes) that a buffer needs for a
+/// shared buffer to store its reference count in the buffer's own memory
+/// when the buffer is adopted (see shared_buffer).
 ///
-/// @param lhs buffer to compare
-/// @param rhs buffer to compare
+constexpr const std::size_t shared_buffer_header_size =
+    sizeof(__shared_buffer_block) + alignof(__shared_buffer_block) - 1;
+
+/// Shared Buffer
 ///
-inline bool
-operator!=(const buffer &lhs, const buffer &rhs) noexcept
+/// An immutable, reference counted buffer. Copying a shared buffer, or
+/// taking a slice of it, does not copy the data. Instead, the new shared
+/// buffer is a view of the same data, and the data is freed when the last
+/// view is destroyed. This is useful for handing sub-ranges of a buffer
+/// (e.g. an ELF section) to other code without copying.
+///
+/// The reference count is stored in the same allocation as the data, so a
+/// shared buffer made from raw bytes costs a single allocation. A buffer
+/// that is adopted only needs an extra allocation (for the reference count)
+/// if it does not have shared_buffer_header_size bytes of spare capacity,
+/// so reserve that much (see basic_buffer::reserve) to avoid it.
+///
+/// Copying and destroying shared buffers is thread safe.
+///
+class shared_buffer
+{
+public:
+
+    using size_type = std::size_t;      ///< Size type of buffer
+    using data_type = const char;       ///< Data type of buffer
+
+    /// Default Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    shared_buffer() noexcept = default;
+
+    /// Buffer Constructor
+    ///
+    /// Takes ownership of buf, without copying its data. If buf has at
+    /// least shared_buffer_header_size bytes of spare capacity, the
+    /// reference count is stored there, and nothing is allocated.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param buf the buffer to share
+    ///
+    /// @throws std::bad_alloc if this constructor is unable to allocate memory for the reference count
+    ///
+    shared_buffer(buffer &&buf)
+    {
+        if (!buf) {
+            return;
+        }
+
+        m_block = __shared_buffer_adopt(std::move(buf));
+        m_data = m_block->buf.data();
+        m_size = m_block->buf.size();
+    }
+
+    /// Copy Data Constructor
+    ///
+    /// @expects data != nullptr || size == 0
+    /// @ensures none
+    ///
+    /// @param data the data to copy into the shared buffer
+    /// @param size the number of bytes to copy
+    ///
+    /// @throws std::bad_alloc if this constructor is unable to allocate memory for the buffer
+    ///
+    shared_buffer(const void *data, size_type size)
+    {
+        expects(data != nullptr || size == 0);
+
+        if (size == 0) {
+            return;
+        }
+
+        m_block = __shared_buffer_copy(data, size);
+        m_data = reinterpret_cast<data_type *>(m_block + 1);
+        m_size = size;
+    }
+
+    /// Destructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    ~shared_buffer()
+    { this->reset(); }
+
+    /// Get Data
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return returns a pointer to the data of this view
+    ///
+    data_type *data() const noexcept
+    { return m_data; }
+
+    /// Is Empty
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return returns true if size() == 0, false otherwise
+    ///
+    bool empty() const noexcept
+    { return m_size == 0; }
+
+    /// Valid
+    ///
+    /// @return returns true if the shared buffer refers to data, false
+    ///     otherwise
+    ///
+    operator bool() const noexcept
+    { return m_block != nullptr; }
+
+    /// Size
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return returns the size of this view
+    ///
+    size_type size() const noexcept
+    { return m_size; }
+
+    /// Use Count
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return returns the number of shared buffers that refer to the same
+    ///     data (including this one), or 0 if this shared buffer is empty
+    ///
+    size_type use_count() const noexcept
+    { return m_block != nullptr ? m_block->refs.load(std::memory_order_relaxed) : 0; }
+
+    /// Span
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return returns a gsl::span that can be used to access this view
+    ///
+    gsl::span<data_type>
+    span() const
+    { return gsl::make_span(m_data, gsl::narrow_cast<std::ptrdiff_t>(m_size)); }
+
+    /// Span
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return returns a gsl::span that can be used to access this view
+    ///
+    operator gsl::span<data_type>() const
+    { return this->span(); }
+
+    /// Slice
+    ///
+    /// Creates a view of part of this view, which shares (and keeps alive)
+    /// the same data. No data is copied.
+    ///
+    /// @expects offset <= size()
+    /// @expects len <= size() - offset
+    /// @ensures none
+    ///
+    /// @param offset the offset of the slice in this view
+    /// @param len the size of the slice
+    /// @return returns the slice
+    ///
+    shared_buffer
+    slice(size_type offset, size_type len) const
+    {
+        expects(offset <= m_size);
+        expects(len <= m_size - offset);
+
+        shared_buffer view(*this);
+
+        view.m_data = m_data + offset;
+        view.m_size = len;
+
+        return view;
+    }
+
+    /// Slice
+    ///
+    /// @expects offset <= size()
+    /// @ensures none
+    ///
+    /// @param offset the offset of the slice in this view
+    /// @return returns a view of this view, from offset to the end
+    ///
+    shared_buffer
+    slice(size_type offset) const
+    {
+        expects(offset <= m_size);
+        return this->slice(offset, m_size - offset);
+    }
+
+    /// Reset
+    ///
+    /// Releases this view's reference to the data, freeing the data if this
+    /// was the last view.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    void
+    reset() noexcept
+    {
+        if (m_block != nullptr && m_block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            __shared_buffer_release(m_block);
+        }
+
+        m_block = nullptr;
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    /// Swap
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param other the other shared buffer to swap with
+    ///
+    void
+    swap(shared_buffer &other) noexcept
+    {
+        std::swap(m_block, other.m_block);
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+    }
+
+private:
+
+    __shared_buffer_block *m_block{nullptr};
+    data_type *m_data{nullptr};
+    size_type m_size{0};
+
+public:
+
+    /// Copy Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param other the shared buffer to copy
+    ///
+    shared_buffer(const shared_buffer &other) noexcept :
+        m_block(other.m_block),
+        m_data(other.m_data),
+        m_size(other.m_size)
+    {
+        if (m_block != nullptr) {
+            m_block->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /// Copy Operator
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param other the shared buffer to copy
+    /// @return *this
+    ///
+    shared_buffer &operator=(const shared_buffer &other) noexcept
+    {
+        shared_buffer tmp(other);
+        this->swap(tmp);
+
+        return *this;
+    }
+
+    /// Move Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param other the shared buffer to move
+    ///
+    shared_buffer(shared_buffer &&other) noexcept
+    { this->swap(other); }
+
+    /// Move Operator
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param other the shared buffer to move
+    /// @return *this
+    ///
+    shared_buffer &operator=(shared_buffer &&other) noexcept
+    {
+        shared_buffer tmp(std::move(other));
+        this->swap(tmp);
+
+        return *this;
+    }
+};
+
+/// Swap
+///
+/// @expects none
+/// @ensures none
+///
+/// @param lhs shared buffer to swap
+/// @param rhs shared buffer to swap
+///
+inline void
+swap(shared_buffer &lhs, shared_buffer &rhs) noexcept
+{ lhs.swap(rhs); }
+
+/// Equals
+///
+/// @expects none
+/// @ensures none
+///
+/// @param lhs shared buffer to compare
+/// @param rhs shared buffer to compare
+///
+inline bool
+operator==(const shared_buffer &lhs, const shared_buffer &rhs) noexcept
+{
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+
+    return lhs.size() == 0 || memcmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+}
+
+/// Not Equals
+///
+/// @expects none
+/// @ensures none
+///
+/// @param lhs shared buffer to compare
+/// @param rhs shared buffer to compare
+///
+inline bool
+operator!=(const shared_buffer &lhs, const shared_buffer &rhs) noexcept
+{ return !(lhs == rhs); }
+
+/// Buffer Chain
+///
+/// A list of segments that together make up one logical buffer (e.g. a
+/// header and a payload), so that the pieces do not need to be
+/// concatenated before they are written (see file::write_chain, which uses
+/// scatter-gather I/O). A segment is either a span that the caller keeps
+/// alive, or a shared buffer that the chain keeps alive.
+///
+/// If a contiguous view is needed, flatten() copies the segments into a
+/// single page aligned buffer, once, and only then.
+///
+class buffer_chain
+{
+public:
+
+    using size_type = std::size_t;                      ///< Size type of the chain
+    using segment_type = gsl::span<const char>;         ///< Type of a segment
+
+    /// Default Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    buffer_chain() = default;
+
+    /// Default Destructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    ~buffer_chain() = default;
+
+    /// Append (Span)
+    ///
+    /// Adds a segment to the end of the chain, without copying it. The
+    /// caller must keep the data alive for as long as the chain uses it.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param data the segment to add
+    ///
+    /// @throws std::bad_alloc if this method is unable to allocate memory for the segment
+    ///
+    void
+    append(segment_type data)
+    { this->append(data, shared_buffer()); }
+
+    /// Append (Shared Buffer)
+    ///
+    /// Adds a segment to the end of the chain, without copying it. The chain
+    /// keeps a reference to data.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param data the segment to add
+    ///
+    /// @throws std::bad_alloc if this method is unable to allocate memory for the segment
+    ///
+    void
+    append(const shared_buffer &data)
+    { this->append(data.span(), data); }
+
+    /// Append (Buffer)
+    ///
+    /// Adds a segment to the end of the chain, taking ownership of data
+    /// without copying it.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param data the segment to add
+    ///
+    /// @throws std::bad_alloc if this method is unable to allocate memory for the segment
+    ///
+    void
+    append(buffer &&data)
+    { this->append(shared_buffer(std::move(data))); }
+
+    /// Size
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return returns the total size of all of the segments
+    ///
+    size_type size() const noexcept
+    { return m_size; }
+
+    /// Is Empty
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return returns true if size() == 0, false otherwise
+    ///
+    bool empty() const noexcept
+    { return m_size == 0; }
+
+    /// Segments
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return returns the segments of the chain, in order (empty segments
+    ///     are not stored)
+    ///
+    const std::vector<segment_type> &segments() const noexcept
+    { return m_segments; }
+
+    /// Flatten
+    ///
+    /// Returns the chain as a single contiguous, page aligned buffer. If the
+    /// chain is not already a single page aligned segment that it owns, the
+    /// segments are copied into a new buffer, which then replaces them, so
+    /// the copy is only made once.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return returns the contents of the chain
+    ///
+    /// @throws std::bad_alloc if this method is unable to allocate memory for the buffer
+    ///
+    shared_buffer
+    flatten()
+    {
+        if (m_size == 0) {
+            return {};
+        }
+
+        if (m_segments.size() == 1 && m_owners.front()) {
+            auto addr = reinterpret_cast<uintptr_t>(m_owners.front().data());
+
+            if ((addr & (MAX_PAGE_SIZE - 1)) == 0) {
+                return m_owners.front();
+            }
+        }
+
+        auto buf = buffer::make_uninitialised(m_size, buffer_policy::page);
+        auto ptr = buf.data();
+
+        for (const auto &segment : m_segments) {
+            memcpy(ptr, segment.data(), static_cast<size_type>(segment.size()));
+            ptr += segment.size();
+        }
+
+        shared_buffer flat(std::move(buf));
+
+        this->clear();
+        this->append(flat);
+
+        return flat;
+    }
+
+    /// Clear
+    ///
+    /// Removes all of the segments from the chain.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    void
+    clear() noexcept
+    {
+        m_segments.clear();
+        m_owners.clear();
+        m_size = 0;
+    }
+
+private:
+
+    void
+    append(segment_type data, const shared_buffer &owner)
+    {
+        if (data.empty()) {
+            return;
+        }
+
+        m_segments.push_back(data);
+
+        try {
+            m_owners.push_back(owner);
+        }
+        catch (...) {
+            m_segments.pop_back();
+            throw;
+        }
+
+        m_size += static_cast<size_type>(data.size());
+    }
+
+private:
+
+    std::vector<segment_type> m_segments;
+    std::vector<shared_buffer> m_owners;
+    size_type m_size{0};
+
+public:
+
+    buffer_chain(buffer_chain &&) noexcept = default;               ///< Default move construction
+    buffer_chain &operator=(buffer_chain &&) noexcept = default;    ///< Default move operator
+
+    buffer_chain(const buffer_chain &) = default;                   ///< Default copy construction
+    buffer_chain &operator=(const buffer_chain &) = default;        ///< Default copy operator
+};
+
+/// Pages Spanned
+///
+/// @expects none
+/// @ensures none
+///
+/// @param ptr the start of the memory
+/// @param size the size of the memory in bytes
+/// @return the number of pages that [ptr, ptr + size) touches, which is the
+///     number of pages that must be mapped to access it
+///
+inline std::size_t
+pages_spanned(const void *ptr, std::size_t size) noexcept
+{
+    if (size == 0) {
+        return 0;
+    }
+
+    auto addr = reinterpret_cast<uintptr_t>(ptr);
+    auto first = addr & ~(MAX_PAGE_SIZE - 1);
+    auto last = (addr + size - 1) & ~(MAX_PAGE_SIZE - 1);
+
+    return static_cast<std::size_t>((last - first) / MAX_PAGE_SIZE + 1);
+}
+
+/// Pages Spanned
+///
+/// @expects none
+/// @ensures none
+///
+/// @param buf the buffer to check
+/// @return the number of pages that the buffer's data touches
+///
+template<std::size_t N>
+std::size_t
+pages_spanned(const basic_buffer<N> &buf) noexcept
+{ return pages_spanned(buf.data(), buf.size()); }
+
+/// Swap
+///
+/// @expects none
+/// @ensures none
+///
+/// @param lhs buffer to swap
+/// @param rhs buffer to swap
+///
+template<std::size_t N>
+void
+swap(basic_buffer<N> &lhs, basic_buffer<N> &rhs) noexcept
+{ lhs.swap(rhs); }
+
+/// Equals
+///
+/// @expects none
+/// @ensures none
+///
+/// @param lhs buffer to compare
+/// @param rhs buffer to compare
+///
+template<std::size_t N1, std::size_t N2>
+bool
+operator==(const basic_buffer<N1> &lhs, const basic_buffer<N2> &rhs) noexcept
+{
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+
+    return memcmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+}
+
+/// Not Equals
+///
+/// @expects none
+/// @ensures none
+///
+/// @param lhs buffer to compare
+/// @param rhs buffer to compare
+///
+template<std::size_t N1, std::size_t N2>
+bool
+operator!=(const basic_buffer<N1> &lhs, const basic_buffer<N2> &rhs) noexcept
 { return !(lhs == rhs); }
 
 }
@@ -195,6 +195,32 @@
  */
 #define DEBUG_RING_SIZE (1 << DEBUG_RING_SHIFT)
 
+/*
+ * Debug Buffer Size
+ *
+ * Defines the size of the buffers that are used by the debug macros to
+ * compose a message before it is written. When DEBUG_PERCPU_BUFFERS is
+ * defined, each CPU gets one of these for the message and one for the
+ * current line, which are reused for every message so that logging does not
+ * allocate memory once a CPU has logged for the first time.
+ *
+ * Note: defined in bytes
+ */
+#ifndef DEBUG_BUFFER_SIZE
+#define DEBUG_BUFFER_SIZE (0x1000ULL)
+#endif
+
+/*
+ * Max Supported CPUs
+ *
+ * The maximum number of CPUs that per-CPU resources (for example, the debug
+ * buffers) are statically sized for. CPUs with an id above this limit fall
+ * back to using dynamically allocated resources.
+ */
+#ifndef MAX_NUM_CPUS
+#define MAX_NUM_CPUS (256ULL)
+#endif
+
 /*
  * Stack Size
  *
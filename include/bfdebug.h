@@ -35,7 +35,9 @@
 
 #include <bfgsl.h>
 #include <bfstring.h>
+#include <bfdebugringinterface.h>
 
+#include <array>
 #include <type_traits>
 
 #ifdef _MSC_VER
@@ -101,22 +103,35 @@ view_as_pointer(const T val)
 /* Helpers (Private)                                                          */
 /* ---------------------------------------------------------------------------*/
 
+inline uint64_t
+__bfdebug_cpuid()
+{
+#ifdef VMM
+    return thread_context_cpuid();
+#else
+    return 0;
+#endif
+}
+
 inline void
-__bfdebug_core(gsl::not_null<std::string *> msg)
+__bfdebug_core(gsl::not_null<std::string *> msg, uint64_t cpuid)
 {
+    std::array<char, bfn::to_string_max_size> str;
+    auto ret = bfn::to_string(str.data(), str.data() + str.size(), cpuid, 10);
+
     *msg += bfcolor_cyan;
     *msg += "[";
     *msg += bfcolor_yellow;
-#ifdef VMM
-    *msg += std::to_string(thread_context_cpuid());
-#else
-    *msg += '0';
-#endif
+    msg->append(str.data(), ret.ptr);
     *msg += bfcolor_cyan;
     *msg += "] ";
     *msg += bfcolor_end;
 }
 
+inline void
+__bfdebug_core(gsl::not_null<std::string *> msg)
+{ __bfdebug_core(msg, __bfdebug_cpuid()); }
+
 inline void
 __bfdebug_type(gsl::not_null<std::string *> msg, cstr_t color, cstr_t type)
 {
@@ -138,19 +153,102 @@ __bfdebug_jtfy(gsl::not_null<std::string *> msg, uint64_t width, cstr_t title, c
         }
 
         *msg += title;
-        *msg += std::string(len, ' ');
+        msg->append(len, ' ');
     }
     else {
-        *msg += std::string(width, ' ');
+        msg->append(width, ' ');
     }
 }
 
-template<typename F>
-void __bfdebug_transaction(F func)
+/*
+ * Binary Log (Debug Ring)
+ *
+ * When DEBUG_BINARY_LOG is defined, everything the debug macros write goes
+ * to a debug ring that stores records (see bfdebugringinterface.h) instead
+ * of being written out as text. The number macros write value records (see
+ * Binary Log below), and everything else is written as text records. In the
+ * VMM, the debug ring is the CPU's own debug ring (i.e. the one returned by
+ * get_drr, which is also what IOCTL_DUMP_VMM reads), which means that the
+ * VMM must not also write unframed text to it. Until the VMM has a debug
+ * ring, the text is written using write_str as usual.
+ */
+
+#ifdef DEBUG_BINARY_LOG
+
+#ifdef VMM
+extern "C" struct debug_ring_resources_t *get_drr(uint64_t vcpuid);
+#endif
+
+/// Binary Log Debug Ring
+///
+/// @expects none
+/// @ensures none
+///
+/// @return the debug ring that the binary log writes to on this CPU. In the
+///     VMM, this is the CPU's debug ring. Otherwise, there is one debug
+///     ring for the whole process. Returns nullptr if there is no debug
+///     ring yet, or if it was not set up using debug_ring_init (i.e. it
+///     might not have room for rpos, see debug_ring_resources_t).
+///
+inline debug_ring_resources_t *
+bfdebug_binary_drr() noexcept
 {
-    std::string msg;
-    msg.reserve(0x1000);
-    func(&msg);
+#ifdef VMM
+    auto drr = get_drr(thread_context_cpuid());
+#else
+    static debug_ring_resources_t s_drr{0, 0, DEBUG_RING_TAG1, {}, DEBUG_RING_TAG2, 0};
+    auto drr = &s_drr;
+#endif
+
+    if (GSL_UNLIKELY(drr == nullptr || debug_ring_is_writable(drr) == 0)) {
+        return nullptr;
+    }
+
+    if (GSL_UNLIKELY(debug_ring_has_records(drr) == 0)) {
+        debug_ring_init_records(drr);
+    }
+
+    return drr;
+}
+
+/*
+ * Text is split into records of at most a quarter of the debug ring, so
+ * that one large transaction cannot discard everything else that is in the
+ * debug ring.
+ */
+inline bool
+__bfdebug_binary_write(const std::string &msg) noexcept
+{
+    constexpr const std::size_t max = DEBUG_RING_SIZE / 4;
+
+    auto drr = bfdebug_binary_drr();
+    if (GSL_UNLIKELY(drr == nullptr)) {
+        return false;
+    }
+
+    debug_ring_record_t rec{};
+    rec.vcpuid = static_cast<uint32_t>(__bfdebug_cpuid());
+    rec.severity = DEBUG_RING_SEVERITY_INFO;
+    rec.type = DEBUG_RING_RECORD_TEXT;
+    rec.tsc = debug_ring_tsc();
+
+    for (std::size_t i = 0; i < msg.size(); i += max) {
+        debug_ring_write_record_hdr(drr, &rec, msg.data() + i, std::min(max, msg.size() - i));
+    }
+
+    return true;
+}
+
+#endif
+
+inline void
+__bfdebug_write(const std::string &msg)
+{
+#ifdef DEBUG_BINARY_LOG
+    if (GSL_LIKELY(__bfdebug_binary_write(msg))) {
+        return;
+    }
+#endif
 
 #ifdef VMM
     write_str(msg);
@@ -159,9 +257,97 @@ void __bfdebug_transaction(F func)
 #endif
 }
 
+/*
+ * Per-CPU Buffers
+ *
+ * When DEBUG_PERCPU_BUFFERS is defined, messages are composed in buffers
+ * that are owned by the CPU (or thread when not in the VMM) that is logging.
+ * These buffers are reserved once, and then reused, which means that once a
+ * CPU has logged its first message, logging no longer allocates memory. If
+ * a transaction grows larger than DEBUG_BUFFER_SIZE, it is written out in
+ * pieces instead of growing the buffer. Nested transactions, and CPUs
+ * above MAX_NUM_CPUS, fall back to allocating their messages.
+ */
+
+#ifdef DEBUG_PERCPU_BUFFERS
+
+struct __bfdebug_buffers_t {
+    std::string msg;
+    std::string ln;
+    bool in_use;
+};
+
+inline __bfdebug_buffers_t *
+__bfdebug_buffers()
+{
+#ifdef VMM
+    static std::array<__bfdebug_buffers_t, MAX_NUM_CPUS> s_buffers{};
+
+    auto cpuid = thread_context_cpuid();
+    if (GSL_UNLIKELY(cpuid >= s_buffers.size())) {
+        return nullptr;
+    }
+
+    return &s_buffers.at(cpuid);
+#else
+    thread_local __bfdebug_buffers_t s_buffers{};
+    return &s_buffers;
+#endif
+}
+
+#endif
+
+template<typename F>
+void __bfdebug_transaction(F func)
+{
+#ifdef DEBUG_PERCPU_BUFFERS
+    auto bufs = __bfdebug_buffers();
+
+    if (GSL_LIKELY(bufs != nullptr && !bufs->in_use)) {
+        bufs->in_use = true;
+        auto ___ = gsl::finally([&] {
+            bufs->in_use = false;
+        });
+
+        bufs->msg.reserve(DEBUG_BUFFER_SIZE);
+        bufs->msg.clear();
+
+        func(&bufs->msg);
+        __bfdebug_write(bufs->msg);
+
+        return;
+    }
+#endif
+
+    std::string msg;
+    msg.reserve(0x1000);
+    func(&msg);
+
+    __bfdebug_write(msg);
+}
+
 template<typename F>
 void __bfdebug_add_line(std::string *msg, F func)
 {
+#ifdef DEBUG_PERCPU_BUFFERS
+    auto bufs = __bfdebug_buffers();
+
+    if (GSL_LIKELY(bufs != nullptr && msg == &bufs->msg)) {
+        bufs->ln.reserve(DEBUG_BUFFER_SIZE);
+        bufs->ln.clear();
+
+        func(&bufs->ln);
+
+        if (msg->size() + bufs->ln.size() > msg->capacity()) {
+            __bfdebug_write(*msg);
+            msg->clear();
+        }
+
+        *msg += bufs->ln;
+        return;
+    }
+#endif
+
     if (msg == nullptr) {
         __bfdebug_transaction([&](std::string * tmsg) {
             func(tmsg);
@@ -225,7 +411,7 @@ __bfdebug_info_core(cstr_t color, cstr_t type, cstr_t title, gsl::not_null<std::
     __bfdebug_type(msg, color, type);
 
     if (title != nullptr) {
-        *msg += std::string(title);
+        *msg += title;
     }
 
     *msg += '\n';
@@ -483,16 +669,25 @@ __bfdebug_brk3(cstr_t color, cstr_t type, std::string *msg = nullptr)
 
 inline void
 __bfdebug_nhex_core(
-    cstr_t color, cstr_t type, cstr_t indent, cstr_t title, uint64_t nhex, gsl::not_null<std::string *> msg)
+    uint64_t cpuid, cstr_t color, cstr_t type, cstr_t indent, cstr_t title, uint64_t nhex,
+    gsl::not_null<std::string *> msg)
 {
-    __bfdebug_core(msg);
+    std::array<char, bfn::to_string_max_size> str;
+    auto ret = bfn::to_string(str.data(), str.data() + str.size(), nhex, 16);
+
+    __bfdebug_core(msg, cpuid);
     __bfdebug_type(msg, color, type);
     __bfdebug_jtfy(msg, 52, title, indent);
 
-    *msg += bfn::to_string(nhex, 16);
+    msg->append(str.data(), ret.ptr);
     *msg += '\n';
 }
 
+inline void
+__bfdebug_nhex_core(
+    cstr_t color, cstr_t type, cstr_t indent, cstr_t title, uint64_t nhex, gsl::not_null<std::string *> msg)
+{ __bfdebug_nhex_core(__bfdebug_cpuid(), color, type, indent, title, nhex, msg); }
+
 inline void
 __bfdebug_nhex(
     cstr_t color, cstr_t type, cstr_t indent, cstr_t title, uint64_t nhex, std::string *msg = nullptr)
@@ -509,32 +704,32 @@ __bfdebug_nhex(
 
 #define bfdebug_nhex(level, ...)                                               \
     if (GSL_UNLIKELY(level <= DEBUG_LEVEL)) {                                  \
-        __bfdebug_nhex(bfcolor_debug, "DEBUG", nullptr, __VA_ARGS__);          \
+        __bfdebug_nhex_select(bfcolor_debug, "DEBUG", nullptr, __VA_ARGS__);   \
     }
 
 #define bfalert_nhex(level, ...)                                               \
     if (GSL_UNLIKELY(level <= DEBUG_LEVEL)) {                                  \
-        __bfdebug_nhex(bfcolor_alert, "ALERT", nullptr, __VA_ARGS__);          \
+        __bfdebug_nhex_select(bfcolor_alert, "ALERT", nullptr, __VA_ARGS__);   \
     }
 
 #define bferror_nhex(level, ...)                                               \
     if (GSL_UNLIKELY(level <= DEBUG_LEVEL)) {                                  \
-        __bfdebug_nhex(bfcolor_error, "ERROR", nullptr, __VA_ARGS__);          \
+        __bfdebug_nhex_select(bfcolor_error, "ERROR", nullptr, __VA_ARGS__);   \
     }
 
 #define bfdebug_subnhex(level, ...)                                            \
     if (GSL_UNLIKELY(level <= DEBUG_LEVEL)) {                                  \
-        __bfdebug_nhex(bfcolor_debug, "DEBUG", "  - ", __VA_ARGS__);           \
+        __bfdebug_nhex_select(bfcolor_debug, "DEBUG", "  - ", __VA_ARGS__);    \
     }
 
 #define bfalert_subnhex(level, ...)                                            \
     if (GSL_UNLIKELY(level <= DEBUG_LEVEL)) {                                  \
-        __bfdebug_nhex(bfcolor_alert, "ALERT", "  - ", __VA_ARGS__);           \
+        __bfdebug_nhex_select(bfcolor_alert, "ALERT", "  - ", __VA_ARGS__);    \
     }
 
 #define bferror_subnhex(level, ...)                                            \
     if (GSL_UNLIKELY(level <= DEBUG_LEVEL)) {                                  \
-        __bfdebug_nhex(bfcolor_error, "ERROR", "  - ", __VA_ARGS__);           \
+        __bfdebug_nhex_select(bfcolor_error, "ERROR", "  - ", __VA_ARGS__);    \
     }
 
 /* ---------------------------------------------------------------------------*/
@@ -543,17 +738,26 @@ __bfdebug_nhex(
 
 inline void
 __bfdebug_ndec_core(
-    cstr_t color, cstr_t type, cstr_t indent, cstr_t title, uint64_t ndec, gsl::not_null<std::string *> msg)
+    uint64_t cpuid, cstr_t color, cstr_t type, cstr_t indent, cstr_t title, uint64_t ndec,
+    gsl::not_null<std::string *> msg)
 {
-    auto str = bfn::to_string(ndec, 10);
-    __bfdebug_core(msg);
+    std::array<char, bfn::to_string_max_size> str;
+    auto ret = bfn::to_string(str.data(), str.data() + str.size(), ndec, 10);
+    auto len = static_cast<uint64_t>(ret.ptr - str.data());
+
+    __bfdebug_core(msg, cpuid);
     __bfdebug_type(msg, color, type);
-    __bfdebug_jtfy(msg, 70 - str.length(), title, indent);
+    __bfdebug_jtfy(msg, 70 - len, title, indent);
 
-    *msg += str;
+    msg->append(str.data(), len);
     *msg += '\n';
 }
 
+inline void
+__bfdebug_ndec_core(
+    cstr_t color, cstr_t type, cstr_t indent, cstr_t title, uint64_t ndec, gsl::not_null<std::string *> msg)
+{ __bfdebug_ndec_core(__bfdebug_cpuid(), color, type, indent, title, ndec, msg); }
+
 inline void
 __bfdebug_ndec(
     cstr_t color, cstr_t type, cstr_t indent, cstr_t title, uint64_t ndec, std::string *msg = nullptr)
@@ -565,34 +769,231 @@ __bfdebug_ndec(
 
 #define bfdebug_ndec(level, ...)                                               \
     if (GSL_UNLIKELY(level <= DEBUG_LEVEL)) {                                  \
-        __bfdebug_ndec(bfcolor_debug, "DEBUG", nullptr, __VA_ARGS__);          \
+        __bfdebug_ndec_select(bfcolor_debug, "DEBUG", nullptr, __VA_ARGS__);   \
     }
 
 #define bfalert_ndec(level, ...)                                               \
     if (GSL_UNLIKELY(level <= DEBUG_LEVEL)) {                                  \
-        __bfdebug_ndec(bfcolor_alert, "ALERT", nullptr, __VA_ARGS__);          \
+        __bfdebug_ndec_select(bfcolor_alert, "ALERT", nullptr, __VA_ARGS__);   \
     }
 
 #define bferror_ndec(level, ...)                                               \
     if (GSL_UNLIKELY(level <= DEBUG_LEVEL)) {                                  \
-        __bfdebug_ndec(bfcolor_error, "ERROR", nullptr, __VA_ARGS__);          \
+        __bfdebug_ndec_select(bfcolor_error, "ERROR", nullptr, __VA_ARGS__);   \
     }
 
 #define bfdebug_subndec(level, ...)                                            \
     if (GSL_UNLIKELY(level <= DEBUG_LEVEL)) {                                  \
-        __bfdebug_ndec(bfcolor_debug, "DEBUG", "  - ", __VA_ARGS__);           \
+        __bfdebug_ndec_select(bfcolor_debug, "DEBUG", "  - ", __VA_ARGS__);    \
     }
 
 #define bfalert_subndec(level, ...)                                            \
     if (GSL_UNLIKELY(level <= DEBUG_LEVEL)) {                                  \
-        __bfdebug_ndec(bfcolor_alert, "ALERT", "  - ", __VA_ARGS__);           \
+        __bfdebug_ndec_select(bfcolor_alert, "ALERT", "  - ", __VA_ARGS__);    \
     }
 
 #define bferror_subndec(level, ...)                                            \
     if (GSL_UNLIKELY(level <= DEBUG_LEVEL)) {                                  \
-        __bfdebug_ndec(bfcolor_error, "ERROR", "  - ", __VA_ARGS__);           \
+        __bfdebug_ndec_select(bfcolor_error, "ERROR", "  - ", __VA_ARGS__);    \
     }
 
+/* ---------------------------------------------------------------------------*/
+/* Binary Log                                                                 */
+/* ---------------------------------------------------------------------------*/
+
+/*
+ * When DEBUG_BINARY_LOG is defined, the hex and decimal number macros no
+ * longer format text. Instead, each call writes a 32 byte value record to
+ * the binary log's debug ring (see bfdebug_binary_drr) containing the id of
+ * the call site's format, the CPU id, a timestamp and the raw value, which
+ * is a handful of stores instead of building a string. The format (color,
+ * type, indent and title) is written to the debug ring as a format record
+ * the first time the call site executes on each CPU (i.e. in each debug
+ * ring), and again whenever the previous copy in that debug ring has been
+ * discarded, so each debug ring can be decoded on its own (see
+ * bfdebugbinary.h).
+ *
+ * The title of a call site must be a string literal of at most
+ * __bfdebug_binary_max_title characters, which is checked at compile time,
+ * so that the format record always holds the whole title. Calls that are
+ * given a msg (i.e. part of a transaction) are still formatted as text.
+ */
+
+#ifdef DEBUG_BINARY_LOG
+
+#include <atomic>
+
+/*
+ * Each call site stores the position of its last format record in each
+ * CPU's debug ring, together with the CPU it was written by as a single
+ * value, so that it can be checked with one load. CPUs above MAX_NUM_CPUS
+ * share a slot with a lower CPU, in which case the CPU does not match and
+ * the format is written again. Positions are truncated to 48 bits.
+ */
+constexpr const uint64_t __bfdebug_binary_pos_mask = 0x0000FFFFFFFFFFFF;
+
+/*
+ * The longest title a call site can have. The color, type and indent come
+ * from the debug macros themselves, and are much shorter than this.
+ */
+constexpr const std::size_t __bfdebug_binary_max_title = 127;
+
+inline uint32_t
+__bfdebug_binary_next_id() noexcept
+{
+    static std::atomic<uint32_t> s_id{1};
+    return s_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+struct __bfdebug_binary_site_t {
+    cstr_t color;
+    cstr_t type;
+    cstr_t indent;
+    cstr_t title;
+    uint8_t kind;
+    uint8_t severity;
+    uint32_t id;
+    std::array<std::atomic<uint64_t>, MAX_NUM_CPUS> emitted;
+
+    __bfdebug_binary_site_t(cstr_t c, cstr_t t, cstr_t i, cstr_t ti, uint8_t k) noexcept :
+        color(c),
+        type(t),
+        indent(i),
+        title(ti),
+        kind(k),
+        severity(DEBUG_RING_SEVERITY_DEBUG),
+        id(__bfdebug_binary_next_id()),
+        emitted{}
+    {
+        switch (t[0]) {
+            case 'E':
+                severity = DEBUG_RING_SEVERITY_ERROR;
+                break;
+
+            case 'A':
+                severity = DEBUG_RING_SEVERITY_WARNING;
+                break;
+
+            default:
+                break;
+        }
+    }
+};
+
+inline void
+__bfdebug_binary_format(
+    debug_ring_resources_t *drr, __bfdebug_binary_site_t *site, uint64_t cpuid, debug_ring_record_t rec) noexcept
+{
+    constexpr const std::size_t max = __bfdebug_binary_max_title + 1;
+
+    std::array<char, 2 + 4 * max> buf;
+    std::size_t len = 0;
+
+    auto add = [&](cstr_t str) {
+        auto num = str != nullptr ? std::min(strlen(str), max - 1) : 0;
+
+        memcpy(&buf.at(len), str != nullptr ? str : "", num);
+        len += num;
+        buf.at(len++) = '\0';
+    };
+
+    buf.at(len++) = static_cast<char>(site->kind);
+    buf.at(len++) = static_cast<char>(
+                        (site->indent != nullptr ? DEBUG_RING_FORMAT_HAS_INDENT : 0) |
+                        (site->title != nullptr ? DEBUG_RING_FORMAT_HAS_TITLE : 0));
+
+    add(site->color);
+    add(site->type);
+    add(site->indent);
+    add(site->title);
+
+    rec.type = DEBUG_RING_RECORD_FORMAT;
+
+    auto pos = __debug_ring_load(&drr->rpos);
+    debug_ring_write_record_hdr(drr, &rec, buf.data(), len);
+
+    site->emitted.at(cpuid % MAX_NUM_CPUS).store(
+        ((cpuid + 1) << 48) | (pos & __bfdebug_binary_pos_mask), std::memory_order_relaxed);
+}
+
+inline void
+__bfdebug_binary_log(
+    __bfdebug_binary_site_t *site, debug_ring_resources_t *drr, uint64_t cpuid, uint64_t val) noexcept
+{
+    debug_ring_record_t rec{};
+    rec.vcpuid = static_cast<uint32_t>(cpuid);
+    rec.severity = site->severity;
+    rec.id = site->id;
+    rec.tsc = debug_ring_tsc();
+
+    auto emitted = site->emitted.at(cpuid % MAX_NUM_CPUS).load(std::memory_order_relaxed);
+    auto spos = __debug_ring_load(&drr->spos) & __bfdebug_binary_pos_mask;
+
+    if (GSL_UNLIKELY((emitted >> 48) != cpuid + 1 || (emitted & __bfdebug_binary_pos_mask) < spos)) {
+        __bfdebug_binary_format(drr, site, cpuid, rec);
+    }
+
+    rec.type = DEBUG_RING_RECORD_VALUE;
+    debug_ring_write_record_hdr(drr, &rec, reinterpret_cast<const char *>(&val), sizeof(val));
+}
+
+inline void
+__bfdebug_binary_log(__bfdebug_binary_site_t *site, uint64_t val)
+{
+    auto drr = bfdebug_binary_drr();
+
+    if (GSL_UNLIKELY(drr == nullptr)) {
+        if (site->kind == DEBUG_RING_FORMAT_NHEX) {
+            __bfdebug_nhex(site->color, site->type, site->indent, site->title, val);
+        }
+        else {
+            __bfdebug_ndec(site->color, site->type, site->indent, site->title, val);
+        }
+
+        return;
+    }
+
+    __bfdebug_binary_log(site, drr, __bfdebug_cpuid(), val);
+}
+
+inline void
+__bfdebug_binary_log(__bfdebug_binary_site_t *site, void *val)
+{ __bfdebug_binary_log(site, reinterpret_cast<uint64_t>(val)); }
+
+#define __bfdebug_nhex_select5(color,type,indent,title,val)                    \
+    {                                                                          \
+        static_assert(sizeof("" title) <= __bfdebug_binary_max_title + 1,      \
+                      "binary log titles are limited to 127 characters");      \
+        static __bfdebug_binary_site_t __bfsite(                               \
+            color, type, indent, "" title, DEBUG_RING_FORMAT_NHEX);            \
+        __bfdebug_binary_log(&__bfsite, val);                                  \
+    }
+
+#define __bfdebug_nhex_select6(color,type,indent,title,val,msg)                \
+    __bfdebug_nhex(color, type, indent, title, val, msg)
+
+#define __bfdebug_ndec_select5(color,type,indent,title,val)                    \
+    {                                                                          \
+        static_assert(sizeof("" title) <= __bfdebug_binary_max_title + 1,      \
+                      "binary log titles are limited to 127 characters");      \
+        static __bfdebug_binary_site_t __bfsite(                               \
+            color, type, indent, "" title, DEBUG_RING_FORMAT_NDEC);            \
+        __bfdebug_binary_log(&__bfsite, val);                                  \
+    }
+
+#define __bfdebug_ndec_select6(color,type,indent,title,val,msg)                \
+    __bfdebug_ndec(color, type, indent, title, val, msg)
+
+#define __bfdebug_nhex_select(...) GET_MACRO(__bfdebug_nhex_select, __VA_ARGS__)
+#define __bfdebug_ndec_select(...) GET_MACRO(__bfdebug_ndec_select, __VA_ARGS__)
+
+#else
+
+#define __bfdebug_nhex_select(...) __bfdebug_nhex(__VA_ARGS__)
+#define __bfdebug_ndec_select(...) __bfdebug_ndec(__VA_ARGS__)
+
+#endif
+
 /* ---------------------------------------------------------------------------*/
 /* Boolean                                                                    */
 /* ---------------------------------------------------------------------------*/
@@ -602,11 +1003,13 @@ __bfdebug_bool_core(
     cstr_t color, cstr_t type, cstr_t indent, cstr_t title, bool val, gsl::not_null<std::string *> msg)
 {
     auto str = val ? "true" : "false";
+    auto len = val ? sizeof("true") - 1 : sizeof("false") - 1;
+
     __bfdebug_core(msg);
     __bfdebug_type(msg, color, type);
-    __bfdebug_jtfy(msg, 70 - strlen(str), title, indent);
+    __bfdebug_jtfy(msg, 70 - len, title, indent);
 
-    *msg += str;
+    msg->append(str, len);
     *msg += '\n';
 }
 
@@ -657,12 +1060,14 @@ inline void
 __bfdebug_text_core(
     cstr_t color, cstr_t type, cstr_t indent, cstr_t title, cstr_t text, gsl::not_null<std::string *> msg)
 {
-    auto str = text == nullptr ? std::string{} : std::string{text};
+    auto str = text == nullptr ? "" : text;
+    auto len = strlen(str);
+
     __bfdebug_core(msg);
     __bfdebug_type(msg, color, type);
-    __bfdebug_jtfy(msg, 70 - str.length(), title, indent);
+    __bfdebug_jtfy(msg, 70 - len, title, indent);
 
-    *msg += str;
+    msg->append(str, len);
     *msg += '\n';
 }
 
@@ -0,0 +1,226 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+///
+/// @file bfdebugbinary.h
+///
+
+#ifndef BFDEBUGBINARY_H
+#define BFDEBUGBINARY_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <bfdebug.h>
+
+// The binary log decoder is only needed on the host (e.g. to decode a
+// debug ring returned by IOCTL_DUMP_VMM), which is why it is not part of
+// bfdebug.h, which is also included by the VMM.
+
+/// Binary Log Decoder
+///
+/// Converts the records that the debug macros write when DEBUG_BINARY_LOG
+/// is defined back into the exact text that they produce when it is not.
+/// Only the records are needed (e.g. a copy of a debug ring returned by
+/// IOCTL_DUMP_VMM), not the image that wrote them, so this can be used on
+/// the host. The decoder remembers the format records it has seen, and a
+/// value record can only be decoded once the decoder has seen its format.
+/// When the first copy of a format record has been discarded, the copy that
+/// replaces it comes after the oldest value records that use it, so to
+/// decode a whole debug ring, the format records are given to the decoder
+/// first (see bfdebug_binary_dump).
+///
+class bfdebug_binary_decoder
+{
+public:
+
+    /// Decode
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param rec the header of the record to decode
+    /// @param data the record's message (rec.len bytes)
+    /// @param msg the string to append the decoded text to
+    ///
+    void
+    decode(const debug_ring_record_t &rec, const char *data, gsl::not_null<std::string *> msg)
+    {
+        switch (rec.type) {
+            case DEBUG_RING_RECORD_TEXT:
+                msg->append(data, rec.len);
+                break;
+
+            case DEBUG_RING_RECORD_FORMAT:
+                this->add_format(rec, data);
+                break;
+
+            case DEBUG_RING_RECORD_VALUE:
+                this->decode_value(rec, data, msg);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+private:
+
+    struct format_t {
+        uint8_t kind;
+        uint8_t flags;
+        std::string color;
+        std::string type;
+        std::string indent;
+        std::string title;
+    };
+
+    void
+    add_format(const debug_ring_record_t &rec, const char *data)
+    {
+        if (rec.len < 2) {
+            return;
+        }
+
+        std::size_t pos = 2;
+        auto next = [&] {
+            auto len = __debug_ring_strnlen(data + pos, rec.len - pos);
+            auto str = std::string(data + pos, len);
+
+            pos = std::min<std::size_t>(pos + len + 1, rec.len);
+            return str;
+        };
+
+        auto &fmt = m_formats[rec.id];
+
+        fmt.kind = static_cast<uint8_t>(data[0]);
+        fmt.flags = static_cast<uint8_t>(data[1]);
+        fmt.color = next();
+        fmt.type = next();
+        fmt.indent = next();
+        fmt.title = next();
+    }
+
+    void
+    decode_value(const debug_ring_record_t &rec, const char *data, gsl::not_null<std::string *> msg)
+    {
+        uint64_t val;
+
+        if (rec.len != sizeof(val)) {
+            return;
+        }
+
+        memcpy(&val, data, sizeof(val));
+
+        auto iter = m_formats.find(rec.id);
+        if (iter == m_formats.end()) {
+            __bfdebug_nhex_core(rec.vcpuid, bfcolor_error, "ERROR", nullptr, "unknown format", val, msg);
+            return;
+        }
+
+        const auto &fmt = iter->second;
+        auto indent = (fmt.flags & DEBUG_RING_FORMAT_HAS_INDENT) != 0 ? fmt.indent.c_str() : nullptr;
+        auto title = (fmt.flags & DEBUG_RING_FORMAT_HAS_TITLE) != 0 ? fmt.title.c_str() : nullptr;
+
+        switch (fmt.kind) {
+            case DEBUG_RING_FORMAT_NHEX:
+                __bfdebug_nhex_core(rec.vcpuid, fmt.color.c_str(), fmt.type.c_str(), indent, title, val, msg);
+                break;
+
+            case DEBUG_RING_FORMAT_NDEC:
+                __bfdebug_ndec_core(rec.vcpuid, fmt.color.c_str(), fmt.type.c_str(), indent, title, val, msg);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+private:
+
+    std::map<uint32_t, format_t> m_formats;
+};
+
+/// Binary Log Dump
+///
+/// Decodes every record that is still in the provided debug ring, oldest
+/// first. A value record is printed as an "unknown format" error only if
+/// every copy of its format has been discarded, which happens when a call
+/// site has not run since its format was discarded.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param drr the debug ring to decode (e.g. a copy returned by
+///     IOCTL_DUMP_VMM)
+/// @return the decoded text of the debug ring
+///
+inline std::string
+bfdebug_binary_dump(debug_ring_resources_t *drr)
+{
+    std::string msg;
+
+    if (drr == nullptr) {
+        return msg;
+    }
+
+    uint64_t cursor = 0;
+    debug_ring_record_t rec{};
+    bfdebug_binary_decoder decoder;
+    std::vector<char> data(DEBUG_RING_SIZE);
+
+    while (debug_ring_read_record(drr, &cursor, &rec, data.data(), data.size(), nullptr) == 1) {
+        if (rec.type == DEBUG_RING_RECORD_FORMAT) {
+            decoder.decode(rec, data.data(), &msg);
+        }
+    }
+
+    cursor = 0;
+
+    while (debug_ring_read_record(drr, &cursor, &rec, data.data(), data.size(), nullptr) == 1) {
+        if (rec.type != DEBUG_RING_RECORD_FORMAT) {
+            decoder.decode(rec, data.data(), &msg);
+        }
+    }
+
+    return msg;
+}
+
+#ifdef DEBUG_BINARY_LOG
+
+/// Binary Log Dump
+///
+/// Decodes every record that is still in the binary log's debug ring on
+/// this CPU, oldest first.
+///
+/// @expects none
+/// @ensures none
+///
+/// @return the decoded text of the binary log
+///
+inline std::string
+bfdebug_binary_dump()
+{ return bfdebug_binary_dump(bfdebug_binary_drr()); }
+
+#endif
+
+#endif
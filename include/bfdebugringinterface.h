@@ -31,6 +31,37 @@
 #include <bfconstants.h>
 #include <bferrorcodes.h>
 
+#if defined(KERNEL) && defined(__linux__)
+#include <linux/string.h>
+#elif !defined(KERNEL)
+#ifdef __cplusplus
+#include <cstring>
+#else
+#include <string.h>
+#endif
+#endif
+
+#if defined(NATIVE) && defined(__unix__)
+#include <sched.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/**
+ * Debug Ring Atomics
+ *
+ * Defined if the compiler provides the atomic operations that the debug
+ * ring's writers need (GCC / Clang builtins, or MSVC's _Interlocked
+ * intrinsics). debug_ring_write, debug_ring_write_record and their
+ * debug_ring_var_xxx versions are only provided if this is defined. The
+ * readers are always provided.
+ */
+#if defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER)
+#define DEBUG_RING_ATOMICS
+#endif
+
 #pragma pack(push, 1)
 
 #ifdef __cplusplus
@@ -58,37 +89,48 @@ typedef struct debug_ring_resources_t *(*get_drr_t)(uint64_t vcpuid);
  * by the ring.
  *
  * Prior to providing this structure to the debug ring, the memory should be
- * cleared, and the len of the buffer should be set to the total length of
- * memory allocated minus the size of debug_ring_resources_t.
+ * cleared. The size of the buffer is fixed at compile time (DEBUG_RING_SIZE).
+ * For a debug ring whose size is chosen when it is allocated, see
+ * debug_ring_var_t.
  *
  * @code
  *
- *  int len = PAGE_SIZE * 100;
- *  struct debug_ring_resources_t *drr = valloc(len);
- *
- *  memset(drr, 0, len);
- *  drr->len = len - sizeof(debug_ring_resources_t);
+ *  struct debug_ring_resources_t *drr = valloc(sizeof(*drr));
+ *  memset(drr, 0, sizeof(*drr));
+ *  debug_ring_init(drr);
  *
  *  <give to vmm and do stuff>
  *
- *  int ret;
- *  char read_buf[len]
- *
- *  ret = debug_ring_read(drr, read_buf, len);
- *  if(ret < 0)
- *      <report error>
+ *  char read_buf[DEBUG_RING_SIZE + 1];
+ *  ret = debug_ring_read(drr, read_buf, sizeof(read_buf));
  *
  * @endcode
  *
  * Note there are many different designs for cicular buffers, but all of the
  * designs have to face the same problem. How to detect when the buffer is
  * full vs when it is empty. This design uses two counters the grow
- * forever. The current position in the buffer is then pos % len. If the
+ * forever. The current position in the buffer is then pos % len (which,
+ * since len is always a power of two, is pos & (len - 1)). If the
  * counters are 64bit, it would take a life time for the counters to
  * overflow.
  *
+ * Writers that use debug_ring_write first reserve space by advancing rpos,
+ * and then commit the data they wrote by advancing epos. Readers only ever
+ * use spos and epos, and thus never see data that is still being written.
+ *
+ * This structure is shared by the driver and the VMM, which are built
+ * separately, and is also found by tools that look at a memory dump, so
+ * the offsets of epos, spos, tag1, buf and tag2 must not change. New fields
+ * go after tag2 (which is why rpos is last). Since rpos makes the structure
+ * larger, a debug ring that was allocated using an older version of this
+ * header does not have room for it. For this reason, the writers only use
+ * a debug ring that has been set up using debug_ring_init (or
+ * debug_ring_init_records), which is how whoever allocated the debug ring
+ * says that it has room for rpos. Readers do not use rpos, and work with
+ * either version.
+ *
  * @var debug_ring_resources_t::epos
- *     the end position in the circular buffer
+ *     the end position in the circular buffer (committed)
  * @var debug_ring_resources_t::spos
  *     the start position in the circular buffer
  * @var debug_ring_resources_t::tag1
@@ -97,6 +139,8 @@ typedef struct debug_ring_resources_t *(*get_drr_t)(uint64_t vcpuid);
  *     the circular buffer that stores the debug strings.
  * @var debug_ring_resources_t::tag2
  *     used to identify the debug ring from a memory dump
+ * @var debug_ring_resources_t::rpos
+ *     the reserved position in the circular buffer (rpos >= epos)
  */
 struct debug_ring_resources_t {
     uint64_t epos;
@@ -105,8 +149,343 @@ struct debug_ring_resources_t {
     uint64_t tag1;
     char buf[DEBUG_RING_SIZE];
     uint64_t tag2;
+
+    uint64_t rpos;
+};
+
+/**
+ * Debug Ring Tags
+ *
+ * The values of tag1 and tag2 of a debug ring that has been set up using
+ * debug_ring_init (an unframed stream of characters) or
+ * debug_ring_init_records (a sequence of records). Both also mean that the
+ * debug ring has room for rpos (see debug_ring_resources_t).
+ */
+#define DEBUG_RING_TAG1 0x4244524157524731ULL
+#define DEBUG_RING_TAG2 0x4244524157524732ULL
+#define DEBUG_RING_RECORD_TAG1 0x4244524543524431ULL
+#define DEBUG_RING_RECORD_TAG2 0x4244524543524432ULL
+
+/**
+ * @struct debug_ring_var_t
+ *
+ * Debug Ring (Variable Size)
+ *
+ * Same as debug_ring_resources_t, except that the size of the buffer is
+ * chosen when the debug ring is allocated instead of at compile time, so
+ * that (for example) a busy vCPU can be given more history than an idle one.
+ * The size must be a power of two, so that positions in the buffer are found
+ * using a mask. The buffer immediately follows this structure in memory.
+ *
+ * @code
+ *
+ *  uint64_t size = 0x100000;
+ *  struct debug_ring_var_t *dr = valloc(debug_ring_var_alloc_size(size));
+ *
+ *  memset(dr, 0, debug_ring_var_alloc_size(size));
+ *  debug_ring_var_init(dr, size);
+ *
+ * @endcode
+ *
+ * All of the debug_ring_xxx functions have a debug_ring_var_xxx version
+ * that takes a debug_ring_var_t instead of a debug_ring_resources_t.
+ *
+ * Like debug_ring_resources_t, tag1 immediately follows epos and spos.
+ *
+ * @var debug_ring_var_t::epos
+ *     the end position in the circular buffer (committed)
+ * @var debug_ring_var_t::spos
+ *     the start position in the circular buffer
+ * @var debug_ring_var_t::tag1
+ *     used to identify the debug ring from a memory dump
+ * @var debug_ring_var_t::size
+ *     the size of the circular buffer in bytes (a power of two)
+ * @var debug_ring_var_t::tag2
+ *     used to identify the debug ring from a memory dump
+ * @var debug_ring_var_t::rpos
+ *     the reserved position in the circular buffer (rpos >= epos)
+ */
+struct debug_ring_var_t {
+    uint64_t epos;
+    uint64_t spos;
+
+    uint64_t tag1;
+    uint64_t size;
+    uint64_t tag2;
+
+    uint64_t rpos;
+};
+
+/** @cond */
+
+/*
+ * Both types of debug ring are accessed through this view, so that the
+ * implementation does not need to know which one it is working with.
+ */
+struct __debug_ring_t {
+    uint64_t *epos;
+    uint64_t *spos;
+    uint64_t *rpos;
+    char *buf;
+    uint64_t size;
+    uint64_t mask;
 };
 
+static inline struct __debug_ring_t
+__debug_ring_fixed(struct debug_ring_resources_t *drr)
+{
+    struct __debug_ring_t ring;
+
+    ring.epos = &drr->epos;
+    ring.spos = &drr->spos;
+    ring.rpos = &drr->rpos;
+    ring.buf = drr->buf;
+    ring.size = DEBUG_RING_SIZE;
+    ring.mask = DEBUG_RING_SIZE - 1;
+
+    return ring;
+}
+
+static inline struct __debug_ring_t
+__debug_ring_var(struct debug_ring_var_t *dr)
+{
+    struct __debug_ring_t ring;
+
+    ring.epos = &dr->epos;
+    ring.spos = &dr->spos;
+    ring.rpos = &dr->rpos;
+    ring.buf = bfrcast(char *, dr + 1);
+    ring.size = dr->size;
+    ring.mask = dr->size - 1;
+
+    return ring;
+}
+
+/*
+ * Called while a writer waits for the writers before it to commit. In the
+ * VMM and the driver, each writer is a CPU that cannot be preempted while
+ * it holds a reservation, so spinning is fine. Native applications are
+ * preempted, so the writer gives up the CPU instead of spinning on a
+ * writer that is not running.
+ */
+static inline void
+__debug_ring_relax(void)
+{
+#if defined(NATIVE) && defined(__unix__)
+    sched_yield();
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_ia32_pause();
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#endif
+}
+
+/*
+ * Returns the number of bytes in buf before the first '\0', or len if buf
+ * does not contain a '\0'. The scan is done 8 bytes at a time using the
+ * "has zero byte" trick so that it is vectorised without needing SIMD
+ * instructions, which cannot be used freely in the driver.
+ */
+static inline uint64_t
+__debug_ring_strnlen(const char *buf, uint64_t len)
+{
+    uint64_t i = 0;
+    uint64_t word;
+
+    for (; i + sizeof(word) <= len; i += sizeof(word)) {
+        memcpy(&word, buf + i, sizeof(word));
+
+        if (((word - 0x0101010101010101ULL) & ~word & 0x8080808080808080ULL) != 0)
+        { break; }
+    }
+
+    for (; i < len; i++) {
+        if (buf[i] == '\0')
+        { return i; }
+    }
+
+    return len;
+}
+
+/*
+ * Copies at most len - 1 bytes of the debug ring, starting at position start
+ * and ending at position start + content, into str using at most two
+ * contiguous segments (one if the contents do not wrap). Any '\0'
+ * characters are removed from the result, and str is always '\0'
+ * terminated. Returns the number of bytes written to str, and the number of
+ * bytes consumed from the debug ring in consumed.
+ */
+static inline uint64_t
+__debug_ring_copy(
+    const struct __debug_ring_t *ring, uint64_t start, uint64_t content,
+    char *str, uint64_t len, uint64_t *consumed)
+{
+    uint64_t i = 0;
+    uint64_t seg;
+    uint64_t run;
+    uint64_t pos = start & ring->mask;
+    uint64_t remaining = content;
+
+    while (remaining > 0 && i < len - 1) {
+        seg = ring->size - pos;
+
+        if (seg > remaining)
+        { seg = remaining; }
+
+        if (seg > len - 1 - i)
+        { seg = len - 1 - i; }
+
+        run = __debug_ring_strnlen(ring->buf + pos, seg);
+        memcpy(str + i, ring->buf + pos, run);
+
+        i += run;
+        pos += run;
+        remaining -= run;
+
+        if (run < seg) {
+            pos++;
+            remaining--;
+        }
+
+        if (pos == ring->size)
+        { pos = 0; }
+    }
+
+    str[i] = '\0';
+
+    *consumed = content - remaining;
+    return i;
+}
+
+/*
+ * Loads a debug ring position that might be changed by a writer on another
+ * CPU. The acquire ensures that the contents of the debug ring are not read
+ * before the position that covers them.
+ */
+static inline uint64_t
+__debug_ring_load(const uint64_t *pos)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __atomic_load_n(pos, __ATOMIC_ACQUIRE);
+#elif defined(_MSC_VER)
+    uint64_t val = *bfrcast(const volatile uint64_t *, pos);
+    _ReadWriteBarrier();
+    return val;
+#else
+    return *bfrcast(const volatile uint64_t *, pos);
+#endif
+}
+
+#ifdef DEBUG_RING_ATOMICS
+
+/*
+ * The rest of the atomic operations are only needed by the writers. With
+ * MSVC, a volatile store after a compiler barrier is a release on x86 and
+ * x64 (the only architectures the driver is built for on Windows), and the
+ * read-modify-write operations use the _Interlocked intrinsics, which are
+ * full barriers.
+ */
+
+static inline void
+__debug_ring_store(uint64_t *pos, uint64_t val)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __atomic_store_n(pos, val, __ATOMIC_RELEASE);
+#else
+    _ReadWriteBarrier();
+    *bfrcast(volatile uint64_t *, pos) = val;
+#endif
+}
+
+static inline uint64_t
+__debug_ring_fetch_add(uint64_t *pos, uint64_t val)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __atomic_fetch_add(pos, val, __ATOMIC_RELAXED);
+#else
+    return bfscast(uint64_t, _InterlockedExchangeAdd64(
+                       bfrcast(volatile __int64 *, pos), bfscast(__int64, val)));
+#endif
+}
+
+/*
+ * Sets *pos to val if it is equal to *expected, and returns 1. Otherwise,
+ * *expected is set to the current value of *pos, and 0 is returned.
+ */
+static inline int
+__debug_ring_cas(uint64_t *pos, uint64_t *expected, uint64_t val)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __atomic_compare_exchange_n(pos, expected, val, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+#else
+    uint64_t prev = bfscast(uint64_t, _InterlockedCompareExchange64(
+                                bfrcast(volatile __int64 *, pos), bfscast(__int64, val),
+                                bfscast(__int64, *expected)));
+
+    if (prev == *expected)
+    { return 1; }
+
+    *expected = prev;
+    return 0;
+#endif
+}
+
+#endif
+
+static inline uint64_t
+__debug_ring_read(const struct __debug_ring_t *ring, char *str, uint64_t len)
+{
+    uint64_t spos;
+    uint64_t epos;
+    uint64_t copied;
+    uint64_t consumed;
+
+    spos = *ring->spos;
+    epos = *ring->epos > spos ? *ring->epos : spos;
+
+    copied = __debug_ring_copy(ring, spos, epos - spos, str, len, &consumed);
+    return epos - spos - (consumed - copied);
+}
+
+static inline uint64_t
+__debug_ring_read_cursor(
+    const struct __debug_ring_t *ring, uint64_t *cursor, char *str, uint64_t len, uint64_t *lost)
+{
+    uint64_t spos;
+    uint64_t epos;
+    uint64_t start;
+    uint64_t copied;
+    uint64_t consumed;
+
+    start = *cursor;
+
+    do {
+        epos = __debug_ring_load(ring->epos);
+        spos = __debug_ring_load(ring->spos);
+
+        if (start > epos)
+        { start = spos; }
+
+        if (start < spos) {
+            if (lost != 0)
+            { *lost += spos - start; }
+
+            start = spos;
+        }
+
+        if (start > epos)
+        { epos = start; }
+
+        copied = __debug_ring_copy(ring, start, epos - start, str, len, &consumed);
+    }
+    while (__debug_ring_load(ring->spos) > start);
+
+    *cursor = start + consumed;
+    return copied;
+}
+
+/** @endcond */
+
 /**
  * Debug Ring Read
  *
@@ -114,6 +493,10 @@ struct debug_ring_resources_t {
  * provide any buffer size you want, it's advised to provide a buffer that
  * is the same size as the buffer that was originally allocated.
  *
+ * The ring is copied using at most two contiguous segments (one if the
+ * contents do not wrap), each of which is copied with memcpy between any
+ * '\0' characters, which are removed from the result.
+ *
  * @expects none
  * @ensures none
  *
@@ -128,33 +511,1268 @@ struct debug_ring_resources_t {
 static inline uint64_t
 debug_ring_read(struct debug_ring_resources_t *drr, char *str, uint64_t len)
 {
-    uint64_t i;
-    uint64_t spos;
-    uint64_t content;
+    struct __debug_ring_t ring;
 
     if (drr == 0 || str == 0 || len == 0)
     { return 0; }
 
-    spos = drr->spos % DEBUG_RING_SIZE;
-    content = drr->epos - drr->spos;
+    ring = __debug_ring_fixed(drr);
+    return __debug_ring_read(&ring, str, len);
+}
+
+/**
+ * Debug Ring Read (Cursor)
+ *
+ * Unlike debug_ring_read, which always returns the entire contents of the
+ * debug ring, this function only returns what has been written to the debug
+ * ring since the last time it was called, and does not modify the debug
+ * ring. This way, a reader that polls the debug ring only copies new
+ * data, no matter how large the debug ring is.
+ *
+ * The cursor is owned by the caller, and should be set to 0 (or to
+ * drr->epos to skip what is already in the debug ring) prior to the first
+ * call. Each call advances the cursor past the data that was returned. If
+ * str is not large enough to hold all of the new data, the rest is returned
+ * on the next call.
+ *
+ * If the writer laps the reader (i.e. the data at the cursor was overwritten
+ * before it was read), the cursor is moved to the oldest data still in the
+ * debug ring, and the number of bytes that were skipped is added to lost.
+ * This is also true if the data is overwritten while it is being copied.
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param drr the debug_ring_resource that was used to create the
+ *        debug ring
+ * @param cursor the caller's position in the debug ring
+ * @param str the buffer to read the string into
+ * @param len the length of the str buffer in bytes
+ * @param lost if not 0, the number of bytes lost to overrun is added to
+ *        the value pointed to by lost
+ * @return the number of bytes read into str (not including the '\0'), 0
+ *        if there is no new data or on error
+ */
+static inline uint64_t
+debug_ring_read_cursor(
+    struct debug_ring_resources_t *drr, uint64_t *cursor, char *str, uint64_t len, uint64_t *lost)
+{
+    struct __debug_ring_t ring;
+
+    if (drr == 0 || cursor == 0 || str == 0 || len == 0)
+    { return 0; }
+
+    ring = __debug_ring_fixed(drr);
+    return __debug_ring_read_cursor(&ring, cursor, str, len, lost);
+}
 
-    for (i = 0; i < content && i < len - 1; i++) {
-        if (spos == DEBUG_RING_SIZE)
-        { spos = 0; }
+/** @cond */
 
-        if (drr->buf[spos] != '\0')
-        { str[i] = drr->buf[spos]; }
-        else {
-            i--;
-            content--;
-        }
+/*
+ * Copies len bytes to (or from) the debug ring at position pos using at most
+ * two memcpys (one if the region does not wrap).
+ */
+static inline void
+__debug_ring_put(const struct __debug_ring_t *ring, uint64_t pos, const void *src, uint64_t len)
+{
+    uint64_t seg;
+
+    pos &= ring->mask;
+    seg = ring->size - pos;
+
+    if (seg > len)
+    { seg = len; }
+
+    memcpy(ring->buf + pos, src, seg);
+    memcpy(ring->buf, bfrcast(const char *, src) + seg, len - seg);
+}
+
+static inline void
+__debug_ring_get(const struct __debug_ring_t *ring, uint64_t pos, void *dst, uint64_t len)
+{
+    uint64_t seg;
+
+    pos &= ring->mask;
+    seg = ring->size - pos;
+
+    if (seg > len)
+    { seg = len; }
+
+    memcpy(dst, ring->buf + pos, seg);
+    memcpy(bfrcast(char *, dst) + seg, ring->buf, len - seg);
+}
+
+/** @endcond */
+
+/**
+ * Debug Ring Init
+ *
+ * Sets up a (cleared) debug ring to store an unframed stream of characters,
+ * and marks it as having room for rpos so that it can be written to (see
+ * debug_ring_resources_t). This must be done by whoever allocates the
+ * debug ring.
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param drr the debug_ring_resource to set up
+ */
+static inline void
+debug_ring_init(struct debug_ring_resources_t *drr)
+{
+    if (drr == 0)
+    { return; }
+
+    drr->tag1 = DEBUG_RING_TAG1;
+    drr->tag2 = DEBUG_RING_TAG2;
+}
+
+/**
+ * Debug Ring Is Writable
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param drr the debug_ring_resource to check
+ * @return 1 if the debug ring has been set up using debug_ring_init or
+ *        debug_ring_init_records (and thus has room for rpos), 0 otherwise
+ */
+static inline int
+debug_ring_is_writable(const struct debug_ring_resources_t *drr)
+{
+    if (drr == 0)
+    { return 0; }
+
+    return (drr->tag1 == DEBUG_RING_TAG1 && drr->tag2 == DEBUG_RING_TAG2) ||
+           (drr->tag1 == DEBUG_RING_RECORD_TAG1 && drr->tag2 == DEBUG_RING_RECORD_TAG2);
+}
+
+#ifdef DEBUG_RING_ATOMICS
+
+/** @cond */
+
+/*
+ * Commits the region [rpos, rpos + len) once all of the regions that were
+ * reserved before it have been committed.
+ */
+static inline void
+__debug_ring_commit(const struct __debug_ring_t *ring, uint64_t rpos, uint64_t len)
+{
+    while (__debug_ring_load(ring->epos) != rpos)
+    { __debug_ring_relax(); }
+
+    __debug_ring_store(ring->epos, rpos + len);
+}
+
+static inline uint64_t
+__debug_ring_write(const struct __debug_ring_t *ring, const char *str, uint64_t len)
+{
+    uint64_t spos;
+    uint64_t rpos;
 
-        spos++;
+    rpos = __debug_ring_fetch_add(ring->rpos, len);
+    spos = __debug_ring_load(ring->spos);
+
+    while (spos + ring->size < rpos + len) {
+        if (__debug_ring_cas(ring->spos, &spos, rpos + len - ring->size))
+        { break; }
     }
 
-    str[i] = '\0';
+    /*
+     * If the writers before this one have reserved more than the size of
+     * the ring, the end of this writer's region wraps onto a region that
+     * might still be being copied into, so wait for it to be committed
+     * (the same rule that __debug_ring_write_record follows).
+     */
+
+    while (__debug_ring_load(ring->epos) + ring->size < rpos + len)
+    { __debug_ring_relax(); }
+
+    __debug_ring_put(ring, rpos, str, len);
+    __debug_ring_commit(ring, rpos, len);
+
+    return len;
+}
+
+/** @endcond */
+
+/**
+ * Debug Ring Write
+ *
+ * Writes a string to the debug ring. More than one CPU may write to the same
+ * debug ring at the same time without the need for a lock:
+ *
+ * - Space is reserved using an atomic fetch-add on rpos, so each writer
+ *   gets its own region of the ring.
+ * - If the reserved region overlaps the oldest data in the ring, spos is
+ *   advanced past the region before it is overwritten, so the oldest data is
+ *   always what is discarded, and readers stop treating it as valid.
+ * - The string is copied into the reserved region using at most two
+ *   memcpys (one if the region does not wrap). If the region wraps onto a
+ *   region that another writer has not committed yet (i.e. more than
+ *   DEBUG_RING_SIZE bytes are reserved at once), the copy waits for that
+ *   writer to commit first, so that its copy cannot land on top of this one.
+ * - The region is committed by advancing epos. Regions are committed in the
+ *   order they were reserved, so a writer waits for writers that reserved
+ *   space before it to finish their copy (never for a lock). As a result,
+ *   epos never covers data that is still being written.
+ *
+ * Note that the debug ring's memory must be cleared, and the debug ring
+ * set up using debug_ring_init, before it is first written to. A debug ring
+ * that has not been set up is not written to, as it might have been
+ * allocated without room for rpos (see debug_ring_resources_t).
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param drr the debug_ring_resource to write to
+ * @param str the string to write
+ * @param len the number of bytes in str to write. Must not be larger than
+ *        DEBUG_RING_SIZE
+ * @return the number of bytes written to the debug ring, 0
+ *        on error
+ */
+static inline uint64_t
+debug_ring_write(struct debug_ring_resources_t *drr, const char *str, uint64_t len)
+{
+    struct __debug_ring_t ring;
+
+    if (drr == 0 || str == 0 || len == 0 || len > DEBUG_RING_SIZE)
+    { return 0; }
+
+    if (debug_ring_is_writable(drr) == 0)
+    { return 0; }
+
+    ring = __debug_ring_fixed(drr);
+    return __debug_ring_write(&ring, str, len);
+}
+
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Records                                                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Debug Ring Record Tags
+ *
+ * A debug ring either stores an unframed stream of characters (written
+ * using debug_ring_write and read using debug_ring_read), or a sequence of
+ * records (written using debug_ring_write_record and read using
+ * debug_ring_read_record). The two must not be mixed in the same debug ring.
+ * A debug ring that stores records has tag1 and tag2 set to
+ * DEBUG_RING_RECORD_TAG1 and DEBUG_RING_RECORD_TAG2 (see
+ * debug_ring_init_records) instead of DEBUG_RING_TAG1 and DEBUG_RING_TAG2,
+ * so that tools that look at a memory dump can tell the two formats apart.
+ */
+
+/**
+ * Debug Ring Record Severities
+ *
+ * Values for debug_ring_record_t::severity. Lower values are more severe.
+ */
+#define DEBUG_RING_SEVERITY_ALERT 0
+#define DEBUG_RING_SEVERITY_ERROR 1
+#define DEBUG_RING_SEVERITY_WARNING 2
+#define DEBUG_RING_SEVERITY_INFO 3
+#define DEBUG_RING_SEVERITY_DEBUG 4
+
+/**
+ * Debug Ring Record Types
+ *
+ * Values for debug_ring_record_t::type. A text record's message is text
+ * (this is what debug_ring_write_record writes). The other types are
+ * written by the binary log (see DEBUG_BINARY_LOG in bfdebug.h):
+ *
+ * - A format record defines format id. Its message is a kind byte
+ *   (DEBUG_RING_FORMAT_NHEX or DEBUG_RING_FORMAT_NDEC), a flags byte
+ *   (DEBUG_RING_FORMAT_HAS_xxx), and then the color, type, indent and title
+ *   strings, each '\0' terminated. A missing indent or title is stored as
+ *   an empty string with its flag cleared.
+ * - A value record is a 64bit value (in the byte order of the CPU that
+ *   wrote it) that is to be printed using the format with the same id.
+ *
+ * A format record is written to a debug ring before the first value record
+ * that uses it, and is written again (before the next value record) if it
+ * has since been discarded, so a reader only needs the contents of the
+ * debug ring to decode it.
+ */
+#define DEBUG_RING_RECORD_TEXT 0
+#define DEBUG_RING_RECORD_FORMAT 1
+#define DEBUG_RING_RECORD_VALUE 2
+
+#define DEBUG_RING_FORMAT_NHEX 1
+#define DEBUG_RING_FORMAT_NDEC 2
+
+#define DEBUG_RING_FORMAT_HAS_INDENT 1
+#define DEBUG_RING_FORMAT_HAS_TITLE 2
+
+/**
+ * Debug Ring Record Alignment
+ *
+ * Each record in the debug ring starts on a multiple of this value, and is
+ * padded with '\0' characters up to the start of the next record.
+ *
+ * Note: defined in bytes
+ */
+#define DEBUG_RING_RECORD_ALIGN 8ULL
+
+/**
+ * @struct debug_ring_record_t
+ *
+ * Debug Ring Record
+ *
+ * The header that precedes each message in a debug ring that stores
+ * records. The message itself (which is not '\0' terminated) immediately
+ * follows the header.
+ *
+ * @var debug_ring_record_t::len
+ *     the length of the message that follows the header in bytes
+ * @var debug_ring_record_t::vcpuid
+ *     the id of the vCPU that wrote the record
+ * @var debug_ring_record_t::severity
+ *     the severity of the message (i.e. DEBUG_RING_SEVERITY_xxx)
+ * @var debug_ring_record_t::type
+ *     what the message contains (i.e. DEBUG_RING_RECORD_xxx)
+ * @var debug_ring_record_t::reserved
+ *     reserved, must be 0
+ * @var debug_ring_record_t::id
+ *     the format id of a format or value record, 0 otherwise
+ * @var debug_ring_record_t::tsc
+ *     the value of the TSC when the record was written
+ */
+struct debug_ring_record_t {
+    uint32_t len;
+    uint32_t vcpuid;
+    uint8_t severity;
+    uint8_t type;
+    uint8_t reserved[2];
+    uint32_t id;
+    uint64_t tsc;
+};
+
+/** @cond */
+
+/*
+ * Returns the number of bytes a record with a message of len bytes uses in
+ * the debug ring (header, message and padding).
+ */
+static inline uint64_t
+__debug_ring_record_size(uint64_t len)
+{
+    len += sizeof(struct debug_ring_record_t);
+    return (len + DEBUG_RING_RECORD_ALIGN - 1) & ~(DEBUG_RING_RECORD_ALIGN - 1);
+}
+
+/** @endcond */
+
+/**
+ * Debug Ring Init Records
+ *
+ * Sets up a (cleared) debug ring to store records instead of an unframed
+ * stream of characters. Like debug_ring_init, this must be done by whoever
+ * allocates the debug ring (or on a debug ring that has already been set up
+ * using debug_ring_init), as it also marks the debug ring as having room
+ * for rpos.
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param drr the debug_ring_resource to set up
+ */
+static inline void
+debug_ring_init_records(struct debug_ring_resources_t *drr)
+{
+    if (drr == 0)
+    { return; }
+
+    drr->tag1 = DEBUG_RING_RECORD_TAG1;
+    drr->tag2 = DEBUG_RING_RECORD_TAG2;
+}
+
+/**
+ * Debug Ring Has Records
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param drr the debug_ring_resource to check
+ * @return 1 if the debug ring stores records, 0 otherwise
+ */
+static inline int
+debug_ring_has_records(const struct debug_ring_resources_t *drr)
+{
+    if (drr == 0)
+    { return 0; }
+
+    return drr->tag1 == DEBUG_RING_RECORD_TAG1 && drr->tag2 == DEBUG_RING_RECORD_TAG2;
+}
+
+/**
+ * Debug Ring TSC
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @return the current value of the TSC, or 0 if it cannot be read on
+ *     this architecture / compiler
+ */
+static inline uint64_t
+debug_ring_tsc(void)
+{
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+#ifdef DEBUG_RING_ATOMICS
+
+/** @cond */
+
+static inline uint64_t
+__debug_ring_write_record(
+    const struct __debug_ring_t *ring, const struct debug_ring_record_t *hdr,
+    const char *str, uint64_t len)
+{
+    uint64_t size;
+    uint64_t spos;
+    uint64_t rpos;
+    struct debug_ring_record_t rec;
+
+    static const char pad[DEBUG_RING_RECORD_ALIGN] = {0};
+
+    size = __debug_ring_record_size(len);
+    if (size > ring->size)
+    { return 0; }
+
+    rec = *hdr;
+    rec.len = bfscast(uint32_t, len);
+
+    rpos = __debug_ring_fetch_add(ring->rpos, size);
+    spos = __debug_ring_load(ring->spos);
+
+    /*
+     * The header at spos can only be trusted if spos has not changed since
+     * it was read, as a writer always advances spos before it overwrites
+     * anything, which is why the compare exchange is done one record at
+     * a time. It also has to have been committed, as a record that is still
+     * being written (spos >= epos) might not have a header yet. In that case,
+     * the writer waits for the writers before it to commit, which they
+     * always do as the oldest writer only ever discards committed records.
+     */
+
+    while (spos + ring->size < rpos + size) {
+        uint32_t old_len;
+
+        if (spos >= __debug_ring_load(ring->epos)) {
+            __debug_ring_relax();
+            spos = __debug_ring_load(ring->spos);
+            continue;
+        }
+
+        __debug_ring_get(ring, spos, &old_len, sizeof(old_len));
+
+        __debug_ring_cas(ring->spos, &spos, spos + __debug_ring_record_size(old_len));
+    }
+
+    __debug_ring_put(ring, rpos, &rec, sizeof(rec));
+    __debug_ring_put(ring, rpos + sizeof(rec), str, len);
+    __debug_ring_put(ring, rpos + sizeof(rec) + len, pad, size - sizeof(rec) - len);
+    __debug_ring_commit(ring, rpos, size);
+
+    return size;
+}
+
+static inline struct debug_ring_record_t
+__debug_ring_text_record(uint64_t tsc, uint32_t vcpuid, uint8_t severity)
+{
+    struct debug_ring_record_t rec;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.vcpuid = vcpuid;
+    rec.severity = severity;
+    rec.type = DEBUG_RING_RECORD_TEXT;
+    rec.tsc = tsc;
+
+    return rec;
+}
+
+/** @endcond */
+
+/**
+ * Debug Ring Write Record
+ *
+ * Writes a record to the debug ring. Like debug_ring_write, more than one
+ * CPU may write to the same debug ring at the same time without the need for
+ * a lock. When the debug ring is full, whole records are discarded (oldest
+ * first) to make room, so spos always points to the start of a record.
+ * Only records that have been committed are discarded. If the room that is
+ * needed is still being written by other CPUs, the writer waits for them
+ * to commit.
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param drr the debug_ring_resource to write to
+ * @param tsc the timestamp of the record (e.g. debug_ring_tsc())
+ * @param vcpuid the id of the vCPU that is writing the record
+ * @param severity the severity of the message (DEBUG_RING_SEVERITY_xxx)
+ * @param str the message to write
+ * @param len the number of bytes in str to write. The record (see
+ *        debug_ring_record_t) must not be larger than DEBUG_RING_SIZE
+ * @return the number of bytes written to the debug ring (including the
+ *        header and padding), 0 on error
+ */
+static inline uint64_t
+debug_ring_write_record(
+    struct debug_ring_resources_t *drr, uint64_t tsc, uint32_t vcpuid, uint8_t severity,
+    const char *str, uint64_t len)
+{
+    struct __debug_ring_t ring;
+    struct debug_ring_record_t rec;
+
+    if (drr == 0 || (str == 0 && len != 0))
+    { return 0; }
+
+    if (debug_ring_is_writable(drr) == 0)
+    { return 0; }
+
+    ring = __debug_ring_fixed(drr);
+    rec = __debug_ring_text_record(tsc, vcpuid, severity);
+
+    return __debug_ring_write_record(&ring, &rec, str, len);
+}
+
+/**
+ * Debug Ring Write Record (Header)
+ *
+ * Same as debug_ring_write_record, except that the header is provided by
+ * the caller, so that records other than text (see DEBUG_RING_RECORD_xxx)
+ * can be written. The header's len is ignored, and is set to len instead.
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param drr the debug_ring_resource to write to
+ * @param rec the header of the record
+ * @param str the message to write
+ * @param len the number of bytes in str to write. The record (see
+ *        debug_ring_record_t) must not be larger than DEBUG_RING_SIZE
+ * @return the number of bytes written to the debug ring (including the
+ *        header and padding), 0 on error
+ */
+static inline uint64_t
+debug_ring_write_record_hdr(
+    struct debug_ring_resources_t *drr, const struct debug_ring_record_t *rec,
+    const char *str, uint64_t len)
+{
+    struct __debug_ring_t ring;
+
+    if (drr == 0 || rec == 0 || (str == 0 && len != 0))
+    { return 0; }
+
+    if (debug_ring_is_writable(drr) == 0)
+    { return 0; }
+
+    ring = __debug_ring_fixed(drr);
+    return __debug_ring_write_record(&ring, rec, str, len);
+}
+
+#endif
+
+/** @cond */
+
+/*
+ * If pos is not 0, it is set to the position of the record that was read.
+ * This cannot be worked out from the cursor and the record's length, as a
+ * truncated record's length is set to 0.
+ */
+static inline int
+__debug_ring_read_record(
+    const struct __debug_ring_t *ring, uint64_t *cursor, struct debug_ring_record_t *rec,
+    char *str, uint64_t len, uint64_t *lost, uint64_t *pos)
+{
+    uint64_t spos;
+    uint64_t epos;
+    uint64_t start;
+    uint64_t size;
+    uint64_t copy;
+
+    start = *cursor;
+
+    do {
+        epos = __debug_ring_load(ring->epos);
+        spos = __debug_ring_load(ring->spos);
+
+        if (start > epos)
+        { start = spos; }
+
+        if (start < spos) {
+            if (lost != 0)
+            { *lost += spos - start; }
+
+            start = spos;
+        }
+
+        if (start >= epos) {
+            *cursor = start;
+            return 0;
+        }
+
+        __debug_ring_get(ring, start, rec, sizeof(*rec));
+
+        size = __debug_ring_record_size(rec->len);
+
+        if (size > epos - start) {
+            size = epos - start;
+            rec->len = 0;
+        }
+
+        if (str != 0) {
+            copy = rec->len;
+
+            if (copy > len - 1)
+            { copy = len - 1; }
+
+            __debug_ring_get(ring, start + sizeof(*rec), str, copy);
+            str[copy] = '\0';
+        }
+    }
+    while (__debug_ring_load(ring->spos) > start);
+
+    if (pos != 0)
+    { *pos = start; }
+
+    *cursor = start + size;
+    return 1;
+}
+
+
+/** @endcond */
+
+/**
+ * Debug Ring Read Record
+ *
+ * Reads the record at the provided cursor and then advances the cursor to
+ * the next record. Like debug_ring_read_cursor, the cursor is owned by the
+ * caller, should be set to 0 prior to the first call, and the debug ring is
+ * not modified, which means that records can be iterated over (or skipped
+ * by passing 0 for str) without copying the rest of the debug ring.
+ *
+ * If the writer laps the reader, the cursor is moved to the oldest record
+ * still in the debug ring, and the number of bytes that were skipped is
+ * added to lost.
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param drr the debug_ring_resource to read from
+ * @param cursor the caller's position in the debug ring
+ * @param rec where to store the record's header
+ * @param str if not 0, the buffer to read the record's message into. The
+ *        message is truncated if needed, and is always '\0' terminated
+ * @param len the length of the str buffer in bytes
+ * @param lost if not 0, the number of bytes lost to overrun is added to
+ *        the value pointed to by lost
+ * @return 1 if a record was read, 0 if there are no more records or
+ *        on error
+ */
+static inline int
+debug_ring_read_record(
+    struct debug_ring_resources_t *drr, uint64_t *cursor, struct debug_ring_record_t *rec,
+    char *str, uint64_t len, uint64_t *lost)
+{
+    struct __debug_ring_t ring;
+
+    if (drr == 0 || cursor == 0 || rec == 0 || (str != 0 && len == 0))
+    { return 0; }
+
+    ring = __debug_ring_fixed(drr);
+    return __debug_ring_read_record(&ring, cursor, rec, str, len, lost, 0);
+}
+
+/* -------------------------------------------------------------------------- */
+/* Merge                                                                      */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @struct debug_ring_merge_t
+ *
+ * Debug Ring Merge
+ *
+ * Reads the records from more than one debug ring (e.g. one per vCPU) in
+ * timestamp order. This is a k-way merge: the next record of each debug
+ * ring is kept in a min-heap ordered by timestamp, so each record costs
+ * O(log N) to read, and only the header of one record per debug ring is
+ * held in memory, no matter how many records there are. Records with the
+ * same timestamp are returned in the order of the debug rings provided.
+ *
+ * Note that this structure is large (it has room for MAX_NUM_CPUS debug
+ * rings), and should not be placed on a kernel stack.
+ *
+ * @code
+ *
+ *  struct debug_ring_merge_t *merge = malloc(sizeof(*merge));
+ *  debug_ring_merge_init(merge, drrs, num);
+ *
+ *  while (debug_ring_merge_next(merge, &rec, str, len) == 1)
+ *      <do something with rec and str>
+ *
+ * @endcode
+ *
+ * @var debug_ring_merge_t::num
+ *     the number of debug rings being merged
+ * @var debug_ring_merge_t::heap_size
+ *     the number of debug rings that are in the heap
+ * @var debug_ring_merge_t::lost
+ *     the total number of bytes lost to overrun in all of the debug rings
+ * @var debug_ring_merge_t::rings
+ *     the debug rings being merged
+ * @var debug_ring_merge_t::cursors
+ *     the position of the next record in each debug ring
+ * @var debug_ring_merge_t::tscs
+ *     the timestamp of the next record in each debug ring
+ * @var debug_ring_merge_t::heap
+ *     the indexes of the debug rings that have a next record, as a min-heap
+ *     ordered by tscs
+ */
+struct debug_ring_merge_t {
+    uint64_t num;
+    uint64_t heap_size;
+    uint64_t lost;
+
+    struct __debug_ring_t rings[MAX_NUM_CPUS];
+    uint64_t cursors[MAX_NUM_CPUS];
+    uint64_t tscs[MAX_NUM_CPUS];
+    uint64_t heap[MAX_NUM_CPUS];
+};
+
+/** @cond */
+
+static inline int
+__debug_ring_merge_less(const struct debug_ring_merge_t *merge, uint64_t a, uint64_t b)
+{
+    a = merge->heap[a];
+    b = merge->heap[b];
+
+    if (merge->tscs[a] != merge->tscs[b])
+    { return merge->tscs[a] < merge->tscs[b]; }
+
+    return a < b;
+}
+
+static inline void
+__debug_ring_merge_swap(struct debug_ring_merge_t *merge, uint64_t a, uint64_t b)
+{
+    uint64_t tmp = merge->heap[a];
+
+    merge->heap[a] = merge->heap[b];
+    merge->heap[b] = tmp;
+}
+
+static inline void
+__debug_ring_merge_sift_up(struct debug_ring_merge_t *merge, uint64_t i)
+{
+    while (i > 0 && __debug_ring_merge_less(merge, i, (i - 1) / 2)) {
+        __debug_ring_merge_swap(merge, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static inline void
+__debug_ring_merge_sift_down(struct debug_ring_merge_t *merge, uint64_t i)
+{
+    uint64_t min;
+
+    while (1) {
+        min = i;
+
+        if (2 * i + 1 < merge->heap_size && __debug_ring_merge_less(merge, 2 * i + 1, min))
+        { min = 2 * i + 1; }
+
+        if (2 * i + 2 < merge->heap_size && __debug_ring_merge_less(merge, 2 * i + 2, min))
+        { min = 2 * i + 2; }
+
+        if (min == i)
+        { return; }
+
+        __debug_ring_merge_swap(merge, i, min);
+        i = min;
+    }
+}
+
+/*
+ * Reads the header of the next record in debug ring i (without advancing
+ * the cursor past it). Returns 1 if there is a next record, 0 otherwise.
+ */
+static inline int
+__debug_ring_merge_peek(struct debug_ring_merge_t *merge, uint64_t i)
+{
+    uint64_t pos;
+    uint64_t cursor = merge->cursors[i];
+    struct debug_ring_record_t rec;
+
+    if (__debug_ring_read_record(&merge->rings[i], &cursor, &rec, 0, 0, &merge->lost, &pos) == 0) {
+        merge->cursors[i] = cursor;
+        return 0;
+    }
+
+    merge->cursors[i] = pos;
+    merge->tscs[i] = rec.tsc;
+
+    return 1;
+}
+
+/** @endcond */
+
+/**
+ * Debug Ring Merge Refresh
+ *
+ * Adds any debug ring that did not have a record the last time it was
+ * checked, but does now, to the merge. This is called by
+ * debug_ring_merge_init, and by debug_ring_merge_next once all of the
+ * debug rings are empty, so it only needs to be called directly when
+ * records that were written to an empty debug ring should be merged in
+ * before the rest of the debug rings are empty.
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param merge the merge to refresh
+ */
+static inline void
+debug_ring_merge_refresh(struct debug_ring_merge_t *merge)
+{
+    uint64_t i;
+    uint64_t j;
+
+    if (merge == 0)
+    { return; }
+
+    for (i = 0; i < merge->num; i++) {
+        for (j = 0; j < merge->heap_size; j++) {
+            if (merge->heap[j] == i)
+            { break; }
+        }
+
+        if (j != merge->heap_size || __debug_ring_merge_peek(merge, i) == 0)
+        { continue; }
+
+        merge->heap[merge->heap_size] = i;
+        __debug_ring_merge_sift_up(merge, merge->heap_size++);
+    }
+}
+
+/** @cond */
+
+static inline void
+__debug_ring_merge_init(struct debug_ring_merge_t *merge, uint64_t num)
+{
+    uint64_t i;
+
+    merge->num = num;
+    merge->heap_size = 0;
+    merge->lost = 0;
+
+    for (i = 0; i < num; i++) {
+        merge->cursors[i] = 0;
+    }
+
+    debug_ring_merge_refresh(merge);
+}
+
+/** @endcond */
+
+/**
+ * Debug Ring Merge Init
+ *
+ * Sets up a merge of the records in the provided debug rings, starting
+ * with the oldest record in each. The debug rings must store records
+ * (see debug_ring_init_records).
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param merge the merge to set up
+ * @param drrs the debug rings to merge
+ * @param num the number of debug rings in drrs. Must not be larger than
+ *        MAX_NUM_CPUS
+ * @return 1 on success, 0 on error
+ */
+static inline int
+debug_ring_merge_init(
+    struct debug_ring_merge_t *merge, struct debug_ring_resources_t *const *drrs, uint64_t num)
+{
+    uint64_t i;
+
+    if (merge == 0 || drrs == 0 || num > MAX_NUM_CPUS)
+    { return 0; }
+
+    for (i = 0; i < num; i++) {
+        if (drrs[i] == 0)
+        { return 0; }
+    }
+
+    for (i = 0; i < num; i++) {
+        merge->rings[i] = __debug_ring_fixed(drrs[i]);
+    }
+
+    __debug_ring_merge_init(merge, num);
+    return 1;
+}
+
+/**
+ * Debug Ring Merge Next
+ *
+ * Reads the record with the lowest timestamp out of all of the debug rings
+ * being merged. If a debug ring is overrun while it is being merged, the
+ * records that are lost are skipped, and added to merge->lost.
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param merge the merge to read from
+ * @param rec where to store the record's header
+ * @param str if not 0, the buffer to read the record's message into. The
+ *        message is truncated if needed, and is always '\0' terminated
+ * @param len the length of the str buffer in bytes
+ * @return 1 if a record was read, 0 if there are no more records or
+ *        on error
+ */
+static inline int
+debug_ring_merge_next(
+    struct debug_ring_merge_t *merge, struct debug_ring_record_t *rec, char *str, uint64_t len)
+{
+    uint64_t i;
+
+    if (merge == 0 || rec == 0 || (str != 0 && len == 0))
+    { return 0; }
+
+    if (merge->heap_size == 0)
+    { debug_ring_merge_refresh(merge); }
+
+    while (merge->heap_size > 0) {
+        i = merge->heap[0];
+
+        if (__debug_ring_read_record(&merge->rings[i], &merge->cursors[i], rec, str, len, &merge->lost, 0) == 0) {
+            merge->heap[0] = merge->heap[--merge->heap_size];
+            __debug_ring_merge_sift_down(merge, 0);
+            continue;
+        }
+
+        if (__debug_ring_merge_peek(merge, i) == 0)
+        { merge->heap[0] = merge->heap[--merge->heap_size]; }
+
+        __debug_ring_merge_sift_down(merge, 0);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Variable Size                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Debug Ring Var Alloc Size
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param size the size of the debug ring's buffer in bytes
+ * @return the number of bytes that must be allocated for a debug_ring_var_t
+ *     whose buffer is size bytes
+ */
+static inline uint64_t
+debug_ring_var_alloc_size(uint64_t size)
+{ return sizeof(struct debug_ring_var_t) + size; }
+
+/**
+ * Debug Ring Var Init
+ *
+ * Sets up a (cleared) debug ring whose buffer is size bytes. The memory
+ * must be at least debug_ring_var_alloc_size(size) bytes.
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param dr the debug ring to set up
+ * @param size the size of the debug ring's buffer in bytes. Must be a power
+ *        of two, and at least DEBUG_RING_RECORD_ALIGN
+ * @return 1 on success, 0 on error
+ */
+static inline int
+debug_ring_var_init(struct debug_ring_var_t *dr, uint64_t size)
+{
+    if (dr == 0 || size < DEBUG_RING_RECORD_ALIGN || (size & (size - 1)) != 0)
+    { return 0; }
+
+    dr->size = size;
+    return 1;
+}
+
+/**
+ * Debug Ring Var Init Records
+ *
+ * Same as debug_ring_init_records, but for a debug_ring_var_t
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param dr the debug ring to set up
+ */
+static inline void
+debug_ring_var_init_records(struct debug_ring_var_t *dr)
+{
+    if (dr == 0)
+    { return; }
+
+    dr->tag1 = DEBUG_RING_RECORD_TAG1;
+    dr->tag2 = DEBUG_RING_RECORD_TAG2;
+}
+
+/**
+ * Debug Ring Var Has Records
+ *
+ * Same as debug_ring_has_records, but for a debug_ring_var_t
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param dr the debug ring to check
+ * @return 1 if the debug ring stores records, 0 otherwise
+ */
+static inline int
+debug_ring_var_has_records(const struct debug_ring_var_t *dr)
+{
+    if (dr == 0)
+    { return 0; }
+
+    return dr->tag1 == DEBUG_RING_RECORD_TAG1 && dr->tag2 == DEBUG_RING_RECORD_TAG2;
+}
+
+/**
+ * Debug Ring Var Read
+ *
+ * Same as debug_ring_read, but for a debug_ring_var_t
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param dr the debug ring to read from
+ * @param str the buffer to read the string into
+ * @param len the length of the str buffer in bytes
+ * @return the number of bytes read from the debug ring, 0
+ *        on error
+ */
+static inline uint64_t
+debug_ring_var_read(struct debug_ring_var_t *dr, char *str, uint64_t len)
+{
+    struct __debug_ring_t ring;
+
+    if (dr == 0 || str == 0 || len == 0)
+    { return 0; }
+
+    ring = __debug_ring_var(dr);
+    return __debug_ring_read(&ring, str, len);
+}
+
+/**
+ * Debug Ring Var Read (Cursor)
+ *
+ * Same as debug_ring_read_cursor, but for a debug_ring_var_t
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param dr the debug ring to read from
+ * @param cursor the caller's position in the debug ring
+ * @param str the buffer to read the string into
+ * @param len the length of the str buffer in bytes
+ * @param lost if not 0, the number of bytes lost to overrun is added to
+ *        the value pointed to by lost
+ * @return the number of bytes read into str (not including the '\0'), 0
+ *        if there is no new data or on error
+ */
+static inline uint64_t
+debug_ring_var_read_cursor(
+    struct debug_ring_var_t *dr, uint64_t *cursor, char *str, uint64_t len, uint64_t *lost)
+{
+    struct __debug_ring_t ring;
+
+    if (dr == 0 || cursor == 0 || str == 0 || len == 0)
+    { return 0; }
+
+    ring = __debug_ring_var(dr);
+    return __debug_ring_read_cursor(&ring, cursor, str, len, lost);
+}
+
+/**
+ * Debug Ring Var Read Record
+ *
+ * Same as debug_ring_read_record, but for a debug_ring_var_t
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param dr the debug ring to read from
+ * @param cursor the caller's position in the debug ring
+ * @param rec where to store the record's header
+ * @param str if not 0, the buffer to read the record's message into
+ * @param len the length of the str buffer in bytes
+ * @param lost if not 0, the number of bytes lost to overrun is added to
+ *        the value pointed to by lost
+ * @return 1 if a record was read, 0 if there are no more records or
+ *        on error
+ */
+static inline int
+debug_ring_var_read_record(
+    struct debug_ring_var_t *dr, uint64_t *cursor, struct debug_ring_record_t *rec,
+    char *str, uint64_t len, uint64_t *lost)
+{
+    struct __debug_ring_t ring;
+
+    if (dr == 0 || cursor == 0 || rec == 0 || (str != 0 && len == 0))
+    { return 0; }
+
+    ring = __debug_ring_var(dr);
+    return __debug_ring_read_record(&ring, cursor, rec, str, len, lost, 0);
+}
+
+#ifdef DEBUG_RING_ATOMICS
+
+/**
+ * Debug Ring Var Write
+ *
+ * Same as debug_ring_write, but for a debug_ring_var_t
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param dr the debug ring to write to
+ * @param str the string to write
+ * @param len the number of bytes in str to write. Must not be larger than
+ *        dr->size
+ * @return the number of bytes written to the debug ring, 0
+ *        on error
+ */
+static inline uint64_t
+debug_ring_var_write(struct debug_ring_var_t *dr, const char *str, uint64_t len)
+{
+    struct __debug_ring_t ring;
+
+    if (dr == 0 || str == 0 || len == 0 || len > dr->size)
+    { return 0; }
+
+    ring = __debug_ring_var(dr);
+    return __debug_ring_write(&ring, str, len);
+}
+
+/**
+ * Debug Ring Var Write Record
+ *
+ * Same as debug_ring_write_record, but for a debug_ring_var_t
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param dr the debug ring to write to
+ * @param tsc the timestamp of the record (e.g. debug_ring_tsc())
+ * @param vcpuid the id of the vCPU that is writing the record
+ * @param severity the severity of the message (DEBUG_RING_SEVERITY_xxx)
+ * @param str the message to write
+ * @param len the number of bytes in str to write. The record (see
+ *        debug_ring_record_t) must not be larger than dr->size
+ * @return the number of bytes written to the debug ring (including the
+ *        header and padding), 0 on error
+ */
+static inline uint64_t
+debug_ring_var_write_record(
+    struct debug_ring_var_t *dr, uint64_t tsc, uint32_t vcpuid, uint8_t severity,
+    const char *str, uint64_t len)
+{
+    struct __debug_ring_t ring;
+    struct debug_ring_record_t rec;
+
+    if (dr == 0 || (str == 0 && len != 0))
+    { return 0; }
+
+    ring = __debug_ring_var(dr);
+    rec = __debug_ring_text_record(tsc, vcpuid, severity);
+
+    return __debug_ring_write_record(&ring, &rec, str, len);
+}
+
+/**
+ * Debug Ring Var Write Record (Header)
+ *
+ * Same as debug_ring_write_record_hdr, but for a debug_ring_var_t
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param dr the debug ring to write to
+ * @param rec the header of the record
+ * @param str the message to write
+ * @param len the number of bytes in str to write. The record (see
+ *        debug_ring_record_t) must not be larger than dr->size
+ * @return the number of bytes written to the debug ring (including the
+ *        header and padding), 0 on error
+ */
+static inline uint64_t
+debug_ring_var_write_record_hdr(
+    struct debug_ring_var_t *dr, const struct debug_ring_record_t *rec,
+    const char *str, uint64_t len)
+{
+    struct __debug_ring_t ring;
+
+    if (dr == 0 || rec == 0 || (str == 0 && len != 0))
+    { return 0; }
+
+    ring = __debug_ring_var(dr);
+    return __debug_ring_write_record(&ring, rec, str, len);
+}
+
+#endif
+
+/**
+ * Debug Ring Var Merge Init
+ *
+ * Same as debug_ring_merge_init, but for debug_ring_var_t. The debug rings
+ * do not need to be the same size.
+ *
+ * @expects none
+ * @ensures none
+ *
+ * @param merge the merge to set up
+ * @param drs the debug rings to merge
+ * @param num the number of debug rings in drs. Must not be larger than
+ *        MAX_NUM_CPUS
+ * @return 1 on success, 0 on error
+ */
+static inline int
+debug_ring_var_merge_init(
+    struct debug_ring_merge_t *merge, struct debug_ring_var_t *const *drs, uint64_t num)
+{
+    uint64_t i;
+
+    if (merge == 0 || drs == 0 || num > MAX_NUM_CPUS)
+    { return 0; }
+
+    for (i = 0; i < num; i++) {
+        if (drs[i] == 0)
+        { return 0; }
+    }
+
+    for (i = 0; i < num; i++) {
+        merge->rings[i] = __debug_ring_var(drs[i]);
+    }
 
-    return content;
+    __debug_ring_merge_init(merge, num);
+    return 1;
 }
 
 #ifdef __cplusplus
@@ -33,6 +33,59 @@
 
 size_t g_new_throws_bad_alloc = 0;
 
+// By default, allocations use malloc (and page aligned allocations for
+// multiples of a page). Defining BFNEWDELETE_SLAB before including this
+// header uses the slab allocator in bfslab.h instead, which uses per-thread
+// caches for small objects. Defining BFNEWDELETE_POOL uses the fixed size
+// heap and page pools in bfpool.h, which run out of memory the same way
+// the VMM does.
+
+#if defined(BFNEWDELETE_SLAB)
+
+#include <bfslab.h>
+
+static void *
+custom_new(std::size_t size)
+{
+    if (size == g_new_throws_bad_alloc || size == 0xFFFFFFFFFFFFFFFF) {
+        throw std::bad_alloc();
+    }
+
+    if (auto ptr = bfn::slab_alloc(size)) {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+static void
+custom_delete(void *ptr)
+{ bfn::slab_free(ptr); }
+
+#elif defined(BFNEWDELETE_POOL)
+
+#include <bfpool.h>
+
+static void *
+custom_new(std::size_t size)
+{
+    if (size == g_new_throws_bad_alloc || size == 0xFFFFFFFFFFFFFFFF) {
+        throw std::bad_alloc();
+    }
+
+    if (auto ptr = bfn::pool_alloc(size)) {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+static void
+custom_delete(void *ptr)
+{ bfn::pool_free(ptr); }
+
+#else
+
 #ifdef _WIN32
 #include <malloc.h>
 #define aligned_alloc _aligned_malloc
@@ -56,6 +109,8 @@ static void
 custom_delete(void *ptr)
 { free(ptr); }
 
+#endif
+
 void *
 operator new[](std::size_t size)
 { return custom_new(size); }
@@ -0,0 +1,589 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+///
+/// @file bfpool.h
+///
+
+#ifndef BFPOOL_H
+#define BFPOOL_H
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+#include <bfgsl.h>
+#include <bfconstants.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace bfn
+{
+
+/// Pool Stats
+///
+/// The statistics of a buddy_pool (see buddy_pool::stats).
+///
+struct pool_stats {
+    std::size_t size{0};                ///< size of the pool
+    std::size_t used_bytes{0};          ///< bytes currently allocated (rounded up to a block)
+    std::size_t high_water{0};          ///< most bytes that were allocated at once
+    std::size_t free_bytes{0};          ///< bytes that are not allocated
+    std::size_t largest_free{0};        ///< largest allocation that can currently succeed
+    std::size_t requested_bytes{0};     ///< total bytes requested by all allocations
+    std::size_t allocated_bytes{0};     ///< total bytes given to all allocations
+    std::size_t allocs{0};              ///< number of allocations
+    std::size_t frees{0};               ///< number of frees
+    std::size_t failures{0};            ///< number of allocations that failed
+
+    /// External Fragmentation
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the fraction of the free bytes that cannot be used by the
+    ///     largest allocation that could succeed (0 means that all of the
+    ///     free bytes are in one block)
+    ///
+    double
+    external_fragmentation() const noexcept
+    {
+        if (free_bytes == 0) {
+            return 0.0;
+        }
+
+        return 1.0 - static_cast<double>(largest_free) / static_cast<double>(free_bytes);
+    }
+
+    /// Internal Fragmentation
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the fraction of the bytes given to allocations that was lost
+    ///     to rounding up to a power of two block
+    ///
+    double
+    internal_fragmentation() const noexcept
+    {
+        if (allocated_bytes == 0) {
+            return 0.0;
+        }
+
+        return 1.0 - static_cast<double>(requested_bytes) / static_cast<double>(allocated_bytes);
+    }
+};
+
+/// Buddy Pool
+///
+/// A fixed size pool of memory that is reserved up front, and is divided
+/// into power-of-two blocks using the buddy system: allocations are rounded
+/// up to a power of two number of blocks, larger blocks are split in half
+/// until an allocation fits, and on free, a block is merged with its
+/// "buddy" (the other half of the block it was split from) whenever the
+/// buddy is also free. Blocks are aligned to their size.
+///
+/// Unlike malloc, this pool runs out of memory, which is how the VMM's
+/// heap and page pools (MAX_HEAP_POOL and MAX_PAGE_POOL) behave.
+///
+/// All functions are thread safe.
+///
+class buddy_pool
+{
+public:
+
+    using size_type = std::size_t;      ///< Size type of the pool
+
+    /// Constructor
+    ///
+    /// @expects min_shift >= 4 (a free block must be able to store two pointers)
+    /// @expects size is a non-zero multiple of the min block size
+    /// @ensures none
+    ///
+    /// @param size the size of the pool in bytes
+    /// @param min_shift the size of the smallest block (in bits)
+    ///
+    /// @throws std::bad_alloc if the pool cannot be reserved
+    ///
+    buddy_pool(size_type size, size_type min_shift) :
+        m_size(size),
+        m_min_shift(min_shift),
+        m_num_blocks(size >> min_shift)
+    {
+        expects(min_shift >= 4 && min_shift < 32);
+        expects(size != 0);
+        expects((size & ((1ULL << min_shift) - 1)) == 0);
+
+        while ((2ULL << m_max_order) <= m_num_blocks) {
+            m_max_order++;
+        }
+
+        // The pool is aligned to its largest block, so that every block is
+        // aligned to its size. This only reserves (untouched) virtual
+        // memory when the pool is not a power of two.
+
+        auto align = 1ULL << (m_max_order + min_shift);
+        align = align > MAX_PAGE_SIZE ? align : MAX_PAGE_SIZE;
+
+#ifdef _WIN32
+        m_base = static_cast<char *>(_aligned_malloc(size, align));
+#else
+        m_base = static_cast<char *>(aligned_alloc(align, (size + align - 1) & ~(align - 1)));
+#endif
+
+        m_meta = static_cast<uint8_t *>(calloc(m_num_blocks, sizeof(uint8_t)));
+
+        if (m_base == nullptr || m_meta == nullptr) {
+            this->release();
+            throw std::bad_alloc();
+        }
+
+        // If the pool is not a power of two, it is divided into the
+        // largest blocks that fit, largest first, so that every block is
+        // aligned to its size.
+
+        size_type index = 0;
+        for (auto order = m_max_order + 1; order-- > 0;) {
+            if (m_num_blocks - index >= (1ULL << order)) {
+                this->push(index, order);
+                index += 1ULL << order;
+            }
+        }
+    }
+
+    /// Destructor
+    ///
+    /// Releases the pool. Any memory allocated from the pool is no longer
+    /// valid.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    ~buddy_pool()
+    { this->release(); }
+
+    /// Allocate
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param size the number of bytes to allocate
+    /// @return the allocated memory (aligned to the size of its block), or
+    ///     nullptr if the pool does not have a free block that is large
+    ///     enough
+    ///
+    void *
+    alloc(size_type size) noexcept
+    {
+        size_type order = 0;
+        while (order <= m_max_order && (1ULL << (order + m_min_shift)) < size) {
+            order++;
+        }
+
+        this->lock();
+
+        auto found = order;
+        while (found <= m_max_order && m_free.at(found) == nullptr) {
+            found++;
+        }
+
+        if (found > m_max_order) {
+            m_stats.failures++;
+            this->unlock();
+
+            return nullptr;
+        }
+
+        auto index = this->pop(found);
+
+        while (found > order) {
+            found--;
+            this->push(index + (1ULL << found), found);
+        }
+
+        m_meta[index] = static_cast<uint8_t>(meta_head | order);
+
+        auto bytes = 1ULL << (order + m_min_shift);
+
+        m_stats.used_bytes += bytes;
+        m_stats.requested_bytes += size;
+        m_stats.allocated_bytes += bytes;
+        m_stats.allocs++;
+
+        if (m_stats.used_bytes > m_stats.high_water) {
+            m_stats.high_water = m_stats.used_bytes;
+        }
+
+        this->unlock();
+        return m_base + (index << m_min_shift);
+    }
+
+    /// Free
+    ///
+    /// @expects ptr was allocated from this pool and has not been freed,
+    ///     or is nullptr
+    /// @ensures none
+    ///
+    /// @param ptr the memory to free
+    ///
+    void
+    free(void *ptr) noexcept
+    {
+        if (ptr == nullptr) {
+            return;
+        }
+
+        auto index = this->index(ptr);
+
+        this->lock();
+
+        auto order = static_cast<size_type>(m_meta[index] & meta_order);
+
+        m_stats.used_bytes -= 1ULL << (order + m_min_shift);
+        m_stats.frees++;
+
+        m_meta[index] = 0;
+
+        for (; order < m_max_order; order++) {
+            auto buddy = index ^ (1ULL << order);
+
+            if (buddy >= m_num_blocks || m_meta[buddy] != (meta_head | meta_free | order)) {
+                break;
+            }
+
+            this->remove(buddy, order);
+            index = index < buddy ? index : buddy;
+        }
+
+        this->push(index, order);
+        this->unlock();
+    }
+
+    /// Contains
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param ptr the pointer to check
+    /// @return true if ptr points into this pool, false otherwise
+    ///
+    bool
+    contains(const void *ptr) const noexcept
+    {
+        auto addr = reinterpret_cast<uintptr_t>(ptr);
+        auto base = reinterpret_cast<uintptr_t>(m_base);
+
+        return addr >= base && addr - base < m_size;
+    }
+
+    /// Block Size
+    ///
+    /// @expects ptr was allocated from this pool and has not been freed
+    /// @ensures none
+    ///
+    /// @param ptr a pointer returned by alloc
+    /// @return the size of the block that was allocated for ptr
+    ///
+    size_type
+    block_size(const void *ptr) const noexcept
+    { return 1ULL << ((m_meta[this->index(ptr)] & meta_order) + m_min_shift); }
+
+    /// Stats
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the current statistics of the pool
+    ///
+    pool_stats
+    stats() const noexcept
+    {
+        this->lock();
+
+        auto stats = m_stats;
+
+        stats.size = m_size;
+        stats.free_bytes = m_size - stats.used_bytes;
+
+        for (auto order = m_max_order + 1; order-- > 0;) {
+            if (m_free.at(order) != nullptr) {
+                stats.largest_free = 1ULL << (order + m_min_shift);
+                break;
+            }
+        }
+
+        this->unlock();
+        return stats;
+    }
+
+    /// Reset High Water
+    ///
+    /// Resets the high water mark to the number of bytes that are currently
+    /// allocated, so that the high water mark of a workload can be
+    /// measured.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    void
+    reset_high_water() noexcept
+    {
+        this->lock();
+        m_stats.high_water = m_stats.used_bytes;
+        this->unlock();
+    }
+
+private:
+
+    // Each min sized block has a byte of metadata. If the block is the
+    // start of a block (free or allocated), meta_head is set and the low
+    // bits store the block's order (log2 of its size in min sized blocks).
+    // Free blocks are stored in a doubly linked list per order, using the
+    // free block's own memory.
+
+    static constexpr const uint8_t meta_head = 0x80;
+    static constexpr const uint8_t meta_free = 0x40;
+    static constexpr const uint8_t meta_order = 0x3F;
+
+    struct free_block {
+        free_block *next;
+        free_block *prev;
+    };
+
+    size_type
+    index(const void *ptr) const noexcept
+    {
+        auto offset = static_cast<size_type>(static_cast<const char *>(ptr) - m_base);
+        return offset >> m_min_shift;
+    }
+
+    free_block *
+    block(size_type index) const noexcept
+    { return reinterpret_cast<free_block *>(m_base + (index << m_min_shift)); }
+
+    void
+    push(size_type index, size_type order) noexcept
+    {
+        auto blk = this->block(index);
+        auto &head = m_free.at(order);
+
+        blk->next = head;
+        blk->prev = nullptr;
+
+        if (head != nullptr) {
+            head->prev = blk;
+        }
+
+        head = blk;
+        m_meta[index] = static_cast<uint8_t>(meta_head | meta_free | order);
+    }
+
+    void
+    remove(size_type index, size_type order) noexcept
+    {
+        auto blk = this->block(index);
+
+        if (blk->prev != nullptr) {
+            blk->prev->next = blk->next;
+        }
+        else {
+            m_free.at(order) = blk->next;
+        }
+
+        if (blk->next != nullptr) {
+            blk->next->prev = blk->prev;
+        }
+
+        m_meta[index] = 0;
+    }
+
+    size_type
+    pop(size_type order) noexcept
+    {
+        auto index = this->index(m_free.at(order));
+
+        this->remove(index, order);
+        return index;
+    }
+
+    // A mutex and not a spin lock, as native threads can be preempted while
+    // they hold it, which, when the pool backs new and delete, would leave
+    // every other allocating thread spinning for its whole time slice.
+
+    void
+    lock() const noexcept
+    { m_lock.lock(); }
+
+    void
+    unlock() const noexcept
+    { m_lock.unlock(); }
+
+    void
+    release() noexcept
+    {
+#ifdef _WIN32
+        _aligned_free(m_base);
+#else
+        ::free(m_base);
+#endif
+
+        ::free(m_meta);
+
+        m_base = nullptr;
+        m_meta = nullptr;
+    }
+
+private:
+
+    size_type m_size;
+    size_type m_min_shift;
+    size_type m_num_blocks;
+    size_type m_max_order{0};
+
+    char *m_base{nullptr};
+    uint8_t *m_meta{nullptr};
+
+    std::array<free_block *, 64> m_free{};
+    pool_stats m_stats{};
+
+    mutable std::mutex m_lock;
+
+public:
+
+    buddy_pool(buddy_pool &&) noexcept = delete;                ///< Deleted move construction
+    buddy_pool &operator=(buddy_pool &&) noexcept = delete;     ///< Deleted move operator
+
+    buddy_pool(const buddy_pool &) = delete;                    ///< Deleted copy construction
+    buddy_pool &operator=(const buddy_pool &) = delete;         ///< Deleted copy operator
+};
+
+/// @cond
+
+// The global pools are constructed in static storage, and are never
+// destroyed, so that memory can still be freed by other static
+// destructors.
+
+template<std::size_t size, std::size_t min_shift>
+buddy_pool &
+__pool_instance()
+{
+    alignas(buddy_pool) static char s_storage[sizeof(buddy_pool)];
+    static buddy_pool *s_pool = new (s_storage) buddy_pool(size, min_shift);
+
+    return *s_pool;
+}
+
+/// @endcond
+
+/// Heap Pool
+///
+/// A pool of MAX_HEAP_POOL bytes, with a min block size of 16 bytes, that
+/// is used for allocations that are not a multiple of a page (like the
+/// VMM's heap).
+///
+/// @expects none
+/// @ensures none
+///
+/// @return the heap pool
+///
+/// @throws std::bad_alloc if the pool cannot be reserved
+///
+inline buddy_pool &
+heap_pool()
+{ return __pool_instance<MAX_HEAP_POOL, 4>(); }
+
+/// Page Pool
+///
+/// A pool of MAX_PAGE_POOL bytes, with a min block size of a page, that is
+/// used for allocations that are a multiple of a page (like the VMM's page
+/// pool).
+///
+/// @expects none
+/// @ensures none
+///
+/// @return the page pool
+///
+/// @throws std::bad_alloc if the pool cannot be reserved
+///
+inline buddy_pool &
+page_pool()
+{ return __pool_instance<MAX_PAGE_POOL, MAX_PAGE_SHIFT>(); }
+
+/// Pool Allocate
+///
+/// Allocates from the page pool if size is a multiple of a page, and from
+/// the heap pool otherwise, the same way the VMM does.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param size the number of bytes to allocate
+/// @return the allocated memory, or nullptr if the pool is out of memory
+///
+/// @throws std::bad_alloc if the pools cannot be reserved
+///
+inline void *
+pool_alloc(std::size_t size)
+{
+    auto &heap = heap_pool();
+    auto &page = page_pool();
+
+    if (size != 0 && (size & (MAX_PAGE_SIZE - 1)) == 0) {
+        return page.alloc(size);
+    }
+
+    return heap.alloc(size);
+}
+
+/// Pool Free
+///
+/// Frees memory allocated by pool_alloc. Pointers that do not belong to
+/// either pool (like nullptr) are ignored.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param ptr the memory to free
+///
+inline void
+pool_free(void *ptr) noexcept
+{
+    if (ptr == nullptr) {
+        return;
+    }
+
+    if (heap_pool().contains(ptr)) {
+        heap_pool().free(ptr);
+        return;
+    }
+
+    if (page_pool().contains(ptr)) {
+        page_pool().free(ptr);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,660 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+///
+/// @file bfsearch.h
+///
+
+#ifndef BFSEARCH_H
+#define BFSEARCH_H
+
+#include <array>
+#include <atomic>
+#include <limits>
+#include <cstring>
+#include <algorithm>
+
+#include <bfgsl.h>
+#include <bftypes.h>
+#include <bfbuffer.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define BFSEARCH_SSE2
+#if defined(NATIVE) && defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define BFSEARCH_AVX2
+#endif
+#endif
+
+namespace bfn
+{
+
+/// No Position
+///
+/// Returned by bfn::find when the pattern is not found.
+///
+constexpr const std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+/// SIMD Level
+///
+/// The instructions that bfn::find, bfn::mismatch and bfn::hash may use.
+/// SSE2 is used whenever the compiler targets it (it is part of x86_64).
+/// AVX2 is only used on native x86_64 builds, and only if the CPU reports
+/// that it supports it, as the rest of the code is not compiled for it.
+///
+enum class simd_level {
+    scalar,
+    sse2,
+    avx2
+};
+
+/// @cond
+
+inline simd_level
+__simd_detect() noexcept
+{
+#ifdef BFSEARCH_AVX2
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        return simd_level::avx2;
+    }
+#endif
+
+#ifdef BFSEARCH_SSE2
+    return simd_level::sse2;
+#else
+    return simd_level::scalar;
+#endif
+}
+
+inline std::atomic<simd_level> &
+__simd_level() noexcept
+{
+    static std::atomic<simd_level> s_level{__simd_detect()};
+    return s_level;
+}
+
+/// @endcond
+
+/// Supported SIMD Level
+///
+/// @expects none
+/// @ensures none
+///
+/// @return returns the highest SIMD level that this CPU (and build) supports
+///
+inline simd_level
+simd_supported() noexcept
+{
+    static const auto s_level = __simd_detect();
+    return s_level;
+}
+
+/// Get SIMD Level
+///
+/// @expects none
+/// @ensures none
+///
+/// @return returns the SIMD level that is currently used
+///
+inline simd_level
+get_simd_level() noexcept
+{ return __simd_level().load(std::memory_order_relaxed); }
+
+/// Set SIMD Level
+///
+/// Limits the instructions that are used, which is mostly useful for
+/// testing and benchmarking each implementation. Levels that are not
+/// supported are lowered to simd_supported(). The result of each function
+/// does not depend on the level used.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param level the SIMD level to use
+/// @return returns the SIMD level that is now used
+///
+inline simd_level
+set_simd_level(simd_level level) noexcept
+{
+    if (level > simd_supported()) {
+        level = simd_supported();
+    }
+
+    __simd_level().store(level, std::memory_order_relaxed);
+    return level;
+}
+
+/// @cond
+
+constexpr const std::size_t __hash_lanes = 8;
+constexpr const std::size_t __hash_stripe = __hash_lanes * sizeof(uint64_t);
+constexpr const uint64_t __hash_step = 0x9E3779B97F4A7C15ULL;
+
+constexpr const std::array<uint64_t, __hash_lanes> __hash_keys = {{
+    0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL,
+    0xDB979083E96DD4DEULL, 0x1F67B3B7A4A44072ULL,
+    0x78E5C0CC4EE679CBULL, 0x2172FFCC7DD05A82ULL,
+    0x8E2443F7744608B8ULL, 0x4C263A81E69035E0ULL
+}};
+
+// Scalar
+//
+// Used as is when SIMD is not available, and for whatever is left over
+// (less than a vector) by the SIMD versions.
+
+inline std::size_t
+__mismatch_scalar(const char *lhs, const char *rhs, std::size_t len) noexcept
+{
+    std::size_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t a;
+        uint64_t b;
+
+        memcpy(&a, lhs + i, sizeof(a));
+        memcpy(&b, rhs + i, sizeof(b));
+
+        if (a != b) {
+            break;
+        }
+    }
+
+    for (; i < len; i++) {
+        if (lhs[i] != rhs[i]) {
+            return i;
+        }
+    }
+
+    return len;
+}
+
+inline std::size_t
+__find_scalar(const char *data, std::size_t len, const char *pat, std::size_t plen) noexcept
+{
+    auto end = len - plen + 1;
+
+    for (std::size_t i = 0; i < end; i++) {
+        auto ptr = static_cast<const char *>(memchr(data + i, pat[0], end - i));
+        if (ptr == nullptr) {
+            break;
+        }
+
+        i = static_cast<std::size_t>(ptr - data);
+        if (memcmp(ptr + 1, pat + 1, plen - 1) == 0) {
+            return i;
+        }
+    }
+
+    return npos;
+}
+
+inline void
+__hash_stripe_scalar(uint64_t *acc, uint64_t *key, const char *data) noexcept
+{
+    for (std::size_t i = 0; i < __hash_lanes; i++) {
+        uint64_t val;
+        memcpy(&val, data + (i * sizeof(val)), sizeof(val));
+
+        auto k = val ^ key[i];
+        acc[i] += (k & 0xFFFFFFFFULL) * (k >> 32);
+        acc[i ^ 1] += val;
+        key[i] += __hash_step;
+    }
+}
+
+inline std::size_t
+__hash_scalar(uint64_t *acc, uint64_t *key, const char *data, std::size_t len) noexcept
+{
+    std::size_t i = 0;
+
+    for (; i + __hash_stripe <= len; i += __hash_stripe) {
+        __hash_stripe_scalar(acc, key, data + i);
+    }
+
+    return i;
+}
+
+// SSE2
+
+#ifdef BFSEARCH_SSE2
+
+inline __m128i
+__sse2_load(const char *ptr) noexcept
+{ return _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr)); }
+
+inline std::size_t
+__mismatch_sse2(const char *lhs, const char *rhs, std::size_t len) noexcept
+{
+    std::size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        auto eq = _mm_cmpeq_epi8(__sse2_load(lhs + i), __sse2_load(rhs + i));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(eq));
+
+        if (mask != 0xFFFFU) {
+            return i + static_cast<std::size_t>(__builtin_ctz(~mask));
+        }
+    }
+
+    return i + __mismatch_scalar(lhs + i, rhs + i, len - i);
+}
+
+// Compares the first and the last byte of the pattern against 16
+// candidate positions at a time, and only compares the rest of the pattern
+// for the candidates where both match.
+
+inline std::size_t
+__find_sse2(const char *data, std::size_t len, const char *pat, std::size_t plen) noexcept
+{
+    auto end = len - plen + 1;
+    auto first = _mm_set1_epi8(pat[0]);
+    auto last = _mm_set1_epi8(pat[plen - 1]);
+
+    std::size_t i = 0;
+    for (; i + 16 <= end; i += 16) {
+        auto eq_first = _mm_cmpeq_epi8(first, __sse2_load(data + i));
+        auto eq_last = _mm_cmpeq_epi8(last, __sse2_load(data + i + plen - 1));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(eq_first, eq_last)));
+
+        while (mask != 0) {
+            auto pos = i + static_cast<std::size_t>(__builtin_ctz(mask));
+
+            if (plen <= 2 || memcmp(data + pos + 1, pat + 1, plen - 2) == 0) {
+                return pos;
+            }
+
+            mask &= mask - 1;
+        }
+    }
+
+    if (i == end) {
+        return npos;
+    }
+
+    auto ret = __find_scalar(data + i, len - i, pat, plen);
+    return ret == npos ? npos : i + ret;
+}
+
+inline void
+__hash_lane_sse2(__m128i &acc, __m128i &key, __m128i step, const char *data) noexcept
+{
+    auto val = __sse2_load(data);
+    auto k = _mm_xor_si128(val, key);
+
+    acc = _mm_add_epi64(acc, _mm_mul_epu32(k, _mm_srli_epi64(k, 32)));
+    acc = _mm_add_epi64(acc, _mm_shuffle_epi32(val, 0x4E));
+    key = _mm_add_epi64(key, step);
+}
+
+inline std::size_t
+__hash_sse2(uint64_t *acc, uint64_t *key, const char *data, std::size_t len) noexcept
+{
+    auto acc_ptr = reinterpret_cast<__m128i *>(acc);
+    auto key_ptr = reinterpret_cast<__m128i *>(key);
+    auto step = _mm_set1_epi64x(static_cast<long long>(__hash_step));
+
+    auto acc0 = _mm_loadu_si128(acc_ptr + 0);
+    auto acc1 = _mm_loadu_si128(acc_ptr + 1);
+    auto acc2 = _mm_loadu_si128(acc_ptr + 2);
+    auto acc3 = _mm_loadu_si128(acc_ptr + 3);
+    auto key0 = _mm_loadu_si128(key_ptr + 0);
+    auto key1 = _mm_loadu_si128(key_ptr + 1);
+    auto key2 = _mm_loadu_si128(key_ptr + 2);
+    auto key3 = _mm_loadu_si128(key_ptr + 3);
+
+    std::size_t i = 0;
+    for (; i + __hash_stripe <= len; i += __hash_stripe) {
+        __hash_lane_sse2(acc0, key0, step, data + i + 0x00);
+        __hash_lane_sse2(acc1, key1, step, data + i + 0x10);
+        __hash_lane_sse2(acc2, key2, step, data + i + 0x20);
+        __hash_lane_sse2(acc3, key3, step, data + i + 0x30);
+    }
+
+    _mm_storeu_si128(acc_ptr + 0, acc0);
+    _mm_storeu_si128(acc_ptr + 1, acc1);
+    _mm_storeu_si128(acc_ptr + 2, acc2);
+    _mm_storeu_si128(acc_ptr + 3, acc3);
+    _mm_storeu_si128(key_ptr + 0, key0);
+    _mm_storeu_si128(key_ptr + 1, key1);
+    _mm_storeu_si128(key_ptr + 2, key2);
+    _mm_storeu_si128(key_ptr + 3, key3);
+
+    return i;
+}
+
+#endif
+
+// AVX2
+
+#ifdef BFSEARCH_AVX2
+
+__attribute__((target("avx2"))) inline __m256i
+__avx2_load(const char *ptr) noexcept
+{ return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr)); }
+
+__attribute__((target("avx2"))) inline std::size_t
+__mismatch_avx2(const char *lhs, const char *rhs, std::size_t len) noexcept
+{
+    std::size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        auto eq = _mm256_cmpeq_epi8(__avx2_load(lhs + i), __avx2_load(rhs + i));
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(eq));
+
+        if (mask != 0xFFFFFFFFU) {
+            return i + static_cast<std::size_t>(__builtin_ctz(~mask));
+        }
+    }
+
+    return i + __mismatch_sse2(lhs + i, rhs + i, len - i);
+}
+
+__attribute__((target("avx2"))) inline std::size_t
+__find_avx2(const char *data, std::size_t len, const char *pat, std::size_t plen) noexcept
+{
+    auto end = len - plen + 1;
+    auto first = _mm256_set1_epi8(pat[0]);
+    auto last = _mm256_set1_epi8(pat[plen - 1]);
+
+    std::size_t i = 0;
+    for (; i + 32 <= end; i += 32) {
+        auto eq_first = _mm256_cmpeq_epi8(first, __avx2_load(data + i));
+        auto eq_last = _mm256_cmpeq_epi8(last, __avx2_load(data + i + plen - 1));
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(eq_first, eq_last)));
+
+        while (mask != 0) {
+            auto pos = i + static_cast<std::size_t>(__builtin_ctz(mask));
+
+            if (plen <= 2 || memcmp(data + pos + 1, pat + 1, plen - 2) == 0) {
+                return pos;
+            }
+
+            mask &= mask - 1;
+        }
+    }
+
+    if (i == end) {
+        return npos;
+    }
+
+    auto ret = __find_sse2(data + i, len - i, pat, plen);
+    return ret == npos ? npos : i + ret;
+}
+
+__attribute__((target("avx2"))) inline void
+__hash_lane_avx2(__m256i &acc, __m256i &key, __m256i step, const char *data) noexcept
+{
+    auto val = __avx2_load(data);
+    auto k = _mm256_xor_si256(val, key);
+
+    acc = _mm256_add_epi64(acc, _mm256_mul_epu32(k, _mm256_srli_epi64(k, 32)));
+    acc = _mm256_add_epi64(acc, _mm256_shuffle_epi32(val, 0x4E));
+    key = _mm256_add_epi64(key, step);
+}
+
+__attribute__((target("avx2"))) inline std::size_t
+__hash_avx2(uint64_t *acc, uint64_t *key, const char *data, std::size_t len) noexcept
+{
+    auto acc_ptr = reinterpret_cast<__m256i *>(acc);
+    auto key_ptr = reinterpret_cast<__m256i *>(key);
+    auto step = _mm256_set1_epi64x(static_cast<long long>(__hash_step));
+
+    auto acc0 = _mm256_loadu_si256(acc_ptr + 0);
+    auto acc1 = _mm256_loadu_si256(acc_ptr + 1);
+    auto key0 = _mm256_loadu_si256(key_ptr + 0);
+    auto key1 = _mm256_loadu_si256(key_ptr + 1);
+
+    std::size_t i = 0;
+    for (; i + __hash_stripe <= len; i += __hash_stripe) {
+        __hash_lane_avx2(acc0, key0, step, data + i + 0x00);
+        __hash_lane_avx2(acc1, key1, step, data + i + 0x20);
+    }
+
+    _mm256_storeu_si256(acc_ptr + 0, acc0);
+    _mm256_storeu_si256(acc_ptr + 1, acc1);
+    _mm256_storeu_si256(key_ptr + 0, key0);
+    _mm256_storeu_si256(key_ptr + 1, key1);
+
+    return i;
+}
+
+#endif
+
+inline uint64_t
+__hash_mix(uint64_t val) noexcept
+{
+    val ^= val >> 33;
+    val *= 0xFF51AFD7ED558CCDULL;
+    val ^= val >> 33;
+    val *= 0xC4CEB9FE1A85EC53ULL;
+    val ^= val >> 33;
+
+    return val;
+}
+
+/// @endcond
+
+/// Find
+///
+/// Same thing as std::string::find, but for bytes. Returns the index of
+/// the first occurrence of pattern in data, starting at pos.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param data the bytes to search
+/// @param pattern the bytes to search for
+/// @param pos the index in data to start searching from
+/// @return returns the index of pattern in data, pos if pattern is empty
+///     (and pos <= data.size()), or bfn::npos if it is not found
+///
+inline std::size_t
+find(gsl::span<const char> data, gsl::span<const char> pattern, std::size_t pos = 0) noexcept
+{
+    auto len = static_cast<std::size_t>(data.size());
+    auto plen = static_cast<std::size_t>(pattern.size());
+
+    if (pos > len || plen > len - pos) {
+        return npos;
+    }
+
+    if (plen == 0) {
+        return pos;
+    }
+
+    auto ptr = data.data() + pos;
+    auto ret = npos;
+
+    switch (get_simd_level()) {
+#ifdef BFSEARCH_AVX2
+        case simd_level::avx2:
+            ret = __find_avx2(ptr, len - pos, pattern.data(), plen);
+            break;
+#endif
+
+#ifdef BFSEARCH_SSE2
+        case simd_level::sse2:
+            ret = __find_sse2(ptr, len - pos, pattern.data(), plen);
+            break;
+#endif
+
+        default:
+            ret = __find_scalar(ptr, len - pos, pattern.data(), plen);
+            break;
+    }
+
+    return ret == npos ? npos : ret + pos;
+}
+
+/// Mismatch
+///
+/// Same thing as std::mismatch, but returns an index. Compares the bytes
+/// that lhs and rhs have in common (i.e. the shorter of the two).
+///
+/// @expects none
+/// @ensures none
+///
+/// @param lhs the bytes to compare
+/// @param rhs the bytes to compare
+/// @return returns the index of the first byte that differs, or the size
+///     of the shorter of lhs and rhs if none do
+///
+inline std::size_t
+mismatch(gsl::span<const char> lhs, gsl::span<const char> rhs) noexcept
+{
+    auto len = static_cast<std::size_t>(std::min(lhs.size(), rhs.size()));
+
+    if (len == 0) {
+        return 0;
+    }
+
+    switch (get_simd_level()) {
+#ifdef BFSEARCH_AVX2
+        case simd_level::avx2:
+            return __mismatch_avx2(lhs.data(), rhs.data(), len);
+#endif
+
+#ifdef BFSEARCH_SSE2
+        case simd_level::sse2:
+            return __mismatch_sse2(lhs.data(), rhs.data(), len);
+#endif
+
+        default:
+            return __mismatch_scalar(lhs.data(), rhs.data(), len);
+    }
+}
+
+/// Hash
+///
+/// A fast, non-cryptographic 64bit hash of a sequence of bytes (e.g. for
+/// finding identical modules). Eight 64bit lanes are updated independently
+/// using 32x32 bit multiplies, which is why SIMD can process 64 bytes at a
+/// time. The result is the same at every SIMD level, but is not compatible
+/// with any published hash, and is only stable between machines of the
+/// same endianness. It must not be used where an attacker controls the
+/// data and could benefit from a collision.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param data the bytes to hash
+/// @param seed changes the result, for the same data
+/// @return returns the hash of data
+///
+inline uint64_t
+hash(gsl::span<const char> data, uint64_t seed = 0) noexcept
+{
+    std::array<uint64_t, __hash_lanes> acc;
+    std::array<uint64_t, __hash_lanes> key;
+
+    for (std::size_t i = 0; i < __hash_lanes; i++) {
+        acc[i] = __hash_keys[i] ^ seed;
+        key[i] = __hash_keys[(i + 3) % __hash_lanes];
+    }
+
+    auto ptr = data.data();
+    auto len = static_cast<std::size_t>(data.size());
+    std::size_t done = 0;
+
+    if (len != 0) {
+        switch (get_simd_level()) {
+#ifdef BFSEARCH_AVX2
+            case simd_level::avx2:
+                done = __hash_avx2(acc.data(), key.data(), ptr, len);
+                break;
+#endif
+
+#ifdef BFSEARCH_SSE2
+            case simd_level::sse2:
+                done = __hash_sse2(acc.data(), key.data(), ptr, len);
+                break;
+#endif
+
+            default:
+                done = __hash_scalar(acc.data(), key.data(), ptr, len);
+                break;
+        }
+    }
+
+    if (done != len) {
+        std::array<char, __hash_stripe> tail{};
+
+        memcpy(tail.data(), ptr + done, len - done);
+        __hash_stripe_scalar(acc.data(), key.data(), tail.data());
+    }
+
+    auto ret = __hash_mix(seed ^ (len * __hash_step));
+    for (auto val : acc) {
+        ret = __hash_mix(ret ^ val);
+    }
+
+    return ret;
+}
+
+/// Find (Buffer)
+///
+/// @expects none
+/// @ensures none
+///
+/// @param buf the buffer to search
+/// @param pattern the bytes to search for
+/// @param pos the index in buf to start searching from
+/// @return returns bfn::find(buf.span(), pattern, pos)
+///
+template<std::size_t N>
+std::size_t
+find(const basic_buffer<N> &buf, gsl::span<const char> pattern, std::size_t pos = 0) noexcept
+{ return find(buf.span(), pattern, pos); }
+
+/// Mismatch (Buffer)
+///
+/// @expects none
+/// @ensures none
+///
+/// @param lhs the buffer to compare
+/// @param rhs the buffer to compare
+/// @return returns bfn::mismatch(lhs.span(), rhs.span())
+///
+template<std::size_t N1, std::size_t N2>
+std::size_t
+mismatch(const basic_buffer<N1> &lhs, const basic_buffer<N2> &rhs) noexcept
+{ return mismatch(lhs.span(), rhs.span()); }
+
+/// Hash (Buffer)
+///
+/// @expects none
+/// @ensures none
+///
+/// @param buf the buffer to hash
+/// @param seed changes the result, for the same data
+/// @return returns bfn::hash(buf.span(), seed)
+///
+template<std::size_t N>
+uint64_t
+hash(const basic_buffer<N> &buf, uint64_t seed = 0) noexcept
+{ return hash(buf.span(), seed); }
+
+}
+
+#endif
@@ -0,0 +1,565 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+///
+/// @file bfslab.h
+///
+
+#ifndef BFSLAB_H
+#define BFSLAB_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <mutex>
+#include <new>
+
+#include <bfconstants.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace bfn
+{
+
+/// Slab Min Shift
+///
+/// The smallest size class (in bits). Every object must be able to store a
+/// free list pointer, and 16 bytes keeps malloc's alignment.
+///
+constexpr const std::size_t slab_min_shift = 4;
+
+/// Slab Max Shift
+///
+/// The largest size class (in bits). Larger allocations are page backed.
+///
+constexpr const std::size_t slab_max_shift = 11;
+
+/// Slab Classes
+///
+/// The number of power-of-two size classes (16 bytes to 2k by default).
+///
+constexpr const std::size_t slab_classes = slab_max_shift - slab_min_shift + 1;
+
+/// Slab Shift
+///
+/// The size (in bits) of each slab. Slabs are aligned to their size, so the
+/// slab that an object belongs to can be found by masking its address.
+///
+constexpr const std::size_t slab_shift = 16;
+
+/// Slab Size
+///
+/// The size (in bytes) of each slab.
+///
+constexpr const std::size_t slab_size = 1ULL << slab_shift;
+
+/// Slab Max Slabs
+///
+/// The maximum number of slabs (defaults to 1GB of small objects). Once
+/// this limit is reached, small objects are page backed.
+///
+constexpr const std::size_t slab_max_slabs = 0x4000;
+
+/// Slab Cache Size
+///
+/// The maximum number of free objects each thread caches per size class.
+/// When a thread's cache is full, half of it is returned to the global free
+/// list, and when it is empty, half of this is taken from the global free
+/// list, so that the global lock is only taken once per batch.
+///
+constexpr const std::size_t slab_cache_size = 0x100;
+
+/// @cond
+
+struct __slab_object {
+    __slab_object *next;
+};
+
+struct __slab_list {
+    __slab_object *head;
+    std::size_t count;
+};
+
+struct __slab_cache {
+    std::array<__slab_list, slab_classes> lists;
+};
+
+struct __slab_global {
+    std::mutex lock;
+    std::array<__slab_list, slab_classes> lists;
+
+    // The registry is an insert only, open addressing hash set of slabs.
+    // Each entry stores the slab's address, with its size class in the low
+    // bits (which are always 0 as slabs are aligned to slab_size). This is
+    // how a free determines if an object came from a slab, without reading
+    // memory that it might not own.
+
+    std::array<std::atomic<uintptr_t>, slab_max_slabs * 2> registry;
+    std::atomic<std::size_t> num_slabs;
+};
+
+inline __slab_global &
+__slab_global_state() noexcept
+{
+    static __slab_global s_global{};
+    return s_global;
+}
+
+inline void *
+__slab_page_alloc(std::size_t align, std::size_t size) noexcept
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, align);
+#else
+    return aligned_alloc(align, size);
+#endif
+}
+
+inline void
+__slab_page_free(void *ptr) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+inline std::size_t
+__slab_class(std::size_t size) noexcept
+{
+    std::size_t cls = 0;
+
+    while ((1ULL << (cls + slab_min_shift)) < size) {
+        cls++;
+    }
+
+    return cls;
+}
+
+inline std::size_t
+__slab_registry_index(uintptr_t base) noexcept
+{
+    auto &global = __slab_global_state();
+    return static_cast<std::size_t>(((base >> slab_shift) * 0x9E3779B97F4A7C15ULL) % global.registry.size());
+}
+
+inline bool
+__slab_registry_add(uintptr_t base, std::size_t cls) noexcept
+{
+    auto &global = __slab_global_state();
+
+    if (global.num_slabs.fetch_add(1) >= slab_max_slabs) {
+        global.num_slabs.fetch_sub(1);
+        return false;
+    }
+
+    for (auto i = __slab_registry_index(base); ; i = (i + 1) % global.registry.size()) {
+        uintptr_t expected = 0;
+
+        if (global.registry.at(i).compare_exchange_strong(expected, base | cls)) {
+            return true;
+        }
+    }
+}
+
+// Returns the size class of the slab that ptr belongs to, or slab_classes
+// if ptr does not belong to a slab.
+
+inline std::size_t
+__slab_registry_find(const void *ptr) noexcept
+{
+    auto &global = __slab_global_state();
+    auto base = reinterpret_cast<uintptr_t>(ptr) & ~(slab_size - 1);
+
+    for (auto i = __slab_registry_index(base); ; i = (i + 1) % global.registry.size()) {
+        auto entry = global.registry.at(i).load(std::memory_order_acquire);
+
+        if (entry == 0) {
+            return slab_classes;
+        }
+
+        if ((entry & ~(slab_size - 1)) == base) {
+            return entry & (slab_size - 1);
+        }
+    }
+}
+
+// The global lock is a mutex and not a spin lock, as native threads can be
+// preempted while they hold it, and the threads waiting on it would then
+// spin for the rest of their time slice.
+
+inline void
+__slab_lock() noexcept
+{ __slab_global_state().lock.lock(); }
+
+inline void
+__slab_unlock() noexcept
+{ __slab_global_state().lock.unlock(); }
+
+inline void
+__slab_push(__slab_list &list, void *ptr) noexcept
+{
+    auto obj = static_cast<__slab_object *>(ptr);
+
+    obj->next = list.head;
+    list.head = obj;
+    list.count++;
+}
+
+inline void *
+__slab_pop(__slab_list &list) noexcept
+{
+    auto obj = list.head;
+
+    list.head = obj->next;
+    list.count--;
+
+    return obj;
+}
+
+// Moves up to num objects from one list to another. The global lock must be
+// held if either list is a global list.
+
+inline void
+__slab_move(__slab_list &dst, __slab_list &src, std::size_t num) noexcept
+{
+    for (; num > 0 && src.head != nullptr; num--) {
+        __slab_push(dst, __slab_pop(src));
+    }
+}
+
+// Carves a new slab into objects of the given size class, and adds them
+// to list, which must be empty. The global lock does not need to be held,
+// and should not be, as allocating the slab can take a while. Returns the
+// last object in the list (see __slab_splice), or nullptr on failure.
+
+inline void *
+__slab_grow(__slab_list &list, std::size_t cls) noexcept
+{
+    auto slab = static_cast<char *>(__slab_page_alloc(slab_size, slab_size));
+    if (slab == nullptr) {
+        return nullptr;
+    }
+
+    if (!__slab_registry_add(reinterpret_cast<uintptr_t>(slab), cls)) {
+        __slab_page_free(slab);
+        return nullptr;
+    }
+
+    auto size = 1ULL << (cls + slab_min_shift);
+
+    for (auto offset = slab_size; offset >= size; offset -= size) {
+        __slab_push(list, slab + offset - size);
+    }
+
+    return slab + slab_size - size;
+}
+
+// Adds every object in src to the front of dst, where tail is the last
+// object in src. The global lock must be held if either list is a global
+// list.
+
+inline void
+__slab_splice(__slab_list &dst, __slab_list &src, void *tail) noexcept
+{
+    if (src.head == nullptr) {
+        return;
+    }
+
+    static_cast<__slab_object *>(tail)->next = dst.head;
+    dst.head = src.head;
+    dst.count += src.count;
+
+    src.head = nullptr;
+    src.count = 0;
+}
+
+// Moves up to num objects of the given size class from the global free
+// list to list. If the global free list is empty, a new slab is carved
+// (without holding the global lock), and the objects that are not moved to
+// list are added to the global free list.
+
+inline void
+__slab_refill(__slab_list &list, std::size_t cls, std::size_t num) noexcept
+{
+    auto &global = __slab_global_state().lists.at(cls);
+
+    __slab_lock();
+    __slab_move(list, global, num);
+    __slab_unlock();
+
+    if (list.head != nullptr) {
+        return;
+    }
+
+    __slab_list slab{};
+
+    auto tail = __slab_grow(slab, cls);
+    if (tail == nullptr) {
+        return;
+    }
+
+    __slab_move(list, slab, num);
+
+    __slab_lock();
+    __slab_splice(global, slab, tail);
+    __slab_unlock();
+}
+
+// Each thread has a cache of free objects. When the thread exits, the
+// cache is returned to the global free lists, and any objects that the
+// thread frees after that (e.g. from other thread_local destructors) go
+// straight to the global free lists.
+
+struct __slab_cache_guard {
+    __slab_cache *cache;
+    bool *dead;
+
+    __slab_cache_guard(__slab_cache *c, bool *d) noexcept :
+        cache(c),
+        dead(d)
+    { }
+
+    ~__slab_cache_guard()
+    {
+        __slab_lock();
+
+        for (std::size_t cls = 0; cls < slab_classes; cls++) {
+            __slab_move(__slab_global_state().lists.at(cls), cache->lists.at(cls), cache->lists.at(cls).count);
+        }
+
+        *dead = true;
+        __slab_unlock();
+    }
+
+    __slab_cache_guard(__slab_cache_guard &&) = delete;
+    __slab_cache_guard &operator=(__slab_cache_guard &&) = delete;
+    __slab_cache_guard(const __slab_cache_guard &) = delete;
+    __slab_cache_guard &operator=(const __slab_cache_guard &) = delete;
+};
+
+inline __slab_cache *
+__slab_thread_cache() noexcept
+{
+    static thread_local __slab_cache s_cache{};
+    static thread_local bool s_dead = false;
+
+    if (s_dead) {
+        return nullptr;
+    }
+
+    static thread_local __slab_cache_guard s_guard{&s_cache, &s_dead};
+    return s_guard.cache;
+}
+
+/// @endcond
+
+/// Slab Allocate
+///
+/// Allocates memory using the slab allocator. Allocations of up to
+/// 1 << slab_max_shift bytes are rounded up to a power of two and come from
+/// the calling thread's cache of free objects for that size class, and are
+/// aligned to their size class. Larger allocations are rounded up to a
+/// multiple of a page and are page aligned.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param size the number of bytes to allocate
+/// @return the allocated memory, or nullptr if the allocation failed
+///
+inline void *
+slab_alloc(std::size_t size) noexcept
+{
+    if (size > (1ULL << slab_max_shift)) {
+        if (size > std::numeric_limits<std::size_t>::max() - MAX_PAGE_SIZE) {
+            return nullptr;
+        }
+
+        return __slab_page_alloc(MAX_PAGE_SIZE, (size + MAX_PAGE_SIZE - 1) & ~(MAX_PAGE_SIZE - 1));
+    }
+
+    auto cls = __slab_class(size);
+
+    if (auto cache = __slab_thread_cache()) {
+        auto &list = cache->lists.at(cls);
+
+        if (list.head != nullptr) {
+            return __slab_pop(list);
+        }
+
+        __slab_refill(list, cls, slab_cache_size / 2);
+
+        if (list.head != nullptr) {
+            return __slab_pop(list);
+        }
+    }
+    else {
+        __slab_list list{};
+        __slab_refill(list, cls, 1);
+
+        if (list.head != nullptr) {
+            return __slab_pop(list);
+        }
+    }
+
+    return __slab_page_alloc(MAX_PAGE_SIZE, MAX_PAGE_SIZE);
+}
+
+/// Slab Free
+///
+/// Frees memory allocated by slab_alloc. Objects may be freed by any
+/// thread, in which case they are added to that thread's cache.
+///
+/// @expects ptr was allocated by slab_alloc, or is nullptr
+/// @ensures none
+///
+/// @param ptr the memory to free
+///
+inline void
+slab_free(void *ptr) noexcept
+{
+    if (ptr == nullptr) {
+        return;
+    }
+
+    auto cls = __slab_registry_find(ptr);
+    if (cls == slab_classes) {
+        __slab_page_free(ptr);
+        return;
+    }
+
+    if (auto cache = __slab_thread_cache()) {
+        auto &list = cache->lists.at(cls);
+        __slab_push(list, ptr);
+
+        if (list.count > slab_cache_size) {
+            __slab_lock();
+            __slab_move(__slab_global_state().lists.at(cls), list, slab_cache_size / 2);
+            __slab_unlock();
+        }
+
+        return;
+    }
+
+    __slab_lock();
+    __slab_push(__slab_global_state().lists.at(cls), ptr);
+    __slab_unlock();
+}
+
+/// Slab Object Size
+///
+/// @expects none
+/// @ensures none
+///
+/// @param ptr a pointer returned by slab_alloc
+/// @return the size class of the slab that ptr belongs to (i.e. the number
+///     of bytes that can be used), or 0 if ptr is page backed
+///
+inline std::size_t
+slab_object_size(const void *ptr) noexcept
+{
+    auto cls = __slab_registry_find(ptr);
+    return cls == slab_classes ? 0 : 1ULL << (cls + slab_min_shift);
+}
+
+/// Slab Allocator
+///
+/// A std::allocator compatible allocator that uses slab_alloc, so that
+/// containers can use the slab allocator without replacing the global
+/// new/delete operators.
+///
+template<typename T>
+struct slab_allocator {
+    using value_type = T;       ///< Type of the objects allocated
+
+    /// Default Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    slab_allocator() noexcept = default;
+
+    /// Rebind Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    template<typename U>
+    slab_allocator(const slab_allocator<U> &) noexcept
+    { }
+
+    /// Allocate
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param num the number of objects to allocate
+    /// @return the allocated memory
+    ///
+    /// @throws std::bad_alloc if the allocation failed
+    ///
+    T *
+    allocate(std::size_t num)
+    {
+        if (num > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+
+        if (auto ptr = slab_alloc(num * sizeof(T))) {
+            return static_cast<T *>(ptr);
+        }
+
+        throw std::bad_alloc();
+    }
+
+    /// Deallocate
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param ptr the memory to free
+    ///
+    void
+    deallocate(T *ptr, std::size_t) noexcept
+    { slab_free(ptr); }
+};
+
+/// @cond
+
+template<typename T, typename U>
+bool operator==(const slab_allocator<T> &, const slab_allocator<U> &) noexcept
+{ return true; }
+
+template<typename T, typename U>
+bool operator!=(const slab_allocator<T> &, const slab_allocator<U> &) noexcept
+{ return false; }
+
+/// @endcond
+
+}
+
+#endif
@@ -26,11 +26,17 @@
 #ifndef BFSTRING_H
 #define BFSTRING_H
 
+#include <array>
 #include <vector>
 #include <string>
 #include <sstream>
-#include <iomanip>
 #include <type_traits>
+#include <system_error>
+
+#if __cplusplus >= 201703L && __has_include(<charconv>)
+#include <charconv>
+#define BFN_STD_TO_CHARS
+#endif
 
 /// std::string literal
 ///
@@ -46,53 +52,199 @@ inline auto operator""_s(const char *str, std::size_t len)
 namespace bfn
 {
 
-/// Convert to String (with base)
+#ifdef BFN_STD_TO_CHARS
+using std::to_chars_result;
+#else
+
+/// To Chars Result
 ///
-/// Same thing as std::to_string, but adds the ability to state the base for
-/// conversion.
+/// Emulation of std::to_chars_result for systems that do not have C++17.
+///
+struct to_chars_result {
+    char *ptr;          ///< one past the last character written
+    std::errc ec;       ///< std::errc() on success
+};
+
+#endif
+
+/// Max String Size
+///
+/// The number of characters needed to store the largest result of
+/// bfn::to_string for a 64bit integer (e.g. "0" + 22 octal digits).
+///
+constexpr const std::size_t to_string_max_size = 32;
+
+/// @cond
+
+template<typename T>
+constexpr bool
+__to_chars_is_negative(const T val, std::true_type) noexcept
+{ return val < 0; }
+
+template<typename T>
+constexpr bool
+__to_chars_is_negative(const T, std::false_type) noexcept
+{ return false; }
+
+/// @endcond
+
+/// Convert to Chars
+///
+/// Same thing as std::to_chars. If the compiler provides C++17, the
+/// standard version is used. Otherwise, this function emulates it so that
+/// C++17 is not required on all systems. No memory is allocated.
+///
+/// @expects base >= 2 && base <= 36
+/// @ensures none
+///
+/// @param first the beginning of the caller provided storage
+/// @param last the end of the caller provided storage
+/// @param val the value to convert
+/// @param base the base for conversion.
+/// @return {ptr, std::errc()} on success, where ptr is one past the last
+///     character written, {last, std::errc::value_too_large} otherwise
+///
+template <
+    typename T,
+    typename = std::enable_if<std::is_integral<T>::value>
+    >
+to_chars_result
+to_chars(char *first, char *last, const T val, const int base = 10)
+{
+#ifdef BFN_STD_TO_CHARS
+    return std::to_chars(first, last, val, base);
+#else
+
+    using unsigned_type = std::make_unsigned_t<T>;
+
+    std::array<char, sizeof(T) * 8> digits;
+    std::size_t num = 0;
+
+    auto neg = __to_chars_is_negative(val, std::is_signed<T>());
+    auto uval = static_cast<unsigned_type>(val);
+    auto ubase = static_cast<unsigned_type>(base);
+
+    if (neg) {
+        uval = static_cast<unsigned_type>(unsigned_type(0) - uval);
+    }
+
+    do {
+        digits[num++] = "0123456789abcdefghijklmnopqrstuvwxyz"[uval % ubase];
+        uval = static_cast<unsigned_type>(uval / ubase);
+    }
+    while (uval != 0);
+
+    if (static_cast<std::size_t>(last - first) < num + (neg ? 1 : 0)) {
+        return {last, std::errc::value_too_large};
+    }
+
+    if (neg) {
+        *first++ = '-';
+    }
+
+    while (num > 0) {
+        *first++ = digits[--num];
+    }
+
+    return {first, std::errc()};
+
+#endif
+}
+
+/// Convert to String (with base, no allocation)
+///
+/// Same thing as bfn::to_string(val, base), but the result is written to
+/// caller provided storage instead of a std::string, which means that no
+/// memory is allocated. Octal numbers are prefixed with "0", and hex
+/// numbers are prefixed with "0x", are upper case and are zero padded to
+/// 16 digits. All other bases are converted as decimal. The result is not
+/// null terminated.
 ///
 /// @expects none
 /// @ensures none
 ///
+/// @param first the beginning of the caller provided storage
+/// @param last the end of the caller provided storage
 /// @param val the value to convert
 /// @param base the base for conversion.
-/// @return string version of val converted to the provided base
+/// @return {ptr, std::errc()} on success, where ptr is one past the last
+///     character written, {last, std::errc::value_too_large} otherwise
 ///
 template <
     typename T,
     typename = std::enable_if<std::is_integral<T>::value>
     >
-std::string
-to_string(const T val, const int base)
+to_chars_result
+to_string(char *first, char *last, const T val, const int base)
 {
-    // TODO:
-    //
-    // C++17 has a new set of functions that called to_chars which gets rid
-    // of the allocation. We should use this in the VMM when compiled with
-    // our cross compiler. When not compiled with our cross compiler, we
-    // should use this code to emulate it so that we do not need C++17 on all
-    // systems. This optimization would reduce the debugging code to just
-    // page allocations as needed which is ideal
-    //
-
-    std::stringstream stream;
+    using unsigned_type = std::make_unsigned_t<T>;
 
     switch (base) {
-        case 8:
-            stream << "0";
-            break;
+        case 8: {
+            if (first == last) {
+                return {last, std::errc::value_too_large};
+            }
+
+            *first++ = '0';
+            return to_chars(first, last, static_cast<unsigned_type>(val), 8);
+        }
+
+        case 16: {
+            constexpr const std::ptrdiff_t width = 16;
+            std::array<char, sizeof(T) * 2 + width> digits;
+
+            auto ret = to_chars(
+                digits.data(), digits.data() + digits.size(), static_cast<unsigned_type>(val), 16);
+
+            auto num = ret.ptr - digits.data();
+            auto pad = num < width ? width - num : 0;
 
-        case 16:
-            stream << "0x";
-            stream << std::setfill('0') << std::setw(16);
-            break;
+            if (last - first < 2 + pad + num) {
+                return {last, std::errc::value_too_large};
+            }
+
+            *first++ = '0';
+            *first++ = 'x';
+
+            for (; pad > 0; pad--) {
+                *first++ = '0';
+            }
+
+            for (auto iter = digits.data(); iter != ret.ptr; iter++) {
+                *first++ = *iter >= 'a' ? static_cast<char>(*iter - 'a' + 'A') : *iter;
+            }
+
+            return {first, std::errc()};
+        }
 
         default:
-            break;
+            return to_chars(first, last, val, 10);
     };
+}
+
+/// Convert to String (with base)
+///
+/// Same thing as std::to_string, but adds the ability to state the base for
+/// conversion.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param val the value to convert
+/// @param base the base for conversion.
+/// @return string version of val converted to the provided base
+///
+template <
+    typename T,
+    typename = std::enable_if<std::is_integral<T>::value>
+    >
+std::string
+to_string(const T val, const int base)
+{
+    std::array<char, to_string_max_size> str;
+    auto ret = to_string(str.data(), str.data() + str.size(), val, base);
 
-    stream << std::setbase(base) << std::uppercase << val;
-    return stream.str();
+    return std::string(str.data(), ret.ptr);
 }
 
 /// Split String
@@ -0,0 +1,385 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <catch/catch.hpp>
+#include <bfbenchmark.h>
+
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+benchmark_options
+fast_options()
+{
+    benchmark_options options;
+
+    options.warmup_ns = 1000;
+    options.min_sample_ns = 10000;
+    options.num_samples = 11;
+
+    return options;
+}
+
+TEST_CASE("benchmark_run: statistics")
+{
+    uint64_t calls = 0;
+
+    auto result = benchmark_run("test", [&] {
+        benchmark_do_not_optimize(++calls);
+    }, fast_options());
+
+    CHECK(result.name == "test");
+    CHECK(result.samples == 11);
+    CHECK(result.iterations > 0);
+    CHECK(calls >= result.iterations * result.samples);
+
+    CHECK(result.min_ns <= result.median_ns);
+    CHECK(result.median_ns <= result.p99_ns);
+    CHECK(result.min_ns <= result.mean_ns);
+    CHECK(result.mean_ns <= result.p99_ns);
+    CHECK(result.stddev_ns >= 0);
+    CHECK(result.min_cycles == 0);
+}
+
+TEST_CASE("benchmark_run: adaptive iterations")
+{
+    auto options = fast_options();
+
+    auto fast = benchmark_run("fast", [] {
+        benchmark_clobber_memory();
+    }, options);
+
+    auto slow = benchmark_run("slow", [] {
+        auto s = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - s < std::chrono::microseconds(20)) {
+            benchmark_clobber_memory();
+        }
+    }, options);
+
+    CHECK(fast.iterations > slow.iterations);
+    CHECK(slow.iterations == 1);
+    CHECK(slow.min_ns >= 20000);
+}
+
+TEST_CASE("benchmark_run: max iterations")
+{
+    auto options = fast_options();
+    options.max_iterations = 4;
+    options.min_sample_ns = 1000000000;
+
+    auto result = benchmark_run("max", [] {
+        benchmark_clobber_memory();
+    }, options);
+
+    CHECK(result.iterations == 4);
+}
+
+#if defined(__x86_64__)
+TEST_CASE("benchmark_run: cycles")
+{
+    auto options = fast_options();
+    options.cycles = true;
+
+    auto result = benchmark_run("cycles", [] {
+        benchmark_clobber_memory();
+    }, options);
+
+    CHECK(result.min_cycles > 0);
+    CHECK(result.min_cycles <= result.median_cycles);
+    CHECK(benchmark_rdtsc_end() > benchmark_rdtsc_start());
+}
+#endif
+
+TEST_CASE("benchmark_to_json")
+{
+    benchmark_result result;
+
+    result.name = "test";
+    result.iterations = 2;
+    result.samples = 3;
+    result.min_ns = 4;
+    result.median_ns = 5;
+    result.p99_ns = 6;
+    result.mean_ns = 7;
+    result.stddev_ns = 8;
+
+    auto obj = benchmark_to_json(result);
+
+    CHECK(obj.at("name") == "test");
+    CHECK(obj.at("iterations") == 2);
+    CHECK(obj.at("samples") == 3);
+    CHECK(obj.at("min_ns") == 4.0);
+    CHECK(obj.at("median_ns") == 5.0);
+    CHECK(obj.at("p99_ns") == 6.0);
+    CHECK(obj.at("mean_ns") == 7.0);
+    CHECK(obj.at("stddev_ns") == 8.0);
+    CHECK(obj.count("min_cycles") == 0);
+
+    result.min_cycles = 9;
+    result.median_cycles = 10;
+
+    obj = benchmark_to_json(result);
+    CHECK(obj.at("min_cycles") == 9.0);
+    CHECK(obj.at("median_cycles") == 10.0);
+}
+
+TEST_CASE("benchmark_dump_json")
+{
+    benchmark_run("dump", [] { }, fast_options());
+
+    CHECK(benchmark_dump_json("benchmark_dump.json") == EXIT_SUCCESS);
+    CHECK(benchmark_dump_json("/this/path/does/not/exist.json") == EXIT_FAILURE);
+
+    std::ifstream file("benchmark_dump.json");
+    auto results = json::parse(file);
+
+    REQUIRE(results.is_array());
+    CHECK(results.back().at("name") == "dump");
+    CHECK(std::remove("benchmark_dump.json") == 0);
+}
+
+TEST_CASE("memory_stats: allocs and frees")
+{
+    auto stats = measure_allocations([] {
+        auto ptr1 = new uint64_t(1);
+        auto ptr2 = new char[0x1000];
+
+        benchmark_do_not_optimize(ptr1);
+        benchmark_do_not_optimize(ptr2);
+
+        delete ptr1;
+        delete[] ptr2;
+    });
+
+    CHECK(stats.allocs == 2);
+    CHECK(stats.frees == 2);
+    CHECK(stats.page_bytes == 0x1000);
+    CHECK(stats.nonpage_bytes == sizeof(uint64_t));
+    CHECK(stats.live_bytes == 0);
+    CHECK(stats.peak_bytes == 0x1000 + sizeof(uint64_t));
+}
+
+TEST_CASE("memory_stats: live and peak")
+{
+    memory_stats_scope scope;
+
+    auto ptr1 = std::make_unique<char[]>(100);
+    auto ptr2 = std::make_unique<char[]>(200);
+
+    CHECK(scope.stats().live_bytes == 300);
+    CHECK(scope.stats().peak_bytes == 300);
+
+    ptr1.reset();
+    CHECK(scope.stats().live_bytes == 200);
+    CHECK(scope.stats().peak_bytes == 300);
+
+    ptr2.reset();
+    CHECK(scope.stats().live_bytes == 0);
+    CHECK(scope.stats().peak_bytes == 300);
+}
+
+TEST_CASE("memory_stats: histogram")
+{
+    auto stats = measure_allocations([] {
+        for (auto size : {0, 1, 2, 3, 4, 5, 8, 9, 0x1000, 0x1001}) {
+            auto ptr = new char[static_cast<std::size_t>(size)];
+            benchmark_do_not_optimize(ptr);
+            delete[] ptr;
+        }
+    });
+
+    CHECK(stats.histogram.at(0) == 2);
+    CHECK(stats.histogram.at(1) == 1);
+    CHECK(stats.histogram.at(2) == 2);
+    CHECK(stats.histogram.at(3) == 2);
+    CHECK(stats.histogram.at(4) == 1);
+    CHECK(stats.histogram.at(12) == 1);
+    CHECK(stats.histogram.at(13) == 1);
+    CHECK(stats.allocs == 10);
+}
+
+TEST_CASE("print_memory_stats: histogram titles")
+{
+    memory_stats stats;
+
+    stats.histogram.at(2) = 2;
+    stats.histogram.at(12) = 1;
+    stats.histogram.at(memory_stats_classes - 1) = 3;
+
+    std::ostringstream out;
+    auto old = std::cout.rdbuf(out.rdbuf());
+    print_memory_stats(stats);
+    std::cout.rdbuf(old);
+
+    auto lines = bfn::split(out.str(), '\n');
+    auto find = [&](const std::string & title) {
+        for (const auto &line : lines) {
+            if (line.find(title) != std::string::npos) {
+                return line;
+            }
+        }
+
+        return std::string{};
+    };
+
+    CHECK(find("allocations <= 4 bytes").back() == '2');
+    CHECK(find("allocations <= 4096 bytes").back() == '1');
+    CHECK(find("allocations > 1073741824 bytes").back() == '3');
+    CHECK(find("allocations <= 8 bytes").empty());
+}
+
+TEST_CASE("memory_stats: failed allocations")
+{
+    auto stats = measure_allocations([] {
+        for (auto size : {SIZE_MAX, SIZE_MAX - 1, SIZE_MAX / 2}) {
+            CHECK_THROWS_AS(::operator new(size), std::bad_alloc);
+            CHECK(::operator new(size, std::nothrow) == nullptr);
+        }
+    });
+
+    CHECK(stats.allocs == 0);
+    CHECK(stats.live_bytes == 0);
+    CHECK(stats.peak_bytes == 0);
+    CHECK(stats.nonpage_bytes == 0);
+    CHECK(stats.histogram.at(memory_stats_classes - 1) == 0);
+}
+
+TEST_CASE("memory_stats: exactly N allocations")
+{
+    CHECK(measure_allocations([] { }).allocs == 0);
+
+    CHECK(measure_allocations([] {
+        std::vector<uint64_t> list;
+        list.reserve(16);
+
+        for (uint64_t i = 0; i < 16; i++) {
+            list.push_back(i);
+        }
+    }).allocs == 1);
+}
+
+TEST_CASE("memory_stats: clear")
+{
+    auto ptr = std::make_unique<char[]>(100);
+
+    clear_memory_stats();
+    auto stats = get_memory_stats();
+
+    CHECK(stats.allocs == 0);
+    CHECK(stats.frees == 0);
+    CHECK(stats.page_bytes + stats.nonpage_bytes == 0);
+    CHECK(stats.live_bytes >= 100);
+    CHECK(stats.peak_bytes == stats.live_bytes);
+}
+
+TEST_CASE("memory_stats: thread safe")
+{
+    constexpr const auto num_threads = 8ULL;
+    constexpr const auto num_allocs = 10000ULL;
+
+    auto stats = measure_allocations([] {
+        std::vector<std::thread> threads;
+        threads.reserve(num_threads);
+
+        for (auto t = 0ULL; t < num_threads; t++) {
+            threads.emplace_back([] {
+                for (auto i = 0ULL; i < num_allocs; i++) {
+                    auto ptr = new uint64_t(i);
+                    benchmark_do_not_optimize(ptr);
+                    delete ptr;
+                }
+            });
+        }
+
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    });
+
+    CHECK(stats.allocs >= num_threads * num_allocs);
+    CHECK(stats.allocs == stats.frees);
+    CHECK(stats.live_bytes == 0);
+}
+
+TEST_CASE("memory_callsites: disabled by default")
+{
+    clear_memory_callsites();
+
+    auto ptr = new uint64_t(1);
+    benchmark_do_not_optimize(ptr);
+    delete ptr;
+
+    CHECK(get_memory_callsites().empty());
+}
+
+TEST_CASE("memory_callsites: grouped by call site")
+{
+    clear_memory_callsites();
+    enable_memory_callsites();
+
+    for (auto i = 0; i < 100; i++) {
+        auto ptr = new char[24];
+        benchmark_do_not_optimize(ptr);
+        delete[] ptr;
+    }
+
+    for (auto i = 0; i < 50; i++) {
+        auto ptr = new char[0x1000];
+        benchmark_do_not_optimize(ptr);
+        delete[] ptr;
+    }
+
+    enable_memory_callsites(false);
+    auto sites = get_memory_callsites();
+
+    auto find = [&](std::size_t allocs, std::size_t bytes) {
+        return std::count_if(sites.begin(), sites.end(), [&](const auto & site) {
+            return site.allocs == allocs && site.bytes == bytes;
+        });
+    };
+
+    CHECK(find(100, 100 * 24) == 1);
+    CHECK(find(50, 50 * 0x1000) == 1);
+
+    REQUIRE(sites.size() >= 2);
+    CHECK(sites.at(0).bytes >= sites.at(1).bytes);
+    CHECK(sites.at(0).depth >= 1);
+    CHECK(sites.at(0).frames.at(0) != nullptr);
+
+    CHECK(memory_callsites_dropped() == 0);
+    CHECK_NOTHROW(print_memory_callsites(2));
+}
+
+TEST_CASE("memory_callsites: clear")
+{
+    enable_memory_callsites();
+
+    auto ptr = new uint64_t(1);
+    benchmark_do_not_optimize(ptr);
+    delete ptr;
+
+    enable_memory_callsites(false);
+    CHECK(!get_memory_callsites().empty());
+
+    clear_memory_callsites();
+    CHECK(get_memory_callsites().empty());
+}
@@ -21,6 +21,12 @@
 
 #include <catch/catch.hpp>
 #include <bfbuffer.h>
+#include <bfbenchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <vector>
 
 TEST_CASE("default constructor")
 {
@@ -170,3 +176,639 @@ TEST_CASE("resize")
     CHECK(buffer.size() == 2);
     CHECK(buffer.span()[0] == 'h');
 }
+
+TEST_CASE("small buffer: no allocations")
+{
+    auto hello = {'h', 'e', 'l', 'l', 'o'};
+
+    auto stats = measure_allocations([&] {
+        bfn::small_buffer buffer1(42);
+        bfn::small_buffer buffer2(bfn::small_buffer_size);
+        bfn::small_buffer buffer3(hello);
+
+        benchmark_do_not_optimize(buffer1.data());
+        benchmark_do_not_optimize(buffer2.data());
+        benchmark_do_not_optimize(buffer3.data());
+
+        CHECK(buffer1.is_inline());
+        CHECK(buffer2.is_inline());
+        CHECK(buffer3.is_inline());
+    });
+
+    CHECK(stats.allocs == 0);
+}
+
+TEST_CASE("small buffer: large buffers allocate")
+{
+    auto stats = measure_allocations([&] {
+        bfn::small_buffer buffer(bfn::small_buffer_size + 1);
+        benchmark_do_not_optimize(buffer.data());
+
+        CHECK(!buffer.is_inline());
+    });
+
+    CHECK(stats.allocs == 1);
+    CHECK(stats.frees == 1);
+}
+
+TEST_CASE("small buffer: buffer always allocates")
+{
+    auto stats = measure_allocations([&] {
+        bfn::buffer buffer(1);
+        benchmark_do_not_optimize(buffer.data());
+
+        CHECK(!buffer.is_inline());
+    });
+
+    CHECK(stats.allocs == 1);
+}
+
+TEST_CASE("small buffer: data")
+{
+    bfn::small_buffer buffer1(42);
+    CHECK(buffer1);
+    CHECK(buffer1.size() == 42);
+    CHECK(buffer1.span().size() == 42);
+    CHECK(buffer1.data() == buffer1.get());
+    CHECK(std::all_of(buffer1.data(), buffer1.data() + 42, [](char c) { return c == 0; }));
+
+    bfn::small_buffer buffer2;
+    CHECK(!buffer2);
+    CHECK(buffer2.data() == nullptr);
+    CHECK(!buffer2.is_inline());
+}
+
+TEST_CASE("small buffer: move")
+{
+    auto hello = {'h', 'e', 'l', 'l', 'o'};
+
+    bfn::small_buffer buffer1(hello);
+    bfn::small_buffer buffer2(std::move(buffer1));
+
+    CHECK(buffer2 == bfn::buffer(hello));
+    CHECK(buffer2.is_inline());
+    CHECK(buffer2.data() != buffer1.data());
+    CHECK(!buffer1);
+
+    bfn::small_buffer buffer3(100);
+    buffer3.span()[0] = 'a';
+
+    auto data = buffer3.data();
+    buffer2 = std::move(buffer3);
+
+    CHECK(buffer2.data() == data);
+    CHECK(buffer2.size() == 100);
+    CHECK(buffer2.span()[0] == 'a');
+}
+
+TEST_CASE("small buffer: swap")
+{
+    auto hello = {'h', 'e', 'l', 'l', 'o'};
+
+    bfn::small_buffer buffer1(hello);
+    bfn::small_buffer buffer2(100);
+
+    bfn::swap(buffer1, buffer2);
+
+    CHECK(buffer1.size() == 100);
+    CHECK(!buffer1.is_inline());
+    CHECK(buffer2 == bfn::buffer(hello));
+    CHECK(buffer2.is_inline());
+
+    buffer1.swap(buffer2);
+
+    CHECK(buffer1 == bfn::buffer(hello));
+    CHECK(buffer2.size() == 100);
+}
+
+TEST_CASE("small buffer: release")
+{
+    bfn::small_buffer buffer1(42);
+    buffer1.release();
+
+    CHECK(!buffer1);
+    CHECK(buffer1.empty());
+
+    bfn::small_buffer buffer2(100);
+    auto data = buffer2.data();
+    buffer2.release();
+
+    CHECK(!buffer2);
+    delete[] data;
+}
+
+TEST_CASE("small buffer: resize")
+{
+    auto hello = {'h', 'e', 'l', 'l', 'o'};
+    bfn::small_buffer buffer(hello);
+
+    auto stats = measure_allocations([&] {
+        buffer.resize(bfn::small_buffer_size);
+    });
+
+    CHECK(stats.allocs == 0);
+    CHECK(buffer.size() == bfn::small_buffer_size);
+    CHECK(buffer.span()[4] == 'o');
+
+    buffer.resize(100);
+
+    CHECK(!buffer.is_inline());
+    CHECK(buffer.size() == 100);
+    CHECK(buffer.span()[4] == 'o');
+
+    buffer.resize(2);
+
+    CHECK(!buffer.is_inline());
+    CHECK(buffer.size() == 2);
+    CHECK(buffer.span()[1] == 'e');
+
+    buffer.shrink_to_fit();
+
+    CHECK(buffer.is_inline());
+    CHECK(buffer.size() == 2);
+    CHECK(buffer.span()[1] == 'e');
+}
+
+TEST_CASE("capacity")
+{
+    bfn::buffer buffer1;
+    CHECK(buffer1.capacity() == 0);
+
+    bfn::buffer buffer2(42);
+    CHECK(buffer2.capacity() == 42);
+
+    bfn::small_buffer buffer3;
+    CHECK(buffer3.capacity() == bfn::small_buffer_size);
+
+    bfn::small_buffer buffer4(100);
+    CHECK(buffer4.capacity() == 100);
+}
+
+TEST_CASE("resize grows geometrically")
+{
+    bfn::buffer buffer(100);
+
+    buffer.resize(101);
+    CHECK(buffer.size() == 101);
+    CHECK(buffer.capacity() == 200);
+
+    auto data = buffer.data();
+
+    auto stats = measure_allocations([&] {
+        buffer.resize(200);
+        buffer.resize(10);
+        buffer.resize(150);
+    });
+
+    CHECK(stats.allocs == 0);
+    CHECK(buffer.data() == data);
+    CHECK(buffer.size() == 150);
+    CHECK(buffer.capacity() == 200);
+
+    buffer.resize(1000);
+    CHECK(buffer.capacity() == 1000);
+}
+
+TEST_CASE("reserve")
+{
+    auto hello = {'h', 'e', 'l', 'l', 'o'};
+
+    bfn::buffer buffer(hello);
+    buffer.reserve(100);
+
+    CHECK(buffer.size() == 5);
+    CHECK(buffer.capacity() == 100);
+    CHECK(buffer == bfn::buffer(hello));
+
+    buffer.reserve(10);
+    CHECK(buffer.capacity() == 100);
+
+    bfn::small_buffer small;
+    small.reserve(10);
+
+    CHECK(small.capacity() == bfn::small_buffer_size);
+    CHECK(small.empty());
+}
+
+TEST_CASE("append")
+{
+    bfn::buffer buffer;
+
+    auto stats = measure_allocations([&] {
+        for (auto i = 0; i < 1000; i++) {
+            auto c = static_cast<char>(i);
+            buffer.append(&c, 1);
+        }
+    });
+
+    CHECK(buffer.size() == 1000);
+    CHECK(stats.allocs <= 11);
+
+    for (auto i = 0; i < 1000; i++) {
+        CHECK(buffer.span()[i] == static_cast<char>(i));
+    }
+
+    CHECK_THROWS(buffer.append(nullptr, 1));
+    CHECK_NOTHROW(buffer.append(nullptr, 0));
+    CHECK(buffer.size() == 1000);
+}
+
+TEST_CASE("append small buffer")
+{
+    bfn::small_buffer buffer;
+
+    auto stats = measure_allocations([&] {
+        buffer.append("hello", 5);
+        buffer.append(" world", 6);
+    });
+
+    CHECK(stats.allocs == 0);
+    CHECK(buffer.is_inline());
+    CHECK(buffer == bfn::buffer({'h', 'e', 'l', 'l', 'o', ' ', 'w', 'o', 'r', 'l', 'd'}));
+
+    std::array<char, bfn::small_buffer_size> data{};
+    buffer.append(data.data(), data.size());
+
+    CHECK(!buffer.is_inline());
+    CHECK(buffer.size() == 11 + bfn::small_buffer_size);
+    CHECK(buffer.span()[10] == 'd');
+}
+
+TEST_CASE("make uninitialised")
+{
+    auto stats = measure_allocations([&] {
+        auto buffer = bfn::buffer::make_uninitialised(42);
+
+        CHECK(buffer.size() == 42);
+        CHECK(buffer.capacity() == 42);
+        CHECK(buffer);
+    });
+
+    CHECK(stats.allocs == 1);
+
+    auto small = bfn::small_buffer::make_uninitialised(42);
+    CHECK(small.size() == 42);
+    CHECK(small.is_inline());
+}
+
+TEST_CASE("shrink to fit")
+{
+    bfn::buffer buffer;
+    buffer.reserve(100);
+    buffer.append("hello", 5);
+
+    buffer.shrink_to_fit();
+    CHECK(buffer.capacity() == 5);
+    CHECK(buffer == bfn::buffer({'h', 'e', 'l', 'l', 'o'}));
+
+    auto stats = measure_allocations([&] {
+        buffer.shrink_to_fit();
+    });
+
+    CHECK(stats.allocs == 0);
+}
+
+TEST_CASE("policy")
+{
+    bfn::buffer buffer1(42);
+    CHECK(buffer1.policy() == bfn::buffer_policy::standard);
+    CHECK(buffer1.capacity() == 42);
+
+    bfn::buffer buffer2(42, bfn::buffer_policy::page);
+    CHECK(buffer2.policy() == bfn::buffer_policy::page);
+    CHECK(buffer2.size() == 42);
+    CHECK(buffer2.capacity() == MAX_PAGE_SIZE);
+    CHECK((reinterpret_cast<uintptr_t>(buffer2.data()) & (MAX_PAGE_SIZE - 1)) == 0);
+    CHECK(std::all_of(buffer2.data(), buffer2.data() + 42, [](char c) { return c == 0; }));
+
+    bfn::buffer buffer3(42, bfn::buffer_policy::huge_page);
+    CHECK(buffer3.policy() == bfn::buffer_policy::huge_page);
+    CHECK(buffer3.capacity() == bfn::huge_page_size);
+    CHECK((reinterpret_cast<uintptr_t>(buffer3.data()) & (bfn::huge_page_size - 1)) == 0);
+}
+
+TEST_CASE("policy is kept when growing")
+{
+    auto buffer = bfn::buffer::make_uninitialised(42, bfn::buffer_policy::page);
+    buffer.span()[0] = 'a';
+
+    buffer.resize(MAX_PAGE_SIZE + 1);
+
+    CHECK(buffer.policy() == bfn::buffer_policy::page);
+    CHECK(buffer.capacity() == MAX_PAGE_SIZE * 2);
+    CHECK(buffer.span()[0] == 'a');
+    CHECK((reinterpret_cast<uintptr_t>(buffer.data()) & (MAX_PAGE_SIZE - 1)) == 0);
+
+    buffer.resize(10);
+    buffer.shrink_to_fit();
+
+    CHECK(buffer.policy() == bfn::buffer_policy::page);
+    CHECK(buffer.capacity() == MAX_PAGE_SIZE);
+    CHECK(buffer.span()[0] == 'a');
+}
+
+TEST_CASE("policy with a small buffer")
+{
+    bfn::small_buffer buffer1(42, bfn::buffer_policy::page);
+    CHECK(!buffer1.is_inline());
+    CHECK((reinterpret_cast<uintptr_t>(buffer1.data()) & (MAX_PAGE_SIZE - 1)) == 0);
+
+    buffer1.resize(10);
+    buffer1.shrink_to_fit();
+    CHECK(!buffer1.is_inline());
+
+    auto buffer2 = bfn::small_buffer::make_uninitialised(0, bfn::buffer_policy::page);
+    CHECK(buffer2.empty());
+    CHECK(!buffer2.is_inline());
+}
+
+TEST_CASE("policy swap and release")
+{
+    bfn::buffer buffer1(42, bfn::buffer_policy::page);
+    bfn::buffer buffer2(42);
+
+    buffer1.swap(buffer2);
+
+    CHECK(buffer1.policy() == bfn::buffer_policy::standard);
+    CHECK(buffer2.policy() == bfn::buffer_policy::page);
+
+    auto data = buffer2.data();
+    buffer2.release();
+
+    CHECK(!buffer2);
+    free(data);
+}
+
+TEST_CASE("pages spanned")
+{
+    auto page = reinterpret_cast<const char *>(MAX_PAGE_SIZE * 16);
+
+    CHECK(bfn::pages_spanned(page, 0) == 0);
+    CHECK(bfn::pages_spanned(page, 1) == 1);
+    CHECK(bfn::pages_spanned(page, MAX_PAGE_SIZE) == 1);
+    CHECK(bfn::pages_spanned(page, MAX_PAGE_SIZE + 1) == 2);
+    CHECK(bfn::pages_spanned(page + MAX_PAGE_SIZE - 1, 2) == 2);
+    CHECK(bfn::pages_spanned(page + 1, MAX_PAGE_SIZE) == 2);
+
+    bfn::buffer buffer1;
+    CHECK(bfn::pages_spanned(buffer1) == 0);
+
+    bfn::buffer buffer2(MAX_PAGE_SIZE * 2, bfn::buffer_policy::page);
+    CHECK(bfn::pages_spanned(buffer2) == 2);
+}
+
+TEST_CASE("shared buffer: constructors")
+{
+    bfn::shared_buffer buffer1;
+    CHECK(!buffer1);
+    CHECK(buffer1.empty());
+    CHECK(buffer1.use_count() == 0);
+
+    bfn::buffer hello({'h', 'e', 'l', 'l', 'o'});
+    auto data = hello.data();
+
+    bfn::shared_buffer buffer2(std::move(hello));
+    CHECK(buffer2);
+    CHECK(buffer2.size() == 5);
+    CHECK(buffer2.data() == data);
+    CHECK(buffer2.use_count() == 1);
+    CHECK(!hello);
+
+    bfn::shared_buffer buffer3("hello", 5);
+    CHECK(buffer3 == buffer2);
+    CHECK(buffer3.data() != buffer2.data());
+
+    CHECK_THROWS(bfn::shared_buffer(nullptr, 1));
+    CHECK(!bfn::shared_buffer(nullptr, 0));
+    CHECK(!bfn::shared_buffer(bfn::buffer()));
+}
+
+TEST_CASE("shared buffer: copies share data")
+{
+    bfn::shared_buffer buffer1("hello", 5);
+
+    auto stats = measure_allocations([&] {
+        auto buffer2 = buffer1;
+        CHECK(buffer2.data() == buffer1.data());
+        CHECK(buffer1.use_count() == 2);
+
+        bfn::shared_buffer buffer3;
+        buffer3 = buffer2;
+        CHECK(buffer1.use_count() == 3);
+
+        auto buffer4 = std::move(buffer3);
+        CHECK(!buffer3);
+        CHECK(buffer1.use_count() == 3);
+    });
+
+    CHECK(stats.allocs == 0);
+    CHECK(stats.frees == 0);
+    CHECK(buffer1.use_count() == 1);
+}
+
+TEST_CASE("shared buffer: slice")
+{
+    bfn::shared_buffer buffer("hello world", 11);
+    bfn::shared_buffer world("world", 5);
+    bfn::shared_buffer orl("orl", 3);
+
+    auto stats = measure_allocations([&] {
+        auto slice1 = buffer.slice(6, 5);
+
+        CHECK(slice1 == world);
+        CHECK(slice1.data() == buffer.data() + 6);
+        CHECK(buffer.use_count() == 2);
+
+        auto slice2 = slice1.slice(1, 3);
+        CHECK(slice2 == orl);
+        CHECK(slice2.data() == buffer.data() + 7);
+
+        CHECK(buffer.slice(11).empty());
+        CHECK(buffer.slice(0) == buffer);
+        CHECK(buffer.slice(4, 0).empty());
+    });
+
+    CHECK(stats.allocs == 0);
+    CHECK(buffer.use_count() == 1);
+
+    CHECK_THROWS(buffer.slice(12));
+    CHECK_THROWS(buffer.slice(12, 0));
+    CHECK_THROWS(buffer.slice(6, 6));
+    CHECK_THROWS(buffer.slice(1, 0xFFFFFFFFFFFFFFFF));
+}
+
+TEST_CASE("shared buffer: slices keep the data alive")
+{
+    bfn::shared_buffer slice;
+
+    auto stats = measure_allocations([&] {
+        bfn::shared_buffer buffer("hello world", 11);
+        slice = buffer.slice(0, 5);
+    });
+
+    CHECK(stats.live_bytes != 0);
+    CHECK(slice == bfn::shared_buffer("hello", 5));
+    CHECK(slice.use_count() == 1);
+
+    stats = measure_allocations([&] {
+        slice.reset();
+    });
+
+    CHECK(stats.frees == 1);
+    CHECK(!slice);
+}
+
+TEST_CASE("shared buffer: reference count is stored with the data")
+{
+    auto stats = measure_allocations([] {
+        bfn::shared_buffer buffer("hello", 5);
+        CHECK(buffer == bfn::shared_buffer("hello", 5));
+    });
+
+    CHECK(stats.allocs == 2);
+    CHECK(stats.live_bytes == 0);
+
+    bfn::buffer spare({'h', 'e', 'l', 'l', 'o'});
+    spare.reserve(spare.size() + bfn::shared_buffer_header_size);
+
+    stats = measure_allocations([&] {
+        bfn::shared_buffer buffer(std::move(spare));
+
+        CHECK(buffer.size() == 5);
+        CHECK(buffer.slice(1, 3) == bfn::shared_buffer("ell", 3));
+    });
+
+    CHECK(stats.allocs == 1);
+    CHECK(stats.frees == 2);
+
+    bfn::buffer full({'h', 'e', 'l', 'l', 'o'});
+    full.shrink_to_fit();
+
+    stats = measure_allocations([&] {
+        bfn::shared_buffer buffer(std::move(full));
+        CHECK(buffer.size() == 5);
+    });
+
+    CHECK(stats.allocs == 1);
+    CHECK(stats.frees == 2);
+}
+
+TEST_CASE("shared buffer: span")
+{
+    bfn::shared_buffer buffer("hello", 5);
+    gsl::span<const char> span = buffer.slice(1, 3);
+
+    CHECK(span.size() == 3);
+    CHECK(span[0] == 'e');
+    CHECK(span.data() == buffer.data() + 1);
+
+    CHECK(buffer.span().size() == 5);
+    CHECK(bfn::shared_buffer().span().empty());
+}
+
+TEST_CASE("shared buffer: swap")
+{
+    bfn::shared_buffer buffer1("hello", 5);
+    bfn::shared_buffer buffer2;
+
+    bfn::swap(buffer1, buffer2);
+
+    CHECK(!buffer1);
+    CHECK(buffer2.size() == 5);
+    CHECK(buffer1 != buffer2);
+}
+
+TEST_CASE("shared buffer: thread safe")
+{
+    bfn::shared_buffer buffer("hello", 5);
+    std::vector<std::thread> threads;
+
+    for (auto t = 0; t < 8; t++) {
+        threads.emplace_back([buffer] {
+            for (auto i = 0; i < 0x10000; i++) {
+                auto slice = buffer.slice(static_cast<std::size_t>(i % 5));
+                benchmark_do_not_optimize(slice);
+            }
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    CHECK(buffer.use_count() == 1);
+}
+
+TEST_CASE("buffer chain: append")
+{
+    std::string header{"header"};
+    bfn::buffer_chain chain;
+
+    CHECK(chain.empty());
+    CHECK(chain.segments().empty());
+
+    chain.append(gsl::span<const char>(header.data(), static_cast<std::ptrdiff_t>(header.size())));
+    chain.append(bfn::shared_buffer("shared", 6));
+    chain.append(bfn::buffer{'o', 'w', 'n', 'e', 'd'});
+    chain.append(gsl::span<const char>());
+
+    CHECK(!chain.empty());
+    CHECK(chain.size() == 17);
+    CHECK(chain.segments().size() == 3);
+    CHECK(chain.segments().front().data() == header.data());
+
+    chain.clear();
+
+    CHECK(chain.empty());
+    CHECK(chain.segments().empty());
+}
+
+TEST_CASE("buffer chain: append does not copy")
+{
+    bfn::buffer payload(0x10000);
+    auto data = payload.data();
+
+    bfn::buffer_chain chain;
+    chain.append(std::move(payload));
+
+    CHECK(chain.segments().front().data() == data);
+}
+
+TEST_CASE("buffer chain: segments are kept alive")
+{
+    bfn::buffer_chain chain;
+
+    {
+        bfn::shared_buffer buffer("hello", 5);
+        chain.append(buffer.slice(1, 3));
+    }
+
+    auto flat = chain.flatten();
+    CHECK(std::string(flat.data(), flat.size()) == "ell");
+}
+
+TEST_CASE("buffer chain: flatten")
+{
+    std::string header{"header"};
+    bfn::buffer_chain chain;
+
+    CHECK(!chain.flatten());
+
+    chain.append(gsl::span<const char>(header.data(), static_cast<std::ptrdiff_t>(header.size())));
+    chain.append(bfn::shared_buffer("payload", 7));
+
+    auto flat1 = chain.flatten();
+    CHECK(std::string(flat1.data(), flat1.size()) == "headerpayload");
+    CHECK(bfn::pages_spanned(flat1.data(), flat1.size()) == 1);
+    CHECK((reinterpret_cast<uintptr_t>(flat1.data()) & (MAX_PAGE_SIZE - 1)) == 0);
+
+    CHECK(chain.size() == 13);
+    CHECK(chain.segments().size() == 1);
+
+    auto stats = measure_allocations([&] {
+        auto flat2 = chain.flatten();
+        CHECK(flat2.data() == flat1.data());
+    });
+
+    CHECK(stats.allocs == 0);
+}
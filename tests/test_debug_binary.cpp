@@ -0,0 +1,362 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#define DEBUG_BINARY_LOG
+
+#include <catch/catch.hpp>
+#include <bfbenchmark.h>
+#include <bfdebugbinary.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+std::string
+expected_nhex(cstr_t color, cstr_t type, cstr_t indent, cstr_t title, uint64_t val)
+{
+    std::string msg;
+    __bfdebug_nhex_core(color, type, indent, title, val, &msg);
+
+    return msg;
+}
+
+std::string
+expected_ndec(cstr_t color, cstr_t type, cstr_t indent, cstr_t title, uint64_t val)
+{
+    std::string msg;
+    __bfdebug_ndec_core(color, type, indent, title, val, &msg);
+
+    return msg;
+}
+
+// Decodes the records written since start using a copy of the debug ring,
+// the same way a host tool decodes a debug ring returned by IOCTL_DUMP_VMM.
+// The records before start are also decoded (but not returned) so that the
+// decoder sees the format records of call sites that ran in earlier tests.
+
+struct decoded {
+    std::string text;
+    uint64_t formats{0};
+    uint64_t values{0};
+};
+
+decoded
+decode_since(uint64_t start)
+{
+    auto copy = std::make_unique<debug_ring_resources_t>(*bfdebug_binary_drr());
+
+    decoded result;
+    std::string ignored;
+    uint64_t cursor = 0;
+    debug_ring_record_t rec{};
+    bfdebug_binary_decoder decoder;
+    std::vector<char> data(DEBUG_RING_SIZE);
+
+    while (true) {
+        auto pos = cursor;
+
+        if (debug_ring_read_record(copy.get(), &cursor, &rec, data.data(), data.size(), nullptr) == 0) {
+            break;
+        }
+
+        if (pos < start) {
+            decoder.decode(rec, data.data(), &ignored);
+            continue;
+        }
+
+        result.formats += rec.type == DEBUG_RING_RECORD_FORMAT ? 1 : 0;
+        result.values += rec.type == DEBUG_RING_RECORD_VALUE ? 1 : 0;
+
+        decoder.decode(rec, data.data(), &result.text);
+    }
+
+    return result;
+}
+
+uint64_t
+epos()
+{ return bfdebug_binary_drr()->epos; }
+
+TEST_CASE("binary log: debug ring")
+{
+    auto drr = bfdebug_binary_drr();
+
+    REQUIRE(drr != nullptr);
+    CHECK(drr == bfdebug_binary_drr());
+    CHECK(debug_ring_has_records(drr) == 1);
+}
+
+TEST_CASE("binary log: decode")
+{
+    int i = 0;
+    auto start = epos();
+
+    bfdebug_nhex(0, "test", 42);
+    bfalert_subnhex(0, "test", &i);
+    bferror_ndec(0, "test", 42);
+    bfdebug_subndec(0, "test", 0xFFFFFFFFFFFFFFFF);
+
+    auto result = decode_since(start);
+
+    CHECK(result.formats == 4);
+    CHECK(result.values == 4);
+    CHECK(result.text ==
+          expected_nhex(bfcolor_debug, "DEBUG", nullptr, "test", 42) +
+          expected_nhex(bfcolor_alert, "ALERT", "  - ", "test", reinterpret_cast<uint64_t>(&i)) +
+          expected_ndec(bfcolor_error, "ERROR", nullptr, "test", 42) +
+          expected_ndec(bfcolor_debug, "DEBUG", "  - ", "test", 0xFFFFFFFFFFFFFFFF));
+}
+
+TEST_CASE("binary log: severity")
+{
+    auto start = epos();
+    bferror_nhex(0, "test", 42);
+
+    uint64_t cursor = start;
+    debug_ring_record_t rec{};
+
+    REQUIRE(debug_ring_read_record(bfdebug_binary_drr(), &cursor, &rec, nullptr, 0, nullptr) == 1);
+    CHECK(rec.type == DEBUG_RING_RECORD_FORMAT);
+    CHECK(rec.severity == DEBUG_RING_SEVERITY_ERROR);
+
+    REQUIRE(debug_ring_read_record(bfdebug_binary_drr(), &cursor, &rec, nullptr, 0, nullptr) == 1);
+    CHECK(rec.type == DEBUG_RING_RECORD_VALUE);
+    CHECK(rec.severity == DEBUG_RING_SEVERITY_ERROR);
+    CHECK(rec.len == sizeof(uint64_t));
+}
+
+TEST_CASE("binary log: one format per call site")
+{
+    auto start = epos();
+
+    for (uint64_t i = 0; i < 10; i++) {
+        bfdebug_ndec(0, "loop", i);
+    }
+
+    auto result = decode_since(start);
+
+    CHECK(result.formats == 1);
+    CHECK(result.values == 10);
+    CHECK(result.text.find("loop") != std::string::npos);
+}
+
+TEST_CASE("binary log: one format per debug ring")
+{
+    static __bfdebug_binary_site_t site(bfcolor_debug, "DEBUG", nullptr, "ring", DEBUG_RING_FORMAT_NDEC);
+
+    auto drr0 = std::make_unique<debug_ring_resources_t>();
+    auto drr1 = std::make_unique<debug_ring_resources_t>();
+    debug_ring_resources_t *drrs[] = {drr0.get(), drr1.get()};
+
+    debug_ring_init_records(drr0.get());
+    debug_ring_init_records(drr1.get());
+
+    for (uint64_t i = 0; i < 10; i++) {
+        __bfdebug_binary_log(&site, drrs[i % 2], i % 2, i);
+    }
+
+    for (uint64_t cpuid = 0; cpuid < 2; cpuid++) {
+        std::string msg;
+        std::string expected;
+        uint64_t cursor = 0;
+        uint64_t formats = 0;
+        debug_ring_record_t rec{};
+        bfdebug_binary_decoder decoder;
+        std::vector<char> data(DEBUG_RING_SIZE);
+
+        while (debug_ring_read_record(drrs[cpuid], &cursor, &rec, data.data(), data.size(), nullptr) == 1) {
+            formats += rec.type == DEBUG_RING_RECORD_FORMAT ? 1 : 0;
+            decoder.decode(rec, data.data(), &msg);
+        }
+
+        for (uint64_t i = cpuid; i < 10; i += 2) {
+            __bfdebug_ndec_core(cpuid, bfcolor_debug, "DEBUG", nullptr, "ring", i, &expected);
+        }
+
+        CHECK(formats == 1);
+        CHECK(msg == expected);
+    }
+}
+
+TEST_CASE("binary log: long titles")
+{
+    auto start = epos();
+
+    bfdebug_ndec(0, "a title that is longer than the 63 characters format records kept", 42);
+    auto expected = expected_ndec(bfcolor_debug, "DEBUG", nullptr, "a title that is longer than the 63 characters format records kept", 42);
+
+    CHECK(decode_since(start).text == expected);
+}
+
+TEST_CASE("binary log: value records are 32 bytes")
+{
+    auto func = [](uint64_t val) {
+        bfdebug_nhex(0, "size", val);
+    };
+
+    func(0);
+
+    auto start = epos();
+    func(1);
+
+    CHECK(epos() - start == 32);
+}
+
+TEST_CASE("binary log: format is written again once discarded")
+{
+    auto func = [](uint64_t val) {
+        bfdebug_ndec(0, "rare", val);
+    };
+
+    func(1);
+
+    for (uint64_t i = 0; i < DEBUG_RING_SIZE / 32 + 10; i++) {
+        bfdebug_ndec(0, "flood", i);
+    }
+
+    auto start = epos();
+    func(2);
+
+    auto result = decode_since(start);
+
+    CHECK(result.formats == 1);
+    CHECK(result.text == expected_ndec(bfcolor_debug, "DEBUG", nullptr, "rare", 2));
+    CHECK(bfdebug_binary_dump().find("unknown format") == std::string::npos);
+}
+
+TEST_CASE("binary log: no allocations")
+{
+    auto func = [](uint64_t val) {
+        bfdebug_nhex(0, "test", val);
+        bfdebug_ndec(0, "test", val);
+    };
+
+    func(0);
+
+    auto stats = measure_allocations([&] {
+        for (uint64_t i = 0; i < 100; i++) {
+            func(i);
+        }
+    });
+
+    CHECK(stats.allocs == 0);
+}
+
+TEST_CASE("binary log: transactions are text")
+{
+    auto start = epos();
+
+    bfdebug_transaction(0, [&](std::string * msg) {
+        bfdebug_nhex(0, "test", 42, msg);
+        bfdebug_ndec(0, "test", 42, msg);
+    });
+
+    auto result = decode_since(start);
+
+    CHECK(result.values == 0);
+    CHECK(result.text ==
+          expected_nhex(bfcolor_debug, "DEBUG", nullptr, "test", 42) +
+          expected_ndec(bfcolor_debug, "DEBUG", nullptr, "test", 42));
+}
+
+TEST_CASE("binary log: dump")
+{
+    for (uint64_t i = 0; i < DEBUG_RING_SIZE / 32 + 10; i++) {
+        bfdebug_ndec(0, "dump", i);
+    }
+
+    auto dump = bfdebug_binary_dump();
+    auto line = expected_ndec(bfcolor_debug, "DEBUG", nullptr, "dump", 0);
+    auto last = expected_ndec(bfcolor_debug, "DEBUG", nullptr, "dump", DEBUG_RING_SIZE / 32 + 9);
+
+    CHECK(dump.find("unknown format") == std::string::npos);
+    CHECK(dump.size() >= line.size() * (DEBUG_RING_SIZE / 32 - 2));
+    CHECK(dump.compare(dump.size() - last.size(), last.size(), last) == 0);
+}
+
+TEST_CASE("binary log: unknown format")
+{
+    debug_ring_record_t rec{};
+    uint64_t val = 42;
+
+    rec.type = DEBUG_RING_RECORD_VALUE;
+    rec.id = 0xFFFFFFFF;
+    rec.len = sizeof(val);
+
+    std::string msg;
+    bfdebug_binary_decoder decoder;
+    decoder.decode(rec, reinterpret_cast<const char *>(&val), &msg);
+
+    CHECK(msg == expected_nhex(bfcolor_error, "ERROR", nullptr, "unknown format", 42));
+}
+
+TEST_CASE("binary log: multiple threads")
+{
+    constexpr const auto num_threads = 8ULL;
+    constexpr const auto num_msgs = 100ULL;
+
+    auto start = epos();
+    std::vector<std::thread> threads;
+
+    for (auto tid = 0ULL; tid < num_threads; tid++) {
+        threads.emplace_back([] {
+            for (auto i = 0ULL; i < num_msgs; i++) {
+                bfdebug_nhex(0, "thread", i);
+            }
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    auto result = decode_since(start);
+    auto line = expected_nhex(bfcolor_debug, "DEBUG", nullptr, "thread", 0);
+
+    CHECK(result.values == num_threads * num_msgs);
+    CHECK(result.text.size() == line.size() * num_threads * num_msgs);
+    CHECK(result.text.find("unknown format") == std::string::npos);
+}
+
+TEST_CASE("binary log: other macros")
+{
+    auto start = epos();
+
+    bfdebug_lnbr(0);
+    bfdebug_info(0, "test");
+    bfdebug_bool(0, "test", true);
+    bfdebug_text(0, "test", "value");
+    bffield(42);
+    bffield_hex(42);
+
+    std::string expected;
+    __bfdebug_lnbr_core(bfcolor_debug, "DEBUG", &expected);
+    __bfdebug_info_core(bfcolor_debug, "DEBUG", "test", &expected);
+    __bfdebug_bool_core(bfcolor_debug, "DEBUG", nullptr, "test", true, &expected);
+    __bfdebug_text_core(bfcolor_debug, "DEBUG", nullptr, "test", "value", &expected);
+    expected += expected_ndec(bfcolor_debug, "DEBUG", nullptr, "42", 42);
+    expected += expected_nhex(bfcolor_debug, "DEBUG", nullptr, "42", 42);
+
+    auto result = decode_since(start);
+
+    CHECK(result.values == 2);
+    CHECK(result.text == expected);
+}
@@ -0,0 +1,111 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#define DEBUG_PERCPU_BUFFERS
+
+#include <catch/catch.hpp>
+#include <bfbenchmark.h>
+#include <bfdebug.h>
+
+#include <stdexcept>
+
+auto
+allocated()
+{ return g_page_allocs + g_nonpage_allocs; }
+
+void
+log_all_types(uint64_t val)
+{
+    bfdebug_lnbr(0);
+    bfdebug_brk1(0);
+    bfdebug_nhex(0, "test", val);
+    bfdebug_subnhex(0, "test", val);
+    bfdebug_ndec(0, "test", val);
+    bfdebug_subndec(0, "test", val);
+    bfdebug_bool(0, "test", val != 0);
+    bfdebug_text(0, "test", "a value that does not fit in a small string");
+    bfdebug_info(0, "a title that does not fit in a small string");
+    bfdebug_pass(0, "test");
+    bffield(val);
+}
+
+TEST_CASE("per-cpu buffers: no allocations per line")
+{
+    log_all_types(0);
+
+    clear_memory_stats();
+    for (uint64_t i = 0; i < 100; i++) {
+        log_all_types(i);
+    }
+
+    CHECK(allocated() == 0);
+}
+
+TEST_CASE("per-cpu buffers: no allocations per transaction")
+{
+    auto func = [](std::string * msg) {
+        for (uint64_t i = 0; i < 100; i++) {
+            bfdebug_nhex(0, "test", i, msg);
+            bfdebug_ndec(0, "test", i, msg);
+            bfdebug_text(0, "test", "a value that does not fit in a small string", msg);
+        }
+    };
+
+    bfdebug_transaction(0, func);
+
+    clear_memory_stats();
+    bfdebug_transaction(0, func);
+
+    CHECK(allocated() == 0);
+}
+
+TEST_CASE("per-cpu buffers: nested transaction")
+{
+    bfdebug_transaction(0, [&](std::string * msg) {
+        bfdebug_info(0, "outer", msg);
+        bfdebug_info(0, "nested");
+        bfdebug_info(0, "outer", msg);
+    });
+
+    log_all_types(0);
+
+    clear_memory_stats();
+    log_all_types(0);
+
+    CHECK(allocated() == 0);
+}
+
+TEST_CASE("per-cpu buffers: exception in transaction")
+{
+    auto func = [](std::string * msg) {
+        bfdebug_info(0, "throw", msg);
+        throw std::runtime_error("error");
+    };
+
+    CHECK_THROWS(__bfdebug_transaction(func));
+
+    log_all_types(0);
+
+    clear_memory_stats();
+    log_all_types(0);
+
+    CHECK(allocated() == 0);
+}
@@ -0,0 +1,1282 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <catch/catch.hpp>
+#include <bfdebugringinterface.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <bfstring.h>
+
+// The original, byte at a time implementation of debug_ring_read, which
+// debug_ring_read must remain equivalent to.
+
+uint64_t
+debug_ring_read_reference(struct debug_ring_resources_t *drr, char *str, uint64_t len)
+{
+    uint64_t i;
+    uint64_t spos;
+    uint64_t content;
+
+    if (drr == 0 || str == 0 || len == 0)
+    { return 0; }
+
+    spos = drr->spos % DEBUG_RING_SIZE;
+    content = drr->epos - drr->spos;
+
+    for (i = 0; i < content && i < len - 1; i++) {
+        if (spos == DEBUG_RING_SIZE)
+        { spos = 0; }
+
+        if (drr->buf[spos] != '\0')
+        { str[i] = drr->buf[spos]; }
+        else {
+            i--;
+            content--;
+        }
+
+        spos++;
+    }
+
+    str[i] = '\0';
+
+    return content;
+}
+
+auto
+make_drr()
+{
+    auto drr = std::make_unique<debug_ring_resources_t>();
+    debug_ring_init(drr.get());
+
+    return drr;
+}
+
+void
+check_equivalent(debug_ring_resources_t *drr, uint64_t len)
+{
+    std::vector<char> str1(len + 1, 'X');
+    std::vector<char> str2(len + 1, 'X');
+
+    auto ret1 = debug_ring_read_reference(drr, str1.data(), len);
+    auto ret2 = debug_ring_read(drr, str2.data(), len);
+
+    CHECK(ret1 == ret2);
+    CHECK(str1 == str2);
+}
+
+TEST_CASE("debug_ring: layout")
+{
+    CHECK(offsetof(debug_ring_resources_t, epos) == 0);
+    CHECK(offsetof(debug_ring_resources_t, spos) == 8);
+    CHECK(offsetof(debug_ring_resources_t, tag1) == 16);
+    CHECK(offsetof(debug_ring_resources_t, buf) == 24);
+    CHECK(offsetof(debug_ring_resources_t, tag2) == 24 + DEBUG_RING_SIZE);
+    CHECK(offsetof(debug_ring_resources_t, rpos) == 32 + DEBUG_RING_SIZE);
+
+    CHECK(offsetof(debug_ring_var_t, tag1) == 16);
+}
+
+TEST_CASE("debug_ring_read: invalid args")
+{
+    auto drr = make_drr();
+    char str[10];
+
+    CHECK(debug_ring_read(nullptr, str, 10) == 0);
+    CHECK(debug_ring_read(drr.get(), nullptr, 10) == 0);
+    CHECK(debug_ring_read(drr.get(), str, 0) == 0);
+}
+
+TEST_CASE("debug_ring_read: empty")
+{
+    auto drr = make_drr();
+    char str[10] = "blah";
+
+    CHECK(debug_ring_read(drr.get(), str, 10) == 0);
+    CHECK(str[0] == '\0');
+}
+
+TEST_CASE("debug_ring_read: wrapped")
+{
+    auto drr = make_drr();
+    std::vector<char> str(DEBUG_RING_SIZE + 1);
+
+    drr->spos = DEBUG_RING_SIZE - 2;
+    drr->epos = DEBUG_RING_SIZE + 3;
+
+    drr->buf[DEBUG_RING_SIZE - 2] = 'h';
+    drr->buf[DEBUG_RING_SIZE - 1] = 'e';
+    drr->buf[0] = 'l';
+    drr->buf[1] = 'l';
+    drr->buf[2] = 'o';
+
+    CHECK(debug_ring_read(drr.get(), str.data(), str.size()) == 5);
+    CHECK(std::string(str.data()) == "hello");
+}
+
+TEST_CASE("debug_ring_read: skips nulls")
+{
+    auto drr = make_drr();
+    std::vector<char> str(DEBUG_RING_SIZE + 1);
+
+    drr->spos = 0;
+    drr->epos = 7;
+
+    drr->buf[0] = 'h';
+    drr->buf[1] = 'e';
+    drr->buf[3] = 'l';
+    drr->buf[4] = 'l';
+    drr->buf[6] = 'o';
+
+    CHECK(debug_ring_read(drr.get(), str.data(), str.size()) == 5);
+    CHECK(std::string(str.data()) == "hello");
+}
+
+TEST_CASE("debug_ring_read: randomised equivalence")
+{
+    std::mt19937_64 gen(42);
+    auto drr = make_drr();
+
+    for (auto iteration = 0; iteration < 500; iteration++) {
+        auto nul_chance = gen() % 4;
+
+        for (auto &c : drr->buf) {
+            c = (nul_chance != 0 && gen() % (nul_chance * 16) == 0) ? '\0' : static_cast<char>('a' + gen() % 26);
+        }
+
+        auto spos = gen() % (DEBUG_RING_SIZE * 4ULL);
+        auto content = gen() % (DEBUG_RING_SIZE + 1ULL);
+
+        switch (gen() % 4) {
+            case 0:
+                content = DEBUG_RING_SIZE;
+                break;
+            case 1:
+                content = gen() % 16;
+                break;
+            default:
+                break;
+        }
+
+        drr->spos = spos;
+        drr->epos = spos + content;
+
+        check_equivalent(drr.get(), DEBUG_RING_SIZE + 1ULL);
+        check_equivalent(drr.get(), 1 + gen() % (content + 2));
+        check_equivalent(drr.get(), 1);
+        check_equivalent(drr.get(), 2);
+    }
+}
+
+TEST_CASE("debug_ring_write: invalid args")
+{
+    auto drr = make_drr();
+
+    CHECK(debug_ring_write(nullptr, "hello", 5) == 0);
+    CHECK(debug_ring_write(drr.get(), nullptr, 5) == 0);
+    CHECK(debug_ring_write(drr.get(), "hello", 0) == 0);
+    CHECK(debug_ring_write(drr.get(), "hello", DEBUG_RING_SIZE + 1ULL) == 0);
+    CHECK(drr->epos == 0);
+    CHECK(drr->rpos == 0);
+}
+
+TEST_CASE("debug_ring_write: debug ring that was not set up")
+{
+    // A debug ring allocated using an older version of this header does
+    // not have room for rpos, so it must not be written to
+
+    auto drr = std::make_unique<debug_ring_resources_t>();
+    debug_ring_record_t rec{};
+
+    CHECK(debug_ring_is_writable(nullptr) == 0);
+    CHECK(debug_ring_is_writable(drr.get()) == 0);
+
+    CHECK(debug_ring_write(drr.get(), "hello", 5) == 0);
+    CHECK(debug_ring_write_record(drr.get(), 0, 0, 0, "hello", 5) == 0);
+    CHECK(debug_ring_write_record_hdr(drr.get(), &rec, "hello", 5) == 0);
+    CHECK(drr->rpos == 0);
+    CHECK(drr->epos == 0);
+
+    debug_ring_init(nullptr);
+    debug_ring_init(drr.get());
+    CHECK(debug_ring_is_writable(drr.get()) == 1);
+    CHECK(debug_ring_has_records(drr.get()) == 0);
+    CHECK(debug_ring_write(drr.get(), "hello", 5) == 5);
+
+    auto rdrr = std::make_unique<debug_ring_resources_t>();
+    debug_ring_init_records(rdrr.get());
+    CHECK(debug_ring_is_writable(rdrr.get()) == 1);
+    CHECK(debug_ring_write_record(rdrr.get(), 0, 0, 0, "hello", 5) != 0);
+}
+
+TEST_CASE("debug_ring_write: success")
+{
+    auto drr = make_drr();
+    std::vector<char> str(DEBUG_RING_SIZE + 1);
+
+    CHECK(debug_ring_write(drr.get(), "hello", 5) == 5);
+    CHECK(debug_ring_write(drr.get(), " world", 6) == 6);
+    CHECK(drr->epos == 11);
+    CHECK(drr->rpos == 11);
+
+    CHECK(debug_ring_read(drr.get(), str.data(), str.size()) == 11);
+    CHECK(std::string(str.data()) == "hello world");
+}
+
+TEST_CASE("debug_ring_write: wraps and discards oldest")
+{
+    auto drr = make_drr();
+    std::vector<char> str(DEBUG_RING_SIZE + 1);
+    std::string fill(DEBUG_RING_SIZE - 2, 'a');
+
+    CHECK(debug_ring_write(drr.get(), fill.c_str(), fill.size()) == fill.size());
+    CHECK(debug_ring_write(drr.get(), "hello", 5) == 5);
+
+    CHECK(drr->spos == 3);
+    CHECK(drr->epos == DEBUG_RING_SIZE + 3);
+    CHECK(drr->buf[DEBUG_RING_SIZE - 2] == 'h');
+    CHECK(drr->buf[2] == 'o');
+
+    CHECK(debug_ring_read(drr.get(), str.data(), str.size()) == DEBUG_RING_SIZE);
+    CHECK(std::string(str.data()) == std::string(DEBUG_RING_SIZE - 5, 'a') + "hello");
+}
+
+// The stress tests below have several threads write messages of the form
+// "[tid:seq:payload]\n" to the same debug ring at the same time. Since
+// messages are never torn, every line that is read back must be complete.
+
+std::string
+make_msg(uint64_t tid, uint64_t seq)
+{
+    auto msg = "[" + bfn::to_string(tid, 10) + ":" + bfn::to_string(seq, 10) + ":";
+    msg.append(seq % 23, static_cast<char>('a' + tid % 26));
+    msg += "]\n";
+
+    return msg;
+}
+
+bool
+valid_msg(const std::string &line)
+{
+    auto fields = bfn::split(line, ':');
+
+    if (fields.size() != 3 || fields.at(0).empty() || fields.at(0).front() != '[') {
+        return false;
+    }
+
+    auto tid = std::stoull(fields.at(0).substr(1));
+    auto seq = std::stoull(fields.at(1));
+
+    return make_msg(tid, seq) == line + "\n";
+}
+
+std::vector<std::string>
+split_lines(const char *str)
+{
+    auto lines = bfn::split(str, '\n');
+
+    if (!lines.empty() && lines.back().empty()) {
+        lines.pop_back();
+    }
+
+    return lines;
+}
+
+template<typename F>
+void
+stress(debug_ring_resources_t *drr, uint64_t num_threads, uint64_t num_msgs, F reader)
+{
+    std::atomic<bool> done{false};
+    std::vector<std::thread> threads;
+
+    std::thread reader_thread([&] {
+        while (!done) {
+            reader();
+        }
+    });
+
+    for (auto tid = 0ULL; tid < num_threads; tid++) {
+        threads.emplace_back([drr, tid, num_msgs] {
+            for (auto seq = 0ULL; seq < num_msgs; seq++) {
+                auto msg = make_msg(tid, seq);
+                debug_ring_write(drr, msg.c_str(), msg.size());
+            }
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    done = true;
+    reader_thread.join();
+}
+
+TEST_CASE("debug_ring_write: multi-threaded stress")
+{
+    constexpr const auto num_threads = 8ULL;
+    constexpr const auto num_msgs = 100ULL;
+
+    auto drr = make_drr();
+    std::vector<char> str(DEBUG_RING_SIZE + 1);
+    std::vector<char> tmp(DEBUG_RING_SIZE + 1);
+
+    auto total = 0ULL;
+    for (auto tid = 0ULL; tid < num_threads; tid++) {
+        for (auto seq = 0ULL; seq < num_msgs; seq++) {
+            total += make_msg(tid, seq).size();
+        }
+    }
+
+    REQUIRE(total <= DEBUG_RING_SIZE);
+
+    // Before the ring wraps, a concurrent reader must only ever see
+    // complete messages
+
+    auto torn = 0ULL;
+    stress(drr.get(), num_threads, num_msgs, [&] {
+        auto ret = debug_ring_read(drr.get(), tmp.data(), tmp.size());
+
+        if (ret > 0 && tmp[ret - 1] != '\n') {
+            torn++;
+        }
+
+        for (const auto &line : split_lines(tmp.data())) {
+            if (!valid_msg(line)) {
+                torn++;
+            }
+        }
+    });
+
+    CHECK(torn == 0);
+    CHECK(drr->spos == 0);
+    CHECK(drr->epos == total);
+    CHECK(drr->rpos == total);
+
+    CHECK(debug_ring_read(drr.get(), str.data(), str.size()) == total);
+
+    std::set<std::string> msgs;
+    for (const auto &line : split_lines(str.data())) {
+        CHECK(valid_msg(line));
+        CHECK(msgs.insert(line).second);
+    }
+
+    CHECK(msgs.size() == num_threads * num_msgs);
+}
+
+TEST_CASE("debug_ring_write: multi-threaded stress with wrapping")
+{
+    constexpr const auto num_threads = 8ULL;
+    constexpr const auto num_msgs = 5000ULL;
+
+    auto drr = make_drr();
+    std::vector<char> str(DEBUG_RING_SIZE + 1);
+
+    stress(drr.get(), num_threads, num_msgs, [] {
+        std::this_thread::yield();
+    });
+
+    CHECK(drr->epos == drr->rpos);
+    CHECK(drr->epos - drr->spos == DEBUG_RING_SIZE);
+    CHECK(debug_ring_read(drr.get(), str.data(), str.size()) == DEBUG_RING_SIZE);
+
+    // The oldest message was likely partially overwritten, but every other
+    // message must be complete
+
+    auto lines = split_lines(str.data());
+    REQUIRE(lines.size() > 1);
+
+    for (auto iter = lines.begin() + 1; iter != lines.end(); iter++) {
+        CHECK(valid_msg(*iter));
+    }
+}
+
+TEST_CASE("debug_ring_read_cursor: invalid args")
+{
+    auto drr = make_drr();
+    uint64_t cursor = 0;
+    char str[10];
+
+    CHECK(debug_ring_read_cursor(nullptr, &cursor, str, 10, nullptr) == 0);
+    CHECK(debug_ring_read_cursor(drr.get(), nullptr, str, 10, nullptr) == 0);
+    CHECK(debug_ring_read_cursor(drr.get(), &cursor, nullptr, 10, nullptr) == 0);
+    CHECK(debug_ring_read_cursor(drr.get(), &cursor, str, 0, nullptr) == 0);
+}
+
+TEST_CASE("debug_ring_read_cursor: only new data")
+{
+    auto drr = make_drr();
+    uint64_t lost = 0;
+    uint64_t cursor = 0;
+    std::vector<char> str(DEBUG_RING_SIZE + 1);
+
+    CHECK(debug_ring_read_cursor(drr.get(), &cursor, str.data(), str.size(), &lost) == 0);
+    CHECK(str[0] == '\0');
+
+    debug_ring_write(drr.get(), "hello", 5);
+    CHECK(debug_ring_read_cursor(drr.get(), &cursor, str.data(), str.size(), &lost) == 5);
+    CHECK(std::string(str.data()) == "hello");
+    CHECK(cursor == 5);
+
+    CHECK(debug_ring_read_cursor(drr.get(), &cursor, str.data(), str.size(), &lost) == 0);
+    CHECK(cursor == 5);
+
+    debug_ring_write(drr.get(), " world", 6);
+    CHECK(debug_ring_read_cursor(drr.get(), &cursor, str.data(), str.size(), &lost) == 6);
+    CHECK(std::string(str.data()) == " world");
+    CHECK(cursor == 11);
+
+    CHECK(lost == 0);
+    CHECK(drr->spos == 0);
+    CHECK(drr->epos == 11);
+}
+
+TEST_CASE("debug_ring_read_cursor: small buffer")
+{
+    auto drr = make_drr();
+    uint64_t cursor = 0;
+    char str[4];
+
+    debug_ring_write(drr.get(), "hello", 5);
+
+    CHECK(debug_ring_read_cursor(drr.get(), &cursor, str, 4, nullptr) == 3);
+    CHECK(std::string(str) == "hel");
+    CHECK(debug_ring_read_cursor(drr.get(), &cursor, str, 4, nullptr) == 2);
+    CHECK(std::string(str) == "lo");
+    CHECK(debug_ring_read_cursor(drr.get(), &cursor, str, 4, nullptr) == 0);
+}
+
+TEST_CASE("debug_ring_read_cursor: skips nulls")
+{
+    auto drr = make_drr();
+    uint64_t cursor = 0;
+    std::vector<char> str(DEBUG_RING_SIZE + 1);
+
+    drr->epos = 7;
+
+    drr->buf[0] = 'h';
+    drr->buf[1] = 'e';
+    drr->buf[3] = 'l';
+    drr->buf[4] = 'l';
+    drr->buf[6] = 'o';
+
+    CHECK(debug_ring_read_cursor(drr.get(), &cursor, str.data(), str.size(), nullptr) == 5);
+    CHECK(std::string(str.data()) == "hello");
+    CHECK(cursor == 7);
+}
+
+TEST_CASE("debug_ring_read_cursor: overrun")
+{
+    auto drr = make_drr();
+    uint64_t lost = 0;
+    uint64_t cursor = 0;
+    std::vector<char> str(DEBUG_RING_SIZE + 1);
+
+    debug_ring_write(drr.get(), "hello", 5);
+    CHECK(debug_ring_read_cursor(drr.get(), &cursor, str.data(), 3, &lost) == 2);
+
+    std::string fill1(DEBUG_RING_SIZE - 8, 'a');
+    debug_ring_write(drr.get(), fill1.c_str(), fill1.size());
+    debug_ring_write(drr.get(), "world", 5);
+
+    CHECK(debug_ring_read_cursor(drr.get(), &cursor, str.data(), str.size(), &lost) == DEBUG_RING_SIZE);
+    CHECK(std::string(str.data()) == "llo" + fill1 + "world");
+    CHECK(cursor == DEBUG_RING_SIZE + 2);
+    CHECK(lost == 0);
+
+    std::string fill2(DEBUG_RING_SIZE - 2, 'a');
+    debug_ring_write(drr.get(), fill2.c_str(), fill2.size());
+    debug_ring_write(drr.get(), "hello", 5);
+    debug_ring_write(drr.get(), "world", 5);
+
+    CHECK(debug_ring_read_cursor(drr.get(), &cursor, str.data(), str.size(), &lost) == DEBUG_RING_SIZE);
+    CHECK(std::string(str.data()) == std::string(DEBUG_RING_SIZE - 10, 'a') + "helloworld");
+    CHECK(cursor == DEBUG_RING_SIZE * 2 + 10);
+    CHECK(lost == 8);
+}
+
+TEST_CASE("debug_ring_read_cursor: reset")
+{
+    auto drr = make_drr();
+    uint64_t cursor = 100;
+    std::vector<char> str(DEBUG_RING_SIZE + 1);
+
+    debug_ring_write(drr.get(), "hello", 5);
+
+    CHECK(debug_ring_read_cursor(drr.get(), &cursor, str.data(), str.size(), nullptr) == 5);
+    CHECK(std::string(str.data()) == "hello");
+    CHECK(cursor == 5);
+}
+
+TEST_CASE("debug_ring_read_cursor: multi-threaded stress")
+{
+    constexpr const auto num_threads = 8ULL;
+    constexpr const auto num_msgs = 5000ULL;
+
+    auto drr = make_drr();
+    std::vector<char> str(DEBUG_RING_SIZE + 1);
+
+    uint64_t lost = 0;
+    uint64_t cursor = 0;
+    uint64_t total = 0;
+    std::string data;
+
+    auto reader = [&] {
+        auto ret = debug_ring_read_cursor(drr.get(), &cursor, str.data(), str.size(), &lost);
+
+        total += ret;
+        data.append(str.data(), ret);
+    };
+
+    stress(drr.get(), num_threads, num_msgs, reader);
+    reader();
+
+    CHECK(cursor == drr->epos);
+    CHECK(total + lost == drr->epos);
+
+    // Every message must be complete, unless the reader was lapped, in
+    // which case the message at the point it was lapped may be partial
+
+    auto lines = split_lines(data.c_str());
+    auto invalid = 0ULL;
+
+    for (const auto &line : lines) {
+        if (!valid_msg(line)) {
+            invalid++;
+        }
+    }
+
+    CHECK(invalid <= (lost > 0 ? lines.size() : 0));
+}
+
+TEST_CASE("debug_ring_record: init")
+{
+    auto drr = make_drr();
+
+    CHECK(debug_ring_has_records(nullptr) == 0);
+    CHECK(debug_ring_has_records(drr.get()) == 0);
+
+    debug_ring_init_records(nullptr);
+    debug_ring_init_records(drr.get());
+
+    CHECK(debug_ring_has_records(drr.get()) == 1);
+    CHECK(drr->tag1 == DEBUG_RING_RECORD_TAG1);
+    CHECK(drr->tag2 == DEBUG_RING_RECORD_TAG2);
+}
+
+TEST_CASE("debug_ring_write_record: invalid args")
+{
+    auto drr = make_drr();
+
+    CHECK(debug_ring_write_record(nullptr, 0, 0, 0, "hello", 5) == 0);
+    CHECK(debug_ring_write_record(drr.get(), 0, 0, 0, nullptr, 5) == 0);
+    CHECK(debug_ring_write_record(drr.get(), 0, 0, 0, "hello", DEBUG_RING_SIZE) == 0);
+    CHECK(drr->epos == 0);
+}
+
+TEST_CASE("debug_ring_read_record: invalid args")
+{
+    auto drr = make_drr();
+    uint64_t cursor = 0;
+    debug_ring_record_t rec{};
+    char str[10];
+
+    debug_ring_write_record(drr.get(), 0, 0, 0, "hello", 5);
+
+    CHECK(debug_ring_read_record(nullptr, &cursor, &rec, str, 10, nullptr) == 0);
+    CHECK(debug_ring_read_record(drr.get(), nullptr, &rec, str, 10, nullptr) == 0);
+    CHECK(debug_ring_read_record(drr.get(), &cursor, nullptr, str, 10, nullptr) == 0);
+    CHECK(debug_ring_read_record(drr.get(), &cursor, &rec, str, 0, nullptr) == 0);
+}
+
+TEST_CASE("debug_ring_record: write and iterate")
+{
+    auto drr = make_drr();
+    uint64_t lost = 0;
+    uint64_t cursor = 0;
+    debug_ring_record_t rec{};
+    char str[64];
+
+    debug_ring_init_records(drr.get());
+
+    CHECK(debug_ring_write_record(drr.get(), 10, 1, DEBUG_RING_SEVERITY_ERROR, "hello", 5) == 32);
+    CHECK(debug_ring_write_record(drr.get(), 20, 2, DEBUG_RING_SEVERITY_DEBUG, "world!!!", 8) == 32);
+    CHECK(debug_ring_write_record(drr.get(), 30, 3, DEBUG_RING_SEVERITY_INFO, nullptr, 0) == 24);
+    CHECK(drr->epos == 88);
+
+    CHECK(debug_ring_read_record(drr.get(), &cursor, &rec, str, sizeof(str), &lost) == 1);
+    CHECK(rec.tsc == 10);
+    CHECK(rec.vcpuid == 1);
+    CHECK(rec.severity == DEBUG_RING_SEVERITY_ERROR);
+    CHECK(rec.len == 5);
+    CHECK(std::string(str) == "hello");
+    CHECK(cursor == 32);
+
+    CHECK(debug_ring_read_record(drr.get(), &cursor, &rec, nullptr, 0, &lost) == 1);
+    CHECK(rec.tsc == 20);
+    CHECK(rec.vcpuid == 2);
+    CHECK(rec.severity == DEBUG_RING_SEVERITY_DEBUG);
+    CHECK(rec.len == 8);
+    CHECK(cursor == 64);
+
+    CHECK(debug_ring_read_record(drr.get(), &cursor, &rec, str, sizeof(str), &lost) == 1);
+    CHECK(rec.tsc == 30);
+    CHECK(rec.len == 0);
+    CHECK(std::string(str).empty());
+
+    CHECK(debug_ring_read_record(drr.get(), &cursor, &rec, str, sizeof(str), &lost) == 0);
+    CHECK(cursor == 88);
+    CHECK(lost == 0);
+}
+
+TEST_CASE("debug_ring_record: header")
+{
+    auto drr = make_drr();
+    uint64_t cursor = 0;
+    debug_ring_record_t rec{};
+    char str[16];
+
+    rec.len = 1000;
+    rec.vcpuid = 3;
+    rec.severity = DEBUG_RING_SEVERITY_ERROR;
+    rec.type = DEBUG_RING_RECORD_VALUE;
+    rec.id = 42;
+    rec.tsc = 10;
+
+    CHECK(debug_ring_write_record_hdr(nullptr, &rec, "hello", 5) == 0);
+    CHECK(debug_ring_write_record_hdr(drr.get(), nullptr, "hello", 5) == 0);
+    CHECK(debug_ring_write_record_hdr(drr.get(), &rec, "hello", 5) == 32);
+    CHECK(debug_ring_write_record(drr.get(), 20, 4, DEBUG_RING_SEVERITY_INFO, "world", 5) == 32);
+
+    rec = {};
+    CHECK(debug_ring_read_record(drr.get(), &cursor, &rec, str, sizeof(str), nullptr) == 1);
+    CHECK(rec.len == 5);
+    CHECK(rec.vcpuid == 3);
+    CHECK(rec.severity == DEBUG_RING_SEVERITY_ERROR);
+    CHECK(rec.type == DEBUG_RING_RECORD_VALUE);
+    CHECK(rec.id == 42);
+    CHECK(rec.tsc == 10);
+    CHECK(std::string(str) == "hello");
+
+    CHECK(debug_ring_read_record(drr.get(), &cursor, &rec, str, sizeof(str), nullptr) == 1);
+    CHECK(rec.type == DEBUG_RING_RECORD_TEXT);
+    CHECK(rec.id == 0);
+    CHECK(std::string(str) == "world");
+}
+
+TEST_CASE("debug_ring_record: truncated message")
+{
+    auto drr = make_drr();
+    uint64_t cursor = 0;
+    debug_ring_record_t rec{};
+    char str[4];
+
+    debug_ring_write_record(drr.get(), 0, 0, 0, "hello", 5);
+
+    CHECK(debug_ring_read_record(drr.get(), &cursor, &rec, str, sizeof(str), nullptr) == 1);
+    CHECK(rec.len == 5);
+    CHECK(std::string(str) == "hel");
+    CHECK(cursor == 32);
+}
+
+TEST_CASE("debug_ring_record: wraps and discards whole records")
+{
+    auto drr = make_drr();
+    uint64_t lost = 0;
+    uint64_t cursor = 0;
+    uint64_t num = 0;
+    debug_ring_record_t rec{};
+    std::vector<char> str(DEBUG_RING_SIZE);
+
+    for (uint64_t i = 0; i < 10000; i++) {
+        auto msg = make_msg(i % 7, i);
+        debug_ring_write_record(drr.get(), i, static_cast<uint32_t>(i % 7), 0, msg.c_str(), msg.size());
+    }
+
+    CHECK(drr->epos - drr->spos <= DEBUG_RING_SIZE);
+
+    auto tsc = 0ULL;
+    while (debug_ring_read_record(drr.get(), &cursor, &rec, str.data(), str.size(), &lost) == 1) {
+        CHECK(rec.vcpuid == rec.tsc % 7);
+        CHECK(std::string(str.data()) == make_msg(rec.vcpuid, rec.tsc));
+        CHECK((num == 0 || rec.tsc == tsc + 1));
+
+        tsc = rec.tsc;
+        num++;
+    }
+
+    CHECK(tsc == 9999);
+    CHECK(cursor == drr->epos);
+    CHECK(lost == drr->spos);
+    CHECK(num > 0);
+}
+
+TEST_CASE("debug_ring_record: multi-threaded stress")
+{
+    constexpr const auto num_threads = 8ULL;
+    constexpr const auto num_msgs = 5000ULL;
+
+    auto drr = make_drr();
+    std::vector<std::thread> threads;
+
+    for (auto tid = 0ULL; tid < num_threads; tid++) {
+        threads.emplace_back([&drr, tid] {
+            for (auto seq = 0ULL; seq < num_msgs; seq++) {
+                auto msg = make_msg(tid, seq);
+                debug_ring_write_record(drr.get(), seq, static_cast<uint32_t>(tid), 0, msg.c_str(), msg.size());
+            }
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    uint64_t lost = 0;
+    uint64_t cursor = 0;
+    uint64_t invalid = 0;
+    debug_ring_record_t rec{};
+    std::vector<char> str(DEBUG_RING_SIZE);
+
+    while (debug_ring_read_record(drr.get(), &cursor, &rec, str.data(), str.size(), &lost) == 1) {
+        if (std::string(str.data()) != make_msg(rec.vcpuid, rec.tsc)) {
+            invalid++;
+        }
+    }
+
+    CHECK(invalid == 0);
+    CHECK(drr->epos == drr->rpos);
+    CHECK(cursor == drr->epos);
+    CHECK(lost == drr->spos);
+}
+
+// Records that are a large fraction of the debug ring mean that most
+// writers have to discard records to make room, which is done while other
+// writers are still writing theirs. Each message's length depends on its
+// tid and seq so that every record can be checked when it is read back.
+
+std::string
+make_long_msg(uint64_t tid, uint64_t seq, uint64_t min, uint64_t max)
+{
+    auto msg = make_msg(tid, seq);
+    msg.resize(min + (seq * 7 + tid) % (max - min + 1), '.');
+
+    return msg;
+}
+
+TEST_CASE("debug_ring_record: multi-threaded stress with large records")
+{
+    constexpr const auto num_threads = 8ULL;
+    constexpr const auto num_msgs = 2000ULL;
+    constexpr const auto min = DEBUG_RING_SIZE / 4 - 40ULL;
+    constexpr const auto max = DEBUG_RING_SIZE / 4 - 33ULL;
+
+    auto drr = make_drr();
+    std::vector<std::thread> threads;
+
+    debug_ring_init_records(drr.get());
+
+    for (auto tid = 0ULL; tid < num_threads; tid++) {
+        threads.emplace_back([&drr, tid] {
+            for (auto seq = 0ULL; seq < num_msgs; seq++) {
+                auto msg = make_long_msg(tid, seq, min, max);
+                debug_ring_write_record(drr.get(), seq, static_cast<uint32_t>(tid), 0, msg.c_str(), msg.size());
+            }
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    uint64_t lost = 0;
+    uint64_t cursor = 0;
+    uint64_t num = 0;
+    uint64_t invalid = 0;
+    debug_ring_record_t rec{};
+    std::vector<char> str(DEBUG_RING_SIZE);
+
+    while (debug_ring_read_record(drr.get(), &cursor, &rec, str.data(), str.size(), &lost) == 1) {
+        if (std::string(str.data()) != make_long_msg(rec.vcpuid, rec.tsc, min, max)) {
+            invalid++;
+        }
+
+        num++;
+    }
+
+    CHECK(invalid == 0);
+    CHECK(num >= 3);
+    CHECK(drr->spos <= drr->epos);
+    CHECK(drr->epos - drr->spos <= DEBUG_RING_SIZE);
+    CHECK(drr->epos == drr->rpos);
+    CHECK(cursor == drr->epos);
+    CHECK(lost == drr->spos);
+}
+
+TEST_CASE("debug_ring_merge: invalid args")
+{
+    auto drr = make_drr();
+    auto merge = std::make_unique<debug_ring_merge_t>();
+
+    debug_ring_record_t rec{};
+    debug_ring_resources_t *drrs[] = {drr.get(), nullptr};
+    char str[10];
+
+    CHECK(debug_ring_merge_init(nullptr, drrs, 1) == 0);
+    CHECK(debug_ring_merge_init(merge.get(), nullptr, 1) == 0);
+    CHECK(debug_ring_merge_init(merge.get(), drrs, 2) == 0);
+    CHECK(debug_ring_merge_init(merge.get(), drrs, MAX_NUM_CPUS + 1) == 0);
+    CHECK(debug_ring_merge_init(merge.get(), drrs, 1) == 1);
+
+    CHECK(debug_ring_merge_next(nullptr, &rec, str, 10) == 0);
+    CHECK(debug_ring_merge_next(merge.get(), nullptr, str, 10) == 0);
+    CHECK(debug_ring_merge_next(merge.get(), &rec, str, 0) == 0);
+
+    debug_ring_merge_refresh(nullptr);
+}
+
+TEST_CASE("debug_ring_merge: empty")
+{
+    auto merge = std::make_unique<debug_ring_merge_t>();
+    debug_ring_record_t rec{};
+
+    CHECK(debug_ring_merge_init(merge.get(), nullptr, 0) == 0);
+
+    auto drr1 = make_drr();
+    auto drr2 = make_drr();
+    debug_ring_resources_t *drrs[] = {drr1.get(), drr2.get()};
+
+    CHECK(debug_ring_merge_init(merge.get(), drrs, 2) == 1);
+    CHECK(debug_ring_merge_next(merge.get(), &rec, nullptr, 0) == 0);
+}
+
+TEST_CASE("debug_ring_merge: timestamp order")
+{
+    constexpr const auto num_rings = 16ULL;
+
+    std::mt19937_64 gen(42);
+    std::vector<std::unique_ptr<debug_ring_resources_t>> rings;
+    std::vector<debug_ring_resources_t *> drrs;
+    std::vector<uint64_t> tscs;
+
+    for (auto i = 0ULL; i < num_rings; i++) {
+        rings.push_back(make_drr());
+        drrs.push_back(rings.back().get());
+    }
+
+    for (auto i = 0ULL; i < 2000; i++) {
+        auto ring = gen() % (num_rings - 1);
+        auto tsc = i / 3;
+        auto msg = make_msg(ring, tsc);
+
+        tscs.push_back(tsc);
+        debug_ring_write_record(drrs.at(ring), tsc, static_cast<uint32_t>(ring), 0, msg.c_str(), msg.size());
+    }
+
+    auto merge = std::make_unique<debug_ring_merge_t>();
+    REQUIRE(debug_ring_merge_init(merge.get(), drrs.data(), drrs.size()) == 1);
+
+    debug_ring_record_t rec{};
+    debug_ring_record_t prev{};
+    std::vector<uint64_t> merged;
+    char str[64];
+
+    while (debug_ring_merge_next(merge.get(), &rec, str, sizeof(str)) == 1) {
+        CHECK(std::string(str) == make_msg(rec.vcpuid, rec.tsc));
+
+        if (!merged.empty()) {
+            CHECK((prev.tsc < rec.tsc || (prev.tsc == rec.tsc && prev.vcpuid <= rec.vcpuid)));
+        }
+
+        prev = rec;
+        merged.push_back(rec.tsc);
+    }
+
+    CHECK(merged == tscs);
+    CHECK(merge->lost == 0);
+}
+
+TEST_CASE("debug_ring_merge: incremental")
+{
+    auto drr1 = make_drr();
+    auto drr2 = make_drr();
+    debug_ring_resources_t *drrs[] = {drr1.get(), drr2.get()};
+
+    auto merge = std::make_unique<debug_ring_merge_t>();
+    debug_ring_record_t rec{};
+
+    debug_ring_write_record(drr1.get(), 1, 0, 0, "a", 1);
+    debug_ring_write_record(drr1.get(), 4, 0, 0, "d", 1);
+
+    REQUIRE(debug_ring_merge_init(merge.get(), drrs, 2) == 1);
+
+    debug_ring_write_record(drr2.get(), 2, 1, 0, "b", 1);
+    debug_ring_merge_refresh(merge.get());
+    debug_ring_write_record(drr2.get(), 3, 1, 0, "c", 1);
+
+    CHECK(debug_ring_merge_next(merge.get(), &rec, nullptr, 0) == 1);
+    CHECK(rec.tsc == 1);
+    CHECK(debug_ring_merge_next(merge.get(), &rec, nullptr, 0) == 1);
+    CHECK(rec.tsc == 2);
+    CHECK(debug_ring_merge_next(merge.get(), &rec, nullptr, 0) == 1);
+    CHECK(rec.tsc == 3);
+    CHECK(debug_ring_merge_next(merge.get(), &rec, nullptr, 0) == 1);
+    CHECK(rec.tsc == 4);
+    CHECK(debug_ring_merge_next(merge.get(), &rec, nullptr, 0) == 0);
+
+    debug_ring_write_record(drr2.get(), 5, 1, 0, "e", 1);
+
+    CHECK(debug_ring_merge_next(merge.get(), &rec, nullptr, 0) == 1);
+    CHECK(rec.tsc == 5);
+    CHECK(debug_ring_merge_next(merge.get(), &rec, nullptr, 0) == 0);
+}
+
+TEST_CASE("debug_ring_merge: overrun")
+{
+    auto drr1 = make_drr();
+    auto drr2 = make_drr();
+    debug_ring_resources_t *drrs[] = {drr1.get(), drr2.get()};
+
+    for (auto i = 0ULL; i < 10000; i++) {
+        auto msg = make_msg(i % 2, i);
+        debug_ring_write_record(drrs[i % 2], i, static_cast<uint32_t>(i % 2), 0, msg.c_str(), msg.size());
+    }
+
+    auto merge = std::make_unique<debug_ring_merge_t>();
+    REQUIRE(debug_ring_merge_init(merge.get(), drrs, 2) == 1);
+
+    debug_ring_record_t rec{};
+    char str[64];
+    auto num = 0ULL;
+
+    while (debug_ring_merge_next(merge.get(), &rec, str, sizeof(str)) == 1) {
+        CHECK(std::string(str) == make_msg(rec.vcpuid, rec.tsc));
+        num++;
+    }
+
+    CHECK(rec.tsc == 9999);
+    CHECK(num > 0);
+    CHECK(merge->lost == drr1->spos + drr2->spos);
+}
+
+TEST_CASE("debug_ring_merge: truncated record")
+{
+    auto drr1 = make_drr();
+    auto drr2 = make_drr();
+    debug_ring_resources_t *drrs[] = {drr1.get(), drr2.get()};
+
+    for (auto i = 0ULL; i < 4; i++) {
+        auto msg = make_msg(i % 2, i + 20);
+        debug_ring_write_record(drrs[i % 2], i, static_cast<uint32_t>(i % 2), 0, msg.c_str(), msg.size());
+    }
+
+    // A dump that stops part of the way through the last record of the
+    // first debug ring
+
+    drr1->epos -= 5;
+    drr1->rpos -= 5;
+
+    auto merge = std::make_unique<debug_ring_merge_t>();
+    REQUIRE(debug_ring_merge_init(merge.get(), drrs, 2) == 1);
+
+    debug_ring_record_t rec{};
+    std::vector<uint64_t> merged;
+    char str[64];
+
+    while (debug_ring_merge_next(merge.get(), &rec, str, sizeof(str)) == 1) {
+        if (rec.tsc == 2) {
+            CHECK(rec.len == 0);
+            CHECK(std::string(str).empty());
+        }
+        else {
+            CHECK(std::string(str) == make_msg(rec.vcpuid, rec.tsc + 20));
+        }
+
+        merged.push_back(rec.tsc);
+    }
+
+    CHECK(merged == std::vector<uint64_t>({0, 1, 2, 3}));
+    CHECK(merge->cursors[0] == drr1->epos);
+    CHECK(merge->lost == 0);
+}
+
+class var_ring
+{
+public:
+    explicit var_ring(uint64_t size) :
+        m_mem((debug_ring_var_alloc_size(size) + sizeof(uint64_t) - 1) / sizeof(uint64_t))
+    { debug_ring_var_init(get(), size); }
+
+    debug_ring_var_t *get()
+    { return reinterpret_cast<debug_ring_var_t *>(m_mem.data()); }
+
+    char *buf()
+    { return reinterpret_cast<char *>(get() + 1); }
+
+private:
+    std::vector<uint64_t> m_mem;
+};
+
+TEST_CASE("debug_ring_var: init")
+{
+    var_ring dr(0x1000);
+
+    CHECK(debug_ring_var_alloc_size(0x1000) == sizeof(debug_ring_var_t) + 0x1000);
+
+    CHECK(debug_ring_var_init(nullptr, 0x1000) == 0);
+    CHECK(debug_ring_var_init(dr.get(), 0) == 0);
+    CHECK(debug_ring_var_init(dr.get(), 4) == 0);
+    CHECK(debug_ring_var_init(dr.get(), 0x1001) == 0);
+    CHECK(debug_ring_var_init(dr.get(), 0x1800) == 0);
+    CHECK(debug_ring_var_init(dr.get(), 0x1000) == 1);
+    CHECK(dr.get()->size == 0x1000);
+
+    CHECK(debug_ring_var_has_records(nullptr) == 0);
+    CHECK(debug_ring_var_has_records(dr.get()) == 0);
+    debug_ring_var_init_records(nullptr);
+    debug_ring_var_init_records(dr.get());
+    CHECK(debug_ring_var_has_records(dr.get()) == 1);
+}
+
+TEST_CASE("debug_ring_var: invalid args")
+{
+    var_ring dr(16);
+    uint64_t cursor = 0;
+    debug_ring_record_t rec{};
+    char str[32];
+
+    CHECK(debug_ring_var_write(nullptr, "hello", 5) == 0);
+    CHECK(debug_ring_var_write(dr.get(), nullptr, 5) == 0);
+    CHECK(debug_ring_var_write(dr.get(), "hello", 0) == 0);
+    CHECK(debug_ring_var_write(dr.get(), "hello world, hello", 17) == 0);
+    CHECK(debug_ring_var_write_record(nullptr, 0, 0, 0, "hello", 5) == 0);
+    CHECK(debug_ring_var_write_record(dr.get(), 0, 0, 0, nullptr, 5) == 0);
+    CHECK(debug_ring_var_write_record(dr.get(), 0, 0, 0, "hello", 5) == 0);
+
+    CHECK(debug_ring_var_read(nullptr, str, 32) == 0);
+    CHECK(debug_ring_var_read(dr.get(), nullptr, 32) == 0);
+    CHECK(debug_ring_var_read(dr.get(), str, 0) == 0);
+    CHECK(debug_ring_var_read_cursor(nullptr, &cursor, str, 32, nullptr) == 0);
+    CHECK(debug_ring_var_read_cursor(dr.get(), nullptr, str, 32, nullptr) == 0);
+    CHECK(debug_ring_var_read_record(nullptr, &cursor, &rec, str, 32, nullptr) == 0);
+    CHECK(debug_ring_var_read_record(dr.get(), &cursor, nullptr, str, 32, nullptr) == 0);
+}
+
+TEST_CASE("debug_ring_var: wraps")
+{
+    var_ring dr(16);
+    uint64_t lost = 0;
+    uint64_t cursor = 0;
+    char str[32];
+
+    CHECK(debug_ring_var_write(dr.get(), "0123456789", 10) == 10);
+    CHECK(debug_ring_var_read_cursor(dr.get(), &cursor, str, sizeof(str), &lost) == 10);
+    CHECK(debug_ring_var_write(dr.get(), "abcdefghij", 10) == 10);
+
+    CHECK(dr.get()->spos == 4);
+    CHECK(dr.get()->epos == 20);
+    CHECK(dr.buf()[0] == 'g');
+
+    CHECK(debug_ring_var_read(dr.get(), str, sizeof(str)) == 16);
+    CHECK(std::string(str) == "456789abcdefghij");
+
+    CHECK(debug_ring_var_read_cursor(dr.get(), &cursor, str, sizeof(str), &lost) == 10);
+    CHECK(std::string(str) == "abcdefghij");
+    CHECK(lost == 0);
+}
+
+TEST_CASE("debug_ring_var: equivalent to fixed size")
+{
+    std::mt19937_64 gen(42);
+    var_ring dr(DEBUG_RING_SIZE);
+    auto drr = make_drr();
+
+    std::vector<char> str1(DEBUG_RING_SIZE + 1);
+    std::vector<char> str2(DEBUG_RING_SIZE + 1);
+
+    for (auto i = 0ULL; i < 2000; i++) {
+        auto msg = make_msg(gen() % 8, i);
+
+        CHECK(debug_ring_write(drr.get(), msg.c_str(), msg.size()) ==
+              debug_ring_var_write(dr.get(), msg.c_str(), msg.size()));
+
+        if (i % 100 == 0) {
+            CHECK(debug_ring_read(drr.get(), str1.data(), str1.size()) ==
+                  debug_ring_var_read(dr.get(), str2.data(), str2.size()));
+            CHECK(str1 == str2);
+        }
+    }
+
+    CHECK(std::equal(drr->buf, drr->buf + DEBUG_RING_SIZE, dr.buf()));
+}
+
+TEST_CASE("debug_ring_var: merge rings of different sizes")
+{
+    var_ring boot(0x100000);
+    var_ring idle1(0x1000);
+    var_ring idle2(0x1000);
+
+    for (auto i = 0ULL; i < 20000; i++) {
+        auto ring = (i % 10 == 1) ? idle1.get() : (i % 10 == 2) ? idle2.get() : boot.get();
+        auto msg = make_msg(i % 10, i);
+
+        debug_ring_var_write_record(ring, i, static_cast<uint32_t>(i % 10), 0, msg.c_str(), msg.size());
+    }
+
+    debug_ring_var_t *drs[] = {boot.get(), idle1.get(), idle2.get()};
+    auto merge = std::make_unique<debug_ring_merge_t>();
+
+    CHECK(debug_ring_var_merge_init(nullptr, drs, 3) == 0);
+    CHECK(debug_ring_var_merge_init(merge.get(), nullptr, 3) == 0);
+    REQUIRE(debug_ring_var_merge_init(merge.get(), drs, 3) == 1);
+
+    debug_ring_record_t rec{};
+    char str[64];
+    auto prev = 0ULL;
+    auto num = 0ULL;
+
+    while (debug_ring_merge_next(merge.get(), &rec, str, sizeof(str)) == 1) {
+        CHECK(std::string(str) == make_msg(rec.vcpuid, rec.tsc));
+        CHECK((num == 0 || rec.tsc > prev));
+
+        prev = rec.tsc;
+        num++;
+    }
+
+    CHECK(boot.get()->spos == 0);
+    CHECK(merge->lost == idle1.get()->spos + idle2.get()->spos);
+    CHECK(num > 16000);
+}
+
+TEST_CASE("debug_ring_var: multi-threaded stress on small rings")
+{
+    constexpr const auto num_threads = 8ULL;
+    constexpr const auto num_msgs = 5000ULL;
+
+    for (auto size : {0x100ULL, 0x1000ULL}) {
+        var_ring dr(size);
+        std::vector<std::thread> threads;
+
+        auto min = size / 2 - 38;
+        auto max = size / 2 - 31;
+
+        debug_ring_var_init_records(dr.get());
+
+        for (auto tid = 0ULL; tid < num_threads; tid++) {
+            threads.emplace_back([&dr, tid, min, max] {
+                for (auto seq = 0ULL; seq < num_msgs; seq++) {
+                    auto msg = make_long_msg(tid, seq, min, max);
+                    debug_ring_var_write_record(dr.get(), seq, static_cast<uint32_t>(tid), 0, msg.c_str(), msg.size());
+                }
+            });
+        }
+
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        uint64_t lost = 0;
+        uint64_t cursor = 0;
+        uint64_t num = 0;
+        uint64_t invalid = 0;
+        debug_ring_record_t rec{};
+        std::vector<char> str(size);
+
+        while (debug_ring_var_read_record(dr.get(), &cursor, &rec, str.data(), str.size(), &lost) == 1) {
+            if (std::string(str.data()) != make_long_msg(rec.vcpuid, rec.tsc, min, max)) {
+                invalid++;
+            }
+
+            num++;
+        }
+
+        CHECK(invalid == 0);
+        CHECK(num >= 1);
+        CHECK(dr.get()->spos <= dr.get()->epos);
+        CHECK(dr.get()->epos - dr.get()->spos <= size);
+        CHECK(dr.get()->epos == dr.get()->rpos);
+        CHECK(cursor == dr.get()->epos);
+        CHECK(lost == dr.get()->spos);
+    }
+}
+
+// A writer that is preempted between reserving its region and copying into
+// it must not be able to overwrite a later writer's message, even when the
+// regions that are reserved at the same time add up to more than the size
+// of the ring. The stalled writer is simulated by reserving its region by
+// hand, and only filling it in (and committing it) once the other writers
+// have had time to reserve regions that wrap onto it.
+
+TEST_CASE("debug_ring_var_write: stalled writer with more than the ring reserved")
+{
+    constexpr const auto num_threads = 8ULL;
+    constexpr const auto num_rounds = 20ULL;
+    constexpr const auto stalled = 200ULL;
+
+    for (auto round = 0ULL; round < num_rounds; round++) {
+        var_ring dr(0x100);
+        std::vector<std::thread> threads;
+
+        dr.get()->rpos = stalled;
+
+        for (auto tid = 0ULL; tid < num_threads; tid++) {
+            threads.emplace_back([&dr, tid, round] {
+                auto msg = make_msg(tid, 22 + round * 23);
+                debug_ring_var_write(dr.get(), msg.c_str(), msg.size());
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+        std::fill(dr.buf(), dr.buf() + stalled, '#');
+        __atomic_store_n(&dr.get()->epos, stalled, __ATOMIC_RELEASE);
+
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        REQUIRE(dr.get()->rpos > 0x100);
+        CHECK(dr.get()->epos == dr.get()->rpos);
+        CHECK(dr.get()->epos - dr.get()->spos == 0x100);
+
+        // The oldest line is the end of the stalled writer's region joined
+        // to the first message, but every other message must be complete
+
+        std::vector<char> str(0x100 + 1);
+        CHECK(debug_ring_var_read(dr.get(), str.data(), str.size()) == 0x100);
+
+        auto lines = split_lines(str.data());
+        REQUIRE(lines.size() > 1);
+
+        for (auto iter = lines.begin() + 1; iter != lines.end(); iter++) {
+            CHECK(valid_msg(*iter));
+        }
+    }
+}
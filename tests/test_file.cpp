@@ -25,7 +25,10 @@
 #include <bffile.h>
 #include <bfstring.h>
 
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <thread>
 
 file g_file;
 
@@ -83,6 +86,357 @@ TEST_CASE("read / write success")
     REQUIRE(std::remove(filename.c_str()) == 0);
 }
 
+TEST_CASE("read mapped with bad filename")
+{
+    CHECK_THROWS(g_file.read_mapped(""));
+    CHECK_THROWS(g_file.read_mapped("/blah/bad_filename.txt"));
+}
+
+TEST_CASE("read mapped success")
+{
+    std::string filename{"test.txt"};
+
+    REQUIRE_NOTHROW(g_file.write_binary(filename, bfn::buffer{}));
+    CHECK(g_file.read_mapped(filename).empty());
+
+    for (auto size : {std::size_t{0x3001}, bfn::file_map_threshold + 1}) {
+        bfn::buffer binary_data(size);
+
+        for (std::size_t i = 0; i < binary_data.size(); i++) {
+            binary_data.data()[i] = static_cast<char>(i);
+        }
+
+        REQUIRE_NOTHROW(g_file.write_binary(filename, binary_data));
+
+        for (auto advice : {file::advise_normal, file::advise_sequential, file::advise_willneed}) {
+            auto view = g_file.read_mapped(filename, advice);
+
+            REQUIRE(view.size() == binary_data.size());
+            CHECK(memcmp(view.data(), binary_data.data(), view.size()) == 0);
+
+#if defined(NATIVE) && defined(__unix__)
+            CHECK(view.is_mapped() == (size >= bfn::file_map_threshold));
+#endif
+        }
+    }
+
+    REQUIRE(std::remove(filename.c_str()) == 0);
+}
+
+TEST_CASE("read mapped move")
+{
+    std::string filename{"test.txt"};
+    REQUIRE_NOTHROW(g_file.write_binary(filename, bfn::buffer(bfn::file_map_threshold)));
+
+    auto view1 = g_file.read_mapped(filename, file::advise_sequential | file::advise_willneed);
+    auto data = view1.data();
+
+    auto view2 = std::move(view1);
+    CHECK(!view1);
+    CHECK(view2.data() == data);
+    CHECK(view2.span().size() == static_cast<std::ptrdiff_t>(bfn::file_map_threshold));
+
+    view2.reset();
+    CHECK(view2.empty());
+    CHECK(view2.data() == nullptr);
+
+    REQUIRE(std::remove(filename.c_str()) == 0);
+}
+
+#if defined(NATIVE) && defined(__linux__)
+
+TEST_CASE("read mapped special files")
+{
+    auto view = g_file.read_mapped("/proc/self/status");
+
+    CHECK(!view.is_mapped());
+    CHECK(!view.empty());
+    CHECK(std::string(view.data(), view.size()).find("Name:") == 0);
+
+    CHECK(g_file.read_mapped("/dev/null").empty());
+}
+
+TEST_CASE("read stream special files")
+{
+    std::string result;
+
+    g_file.read_stream("/proc/self/status").for_each([&](auto chunk) {
+        result.append(chunk.data(), static_cast<std::size_t>(chunk.size()));
+    });
+
+    CHECK(result.find("Name:") == 0);
+    CHECK(g_file.read_stream("/dev/null").next().empty());
+}
+
+TEST_CASE("read text special files")
+{
+    CHECK(g_file.read_text("/proc/self/status").find("Name:") == 0);
+    CHECK(g_file.read_text("/dev/null").empty());
+}
+
+#endif
+
+TEST_CASE("read many")
+{
+    std::vector<std::string> filenames{"test1.txt", "/blah/bad_filename.txt", "test2.txt", "test3.txt"};
+
+    REQUIRE_NOTHROW(g_file.write_text(filenames[0], "hello"));
+    REQUIRE_NOTHROW(g_file.write_text(filenames[2], ""));
+    REQUIRE_NOTHROW(g_file.write_text(filenames[3], "world"));
+
+    CHECK_THROWS(g_file.read_many(filenames, 0));
+    CHECK_THROWS(g_file.read_many(filenames, 1, 0));
+    CHECK(g_file.read_many({}).empty());
+
+    for (auto num_threads : {1U, 2U, 8U}) {
+        for (auto max_bytes : {1U, 5U, 0x1000U}) {
+            auto results = g_file.read_many(filenames, num_threads, max_bytes);
+            REQUIRE(results.size() == 4);
+
+            CHECK(results[0]);
+            CHECK(results[0].data == bfn::buffer({'h', 'e', 'l', 'l', 'o'}));
+
+            CHECK(!results[1]);
+            CHECK_THROWS_AS(std::rethrow_exception(results[1].error), std::runtime_error);
+
+            CHECK(results[2]);
+            CHECK(results[2].data.empty());
+
+            CHECK(results[3]);
+            CHECK(results[3].data == bfn::buffer({'w', 'o', 'r', 'l', 'd'}));
+        }
+    }
+
+    REQUIRE(std::remove(filenames[0].c_str()) == 0);
+    REQUIRE(std::remove(filenames[2].c_str()) == 0);
+    REQUIRE(std::remove(filenames[3].c_str()) == 0);
+}
+
+class file_in_flight : public file
+{
+public:
+
+    binary_data
+    read_binary(const filename_type &filename) const override
+    {
+        auto bytes = this->size(filename);
+        auto now = m_in_flight.fetch_add(bytes) + bytes;
+
+        auto max = m_max_in_flight.load();
+        while (now > max && !m_max_in_flight.compare_exchange_weak(max, now))
+        { }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        auto ret = file::read_binary(filename);
+
+        m_in_flight.fetch_sub(bytes);
+        return ret;
+    }
+
+    mutable std::atomic<std::size_t> m_in_flight{0};
+    mutable std::atomic<std::size_t> m_max_in_flight{0};
+};
+
+TEST_CASE("read many limits the bytes being read")
+{
+    file_in_flight f;
+    std::vector<std::string> filenames;
+
+    for (auto i = 0; i < 16; i++) {
+        filenames.push_back("test" + std::to_string(i) + ".txt");
+        REQUIRE_NOTHROW(f.write_binary(filenames.back(), bfn::buffer(0x100)));
+    }
+
+    auto results = f.read_many(filenames, 8, 0x200);
+    CHECK(f.m_max_in_flight <= 0x200);
+
+    f.m_max_in_flight = 0;
+    results = f.read_many(filenames, 8, 0x10);
+    CHECK(f.m_max_in_flight == 0x100);
+
+    for (const auto &result : results) {
+        CHECK(result.data.size() == 0x100);
+    }
+
+    for (const auto &filename : filenames) {
+        REQUIRE(std::remove(filename.c_str()) == 0);
+    }
+}
+
+TEST_CASE("read stream with bad filename")
+{
+    CHECK_THROWS(g_file.read_stream(""));
+    CHECK_THROWS(g_file.read_stream("/blah/bad_filename.txt"));
+    CHECK_THROWS(g_file.read_stream("test.txt", 0));
+}
+
+TEST_CASE("read stream")
+{
+    std::string filename{"test.txt"};
+    std::string text_data;
+
+    for (auto i = 0; i < 1000; i++) {
+        text_data += std::to_string(i);
+    }
+
+    REQUIRE_NOTHROW(g_file.write_text(filename, text_data));
+
+    for (auto chunk_size : {std::size_t{1}, std::size_t{7}, std::size_t{0x100}, text_data.size(), std::size_t{0x10000}}) {
+        std::string result;
+        auto reader = g_file.read_stream(filename, chunk_size);
+
+        CHECK(reader.chunk_size() == chunk_size);
+
+        reader.for_each([&](auto chunk) {
+            CHECK(static_cast<std::size_t>(chunk.size()) <= chunk_size);
+            result.append(chunk.data(), static_cast<std::size_t>(chunk.size()));
+        });
+
+        CHECK(result == text_data);
+        CHECK(reader.next().empty());
+    }
+
+    REQUIRE_NOTHROW(g_file.write_text(filename, ""));
+    CHECK(g_file.read_stream(filename).next().empty());
+
+    REQUIRE(std::remove(filename.c_str()) == 0);
+}
+
+TEST_CASE("read stream chunks stay valid until next")
+{
+    std::string filename{"test.txt"};
+    REQUIRE_NOTHROW(g_file.write_text(filename, "aaaabbbbcccc"));
+
+    auto reader = g_file.read_stream(filename, 4);
+
+    auto chunk1 = reader.next();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    CHECK(std::string(chunk1.data(), 4) == "aaaa");
+
+    auto chunk2 = reader.next();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    CHECK(std::string(chunk2.data(), 4) == "bbbb");
+
+    REQUIRE(std::remove(filename.c_str()) == 0);
+}
+
+TEST_CASE("read stream stop early")
+{
+    std::string filename{"test.txt"};
+    REQUIRE_NOTHROW(g_file.write_binary(filename, bfn::buffer(0x10000)));
+
+    {
+        auto reader = g_file.read_stream(filename, 0x10);
+        CHECK(reader.next().size() == 0x10);
+    }
+
+    {
+        auto reader = g_file.read_stream(filename, 0x10);
+    }
+
+    auto reader1 = g_file.read_stream(filename, 0x10);
+    CHECK(reader1.next().size() == 0x10);
+
+    auto reader2 = std::move(reader1);
+    CHECK(reader2.next().size() == 0x10);
+    CHECK_THROWS(reader1.next());
+
+    reader1 = g_file.read_stream(filename, 0x1000);
+    CHECK(reader1.next().size() == 0x1000);
+
+    REQUIRE(std::remove(filename.c_str()) == 0);
+}
+
+TEST_CASE("write stream with bad filename")
+{
+    CHECK_THROWS(g_file.write_stream(""));
+    CHECK_THROWS(g_file.write_stream("/blah/bad_filename.txt"));
+    CHECK_THROWS(g_file.write_stream("test.txt", 0));
+}
+
+TEST_CASE("write stream")
+{
+    std::string filename{"test.txt"};
+
+    for (auto chunk_size : {std::size_t{1}, std::size_t{7}, std::size_t{0x100}}) {
+        std::string expected;
+
+        {
+            auto writer = g_file.write_stream(filename, chunk_size);
+
+            for (auto i = 0; i < 1000; i++) {
+                auto str = std::to_string(i) + std::string(static_cast<std::size_t>(i % 13), 'x');
+                expected += str;
+
+                writer.write(gsl::span<const char>(str.data(), static_cast<std::ptrdiff_t>(str.size())));
+            }
+        }
+
+        CHECK(g_file.read_text(filename) == expected);
+    }
+
+    auto writer = g_file.write_stream(filename, 0x10);
+    writer.write(gsl::span<const char>("hello", 5));
+    writer.flush();
+    CHECK(g_file.read_text(filename) == "hello");
+
+    writer.write(gsl::span<const char>(" world", 6));
+    writer.close();
+    CHECK(g_file.read_text(filename) == "hello world");
+
+    CHECK_THROWS(writer.write(gsl::span<const char>("!", 1)));
+    CHECK_THROWS(writer.flush());
+
+    auto moved = std::move(writer);
+
+    REQUIRE(std::remove(filename.c_str()) == 0);
+}
+
+TEST_CASE("write chain with bad filename")
+{
+    bfn::buffer_chain chain;
+    chain.append(bfn::buffer{'h', 'e', 'l', 'l', 'o'});
+
+    CHECK_THROWS(g_file.write_chain("", chain));
+    CHECK_THROWS(g_file.write_chain("/blah/bad_filename.txt", chain));
+}
+
+TEST_CASE("write chain success")
+{
+    std::string filename{"test.txt"};
+    std::string header{"header"};
+
+    bfn::buffer_chain chain;
+    REQUIRE_NOTHROW(g_file.write_chain(filename, chain));
+    CHECK(g_file.read_binary(filename).empty());
+
+    chain.append(gsl::span<const char>(header.data(), static_cast<std::ptrdiff_t>(header.size())));
+    chain.append(bfn::buffer{'h', 'e', 'l', 'l', 'o'});
+
+    REQUIRE_NOTHROW(g_file.write_chain(filename, chain));
+    CHECK(g_file.read_text(filename) == "headerhello");
+
+    REQUIRE(std::remove(filename.c_str()) == 0);
+}
+
+TEST_CASE("write chain with many segments")
+{
+    std::string filename{"test.txt"};
+    std::string expected;
+
+    bfn::buffer_chain chain;
+    for (auto i = 0; i < 5000; i++) {
+        auto str = std::to_string(i);
+        expected += str;
+        chain.append(bfn::shared_buffer(str.data(), str.size()));
+    }
+
+    REQUIRE_NOTHROW(g_file.write_chain(filename, chain));
+    CHECK(g_file.read_text(filename) == expected);
+
+    REQUIRE(std::remove(filename.c_str()) == 0);
+}
+
 TEST_CASE("extension")
 {
     CHECK(g_file.extension("") == "");
@@ -130,11 +484,78 @@ TEST_CASE("find files")
     CHECK(results.at(0) == "./test1.txt");
     CHECK(results.at(1) == "./test2.txt");
 
+    results = g_file.find_files({"./test1.txt"_s, "test2.txt"_s}, {"test1.txt"_s, "."_s});
+
+    REQUIRE(results.size() == 2);
+    CHECK(results.at(0) == "././test1.txt");
+    CHECK(results.at(1) == "./test2.txt");
+
     for (const auto &file : files) {
         REQUIRE(std::remove(file.c_str()) == 0);
     }
 }
 
+#if defined(NATIVE) && defined(__unix__)
+
+TEST_CASE("find files skips entries that do not exist")
+{
+    REQUIRE(::mkdir("find_dir1", 0755) == 0);
+    REQUIRE(::mkdir("find_dir2", 0755) == 0);
+    REQUIRE(::mkdir("find_dir2/sub", 0755) == 0);
+    REQUIRE(::symlink("missing.txt", "find_dir1/test.txt") == 0);
+    REQUIRE(::symlink("find_loop", "find_loop") == 0);
+    REQUIRE_NOTHROW(g_file.write_text("find_dir2/test.txt", "hello world"));
+    REQUIRE_NOTHROW(g_file.write_text("find_dir2/sub/test.txt", "hello world"));
+
+    auto ___ = gsl::finally([] {
+        std::remove("find_dir2/sub/test.txt");
+        std::remove("find_dir2/test.txt");
+        std::remove("find_dir1/test.txt");
+        std::remove("find_loop");
+        ::rmdir("find_dir2/sub");
+        ::rmdir("find_dir2");
+        ::rmdir("find_dir1");
+    });
+
+    auto results = g_file.find_files({"test.txt"_s}, {"find_dir1"_s, "find_dir2"_s});
+    REQUIRE(results.size() == 1);
+    CHECK(results.at(0) == "find_dir2/test.txt");
+
+    results = g_file.find_files({"test.txt"_s}, {"find_loop"_s, "find_dir2"_s});
+    REQUIRE(results.size() == 1);
+    CHECK(results.at(0) == "find_dir2/test.txt");
+
+    results = g_file.find_files({"sub/test.txt"_s}, {"find_dir1"_s, "find_dir2"_s});
+    REQUIRE(results.size() == 1);
+    CHECK(results.at(0) == "find_dir2/sub/test.txt");
+
+    CHECK_THROWS(g_file.find_files({"test.txt"_s}, {"find_dir1"_s, "find_loop"_s}));
+}
+
+// Note that root can list any directory, in which case this takes the
+// listing path instead.
+
+TEST_CASE("find files in a path that cannot be listed")
+{
+    REQUIRE(::mkdir("find_dir3", 0755) == 0);
+    REQUIRE_NOTHROW(g_file.write_text("find_dir3/test.txt", "hello world"));
+    REQUIRE(::chmod("find_dir3", 0111) == 0);
+
+    auto ___ = gsl::finally([] {
+        ::chmod("find_dir3", 0755);
+        std::remove("find_dir3/test.txt");
+        ::rmdir("find_dir3");
+    });
+
+    auto results = g_file.find_files({"test.txt"_s}, {"find_dir3"_s});
+    REQUIRE(results.size() == 1);
+    CHECK(results.at(0) == "find_dir3/test.txt");
+
+    CHECK_THROWS(g_file.find_files({"missing.txt"_s}, {"find_dir3"_s}));
+}
+
+#endif
+
 TEST_CASE("file size")
 {
     std::string filename{"test.txt"};
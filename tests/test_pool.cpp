@@ -0,0 +1,267 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <catch/catch.hpp>
+#include <bfpool.h>
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <thread>
+#include <vector>
+
+TEST_CASE("constructor")
+{
+    CHECK_THROWS(bfn::buddy_pool(0, 4));
+    CHECK_THROWS(bfn::buddy_pool(0x1000, 3));
+    CHECK_THROWS(bfn::buddy_pool(0x1001, 4));
+
+    CHECK_NOTHROW(bfn::buddy_pool(0x1000, 4));
+    CHECK_NOTHROW(bfn::buddy_pool(0x3000, 12));
+}
+
+TEST_CASE("empty pool")
+{
+    bfn::buddy_pool pool(0x10000, 4);
+    auto stats = pool.stats();
+
+    CHECK(stats.size == 0x10000);
+    CHECK(stats.used_bytes == 0);
+    CHECK(stats.free_bytes == 0x10000);
+    CHECK(stats.largest_free == 0x10000);
+    CHECK(stats.external_fragmentation() == Approx(0.0));
+    CHECK(stats.internal_fragmentation() == Approx(0.0));
+}
+
+TEST_CASE("alloc rounds up to a power of two block")
+{
+    bfn::buddy_pool pool(0x10000, 4);
+
+    for (auto size : {0ULL, 1ULL, 16ULL, 17ULL, 100ULL, 0x1000ULL, 0x1001ULL}) {
+        auto ptr = pool.alloc(size);
+        REQUIRE(ptr != nullptr);
+
+        auto block_size = pool.block_size(ptr);
+        CHECK(block_size >= size);
+        CHECK(block_size >= 16);
+        CHECK(block_size < std::max(size, 16ULL) * 2);
+        CHECK((reinterpret_cast<uintptr_t>(ptr) & (block_size - 1)) == 0);
+
+        pool.free(ptr);
+    }
+
+    CHECK(pool.stats().used_bytes == 0);
+    CHECK(pool.stats().largest_free == 0x10000);
+}
+
+TEST_CASE("free merges buddies")
+{
+    bfn::buddy_pool pool(0x10000, 4);
+    std::vector<void *> ptrs;
+
+    while (auto ptr = pool.alloc(16)) {
+        ptrs.push_back(ptr);
+    }
+
+    CHECK(ptrs.size() == 0x1000);
+    CHECK(pool.stats().largest_free == 0);
+
+    std::shuffle(ptrs.begin(), ptrs.end(), std::mt19937());
+
+    for (auto ptr : ptrs) {
+        pool.free(ptr);
+    }
+
+    auto stats = pool.stats();
+    CHECK(stats.used_bytes == 0);
+    CHECK(stats.largest_free == 0x10000);
+    CHECK(stats.allocs == 0x1000);
+    CHECK(stats.frees == 0x1000);
+    CHECK(stats.failures == 1);
+}
+
+TEST_CASE("out of memory")
+{
+    bfn::buddy_pool pool(0x10000, 12);
+
+    auto ptr1 = pool.alloc(0x8000);
+    auto ptr2 = pool.alloc(0x8000);
+    auto ptr3 = pool.alloc(0x1000);
+
+    CHECK(ptr1 != nullptr);
+    CHECK(ptr2 != nullptr);
+    CHECK(ptr3 == nullptr);
+    CHECK(pool.alloc(0x20000) == nullptr);
+    CHECK(pool.stats().failures == 2);
+
+    pool.free(ptr1);
+    pool.free(ptr2);
+    pool.free(nullptr);
+
+    CHECK(pool.alloc(0x10000) != nullptr);
+}
+
+TEST_CASE("pool that is not a power of two")
+{
+    bfn::buddy_pool pool(0x7000, 12);
+
+    CHECK(pool.stats().largest_free == 0x4000);
+
+    auto ptr1 = pool.alloc(0x4000);
+    auto ptr2 = pool.alloc(0x2000);
+    auto ptr3 = pool.alloc(0x1000);
+
+    CHECK(ptr1 != nullptr);
+    CHECK(ptr2 != nullptr);
+    CHECK(ptr3 != nullptr);
+    CHECK(pool.alloc(0x1000) == nullptr);
+
+    pool.free(ptr3);
+    pool.free(ptr2);
+    pool.free(ptr1);
+
+    auto stats = pool.stats();
+    CHECK(stats.free_bytes == 0x7000);
+    CHECK(stats.largest_free == 0x4000);
+    CHECK(stats.external_fragmentation() == Approx(3.0 / 7.0));
+}
+
+TEST_CASE("high water and fragmentation")
+{
+    bfn::buddy_pool pool(0x10000, 4);
+
+    auto ptr1 = pool.alloc(0x100);
+    auto ptr2 = pool.alloc(0x180);
+
+    auto stats = pool.stats();
+    CHECK(stats.used_bytes == 0x300);
+    CHECK(stats.high_water == 0x300);
+    CHECK(stats.requested_bytes == 0x280);
+    CHECK(stats.allocated_bytes == 0x300);
+    CHECK(stats.internal_fragmentation() == Approx(1.0 - 0x280 / 768.0));
+
+    pool.free(ptr2);
+    CHECK(pool.stats().high_water == 0x300);
+
+    pool.reset_high_water();
+    CHECK(pool.stats().high_water == 0x100);
+
+    // Only the first 16 byte block is allocated, which leaves free blocks
+    // of every other size, so the largest is half of the pool.
+
+    pool.free(ptr1);
+    ptr1 = pool.alloc(16);
+
+    stats = pool.stats();
+    CHECK(stats.largest_free == 0x8000);
+    CHECK(stats.external_fragmentation() == Approx(1.0 - 0x8000 / static_cast<double>(0x10000 - 16)));
+
+    pool.free(ptr1);
+}
+
+TEST_CASE("contains")
+{
+    bfn::buddy_pool pool(0x10000, 4);
+    auto ptr = static_cast<char *>(pool.alloc(16));
+
+    CHECK(pool.contains(ptr));
+    CHECK(pool.contains(ptr + 0xFFFF));
+    CHECK(!pool.contains(ptr + 0x10000));
+    CHECK(!pool.contains(nullptr));
+
+    pool.free(ptr);
+}
+
+TEST_CASE("global pools")
+{
+    auto heap = bfn::pool_alloc(42);
+    auto page = bfn::pool_alloc(MAX_PAGE_SIZE * 2);
+
+    CHECK(bfn::heap_pool().contains(heap));
+    CHECK(bfn::page_pool().contains(page));
+    CHECK((reinterpret_cast<uintptr_t>(page) & (MAX_PAGE_SIZE - 1)) == 0);
+
+    CHECK(bfn::heap_pool().stats().size == MAX_HEAP_POOL);
+    CHECK(bfn::page_pool().stats().size == MAX_PAGE_POOL);
+
+    bfn::pool_free(heap);
+    bfn::pool_free(page);
+    bfn::pool_free(nullptr);
+
+    CHECK(bfn::heap_pool().stats().used_bytes == 0);
+    CHECK(bfn::page_pool().stats().used_bytes == 0);
+}
+
+TEST_CASE("thread safe")
+{
+    constexpr const auto num_threads = 8;
+
+    bfn::buddy_pool pool(0x100000, 4);
+    std::vector<std::thread> threads;
+    std::array<bool, num_threads> valid{};
+
+    for (auto t = 0; t < num_threads; t++) {
+        threads.emplace_back([t, &pool, &valid] {
+            std::vector<std::pair<char *, std::size_t>> ptrs;
+            auto ok = true;
+
+            for (auto i = 0; i < 0x4000; i++) {
+                auto size = static_cast<std::size_t>((i * 7 + t) % 300) + 1;
+
+                if (auto ptr = static_cast<char *>(pool.alloc(size))) {
+                    std::fill(ptr, ptr + size, static_cast<char>(t));
+                    ptrs.emplace_back(ptr, size);
+                }
+
+                if (i % 2 == 0 && !ptrs.empty()) {
+                    auto index = static_cast<std::size_t>(i * 13) % ptrs.size();
+                    auto obj = ptrs.at(index);
+
+                    ptrs.at(index) = ptrs.back();
+                    ptrs.pop_back();
+
+                    ok &= std::all_of(obj.first, obj.first + obj.second, [&](char c) {
+                        return c == static_cast<char>(t);
+                    });
+
+                    pool.free(obj.first);
+                }
+            }
+
+            for (const auto &obj : ptrs) {
+                pool.free(obj.first);
+            }
+
+            valid.at(static_cast<std::size_t>(t)) = ok;
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (auto ok : valid) {
+        CHECK(ok);
+    }
+
+    CHECK(pool.stats().used_bytes == 0);
+    CHECK(pool.stats().largest_free == 0x100000);
+}
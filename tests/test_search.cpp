@@ -0,0 +1,227 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <catch/catch.hpp>
+
+#include <bfsearch.h>
+
+#include <set>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+auto
+levels()
+{
+    std::vector<bfn::simd_level> result;
+
+    for (auto level : {bfn::simd_level::scalar, bfn::simd_level::sse2, bfn::simd_level::avx2}) {
+        if (level <= bfn::simd_supported()) {
+            result.push_back(level);
+        }
+    }
+
+    return result;
+}
+
+auto
+span(const std::string &str)
+{ return gsl::span<const char>(str.data(), static_cast<std::ptrdiff_t>(str.size())); }
+
+auto
+random_string(std::mt19937 &gen, std::size_t size, char max = 'c')
+{
+    std::string str(size, 'a');
+    std::uniform_int_distribution<int> dist('a', max);
+
+    for (auto &c : str) {
+        c = static_cast<char>(dist(gen));
+    }
+
+    return str;
+}
+
+TEST_CASE("simd level")
+{
+    auto supported = bfn::simd_supported();
+
+    CHECK(bfn::set_simd_level(bfn::simd_level::scalar) == bfn::simd_level::scalar);
+    CHECK(bfn::get_simd_level() == bfn::simd_level::scalar);
+
+    CHECK(bfn::set_simd_level(bfn::simd_level::avx2) == supported);
+    CHECK(bfn::get_simd_level() == supported);
+}
+
+TEST_CASE("find")
+{
+    std::string data{"hello world"};
+
+    for (auto level : levels()) {
+        bfn::set_simd_level(level);
+
+        CHECK(bfn::find(span(data), span("hello")) == 0);
+        CHECK(bfn::find(span(data), span("world")) == 6);
+        CHECK(bfn::find(span(data), span("o")) == 4);
+        CHECK(bfn::find(span(data), span("o"), 5) == 7);
+        CHECK(bfn::find(span(data), span("d")) == 10);
+        CHECK(bfn::find(span(data), span("hello world")) == 0);
+
+        CHECK(bfn::find(span(data), span("")) == 0);
+        CHECK(bfn::find(span(data), span(""), 11) == 11);
+        CHECK(bfn::find(span(""), span("")) == 0);
+
+        CHECK(bfn::find(span(data), span("x")) == bfn::npos);
+        CHECK(bfn::find(span(data), span("hello world!")) == bfn::npos);
+        CHECK(bfn::find(span(data), span("hello"), 1) == bfn::npos);
+        CHECK(bfn::find(span(data), span(""), 12) == bfn::npos);
+        CHECK(bfn::find(span(""), span("x")) == bfn::npos);
+    }
+
+    bfn::set_simd_level(bfn::simd_supported());
+}
+
+TEST_CASE("find matches std::search")
+{
+    std::mt19937 gen(1);
+
+    for (auto level : levels()) {
+        bfn::set_simd_level(level);
+
+        for (std::size_t size = 0; size < 200; size++) {
+            auto data = random_string(gen, size);
+
+            for (std::size_t plen = 1; plen < 6; plen++) {
+                auto pattern = random_string(gen, plen);
+                auto iter = std::search(data.begin(), data.end(), pattern.begin(), pattern.end());
+                auto expected = iter == data.end() ? bfn::npos : static_cast<std::size_t>(iter - data.begin());
+
+                CHECK(bfn::find(span(data), span(pattern)) == expected);
+            }
+        }
+    }
+
+    bfn::set_simd_level(bfn::simd_supported());
+}
+
+TEST_CASE("find long pattern")
+{
+    std::mt19937 gen(2);
+
+    auto data = random_string(gen, 0x10000, 'z');
+    auto pattern = data.substr(0xFF00, 100);
+
+    for (auto level : levels()) {
+        bfn::set_simd_level(level);
+        CHECK(bfn::find(span(data), span(pattern)) == data.find(pattern));
+    }
+
+    bfn::set_simd_level(bfn::simd_supported());
+}
+
+TEST_CASE("find buffer")
+{
+    bfn::buffer buf{0x7F, 'E', 'L', 'F', 0x02};
+
+    CHECK(bfn::find(buf, span("ELF")) == 1);
+    CHECK(bfn::find(bfn::shared_buffer(std::move(buf)), span("\x7F" "ELF")) == 0);
+}
+
+TEST_CASE("mismatch")
+{
+    for (auto level : levels()) {
+        bfn::set_simd_level(level);
+
+        for (std::size_t size = 0; size < 200; size++) {
+            std::string lhs(size, 'a');
+
+            CHECK(bfn::mismatch(span(lhs), span(lhs)) == size);
+            CHECK(bfn::mismatch(span(lhs), span(lhs + "b")) == size);
+
+            for (std::size_t i = 0; i < size; i++) {
+                auto rhs = lhs;
+                rhs[i] = 'b';
+
+                CHECK(bfn::mismatch(span(lhs), span(rhs)) == i);
+            }
+        }
+    }
+
+    bfn::set_simd_level(bfn::simd_supported());
+}
+
+TEST_CASE("mismatch buffer")
+{
+    bfn::buffer lhs{1, 2, 3, 4};
+    bfn::small_buffer rhs{1, 2, 4};
+
+    CHECK(bfn::mismatch(lhs, rhs) == 2);
+    CHECK(bfn::mismatch(lhs, lhs) == 4);
+}
+
+TEST_CASE("hash is the same at every level")
+{
+    std::mt19937 gen(3);
+
+    for (std::size_t size : {0U, 1U, 7U, 63U, 64U, 65U, 127U, 128U, 200U, 0x10001U}) {
+        auto data = random_string(gen, size, 'z');
+        auto expected = bfn::hash(span(data));
+
+        for (auto level : levels()) {
+            bfn::set_simd_level(level);
+            CHECK(bfn::hash(span(data)) == expected);
+            CHECK(bfn::hash(span(data), 42) != expected);
+        }
+
+        bfn::set_simd_level(bfn::simd_supported());
+    }
+}
+
+TEST_CASE("hash distinguishes")
+{
+    std::set<uint64_t> hashes;
+    std::string data(200, '\0');
+
+    for (std::size_t size = 0; size <= data.size(); size++) {
+        hashes.insert(bfn::hash(gsl::span<const char>(data.data(), static_cast<std::ptrdiff_t>(size))));
+    }
+
+    for (std::size_t i = 0; i < data.size() * 8; i++) {
+        auto tmp = data;
+        tmp[i / 8] = static_cast<char>(1 << (i % 8));
+        hashes.insert(bfn::hash(span(tmp)));
+    }
+
+    std::string stripes(128, 'a');
+    std::fill(stripes.begin() + 64, stripes.end(), 'b');
+    hashes.insert(bfn::hash(span(stripes)));
+    std::rotate(stripes.begin(), stripes.begin() + 64, stripes.end());
+    hashes.insert(bfn::hash(span(stripes)));
+
+    CHECK(hashes.size() == 201 + 1600 + 2);
+}
+
+TEST_CASE("hash buffer")
+{
+    bfn::buffer buf{1, 2, 3, 4};
+    CHECK(bfn::hash(buf) == bfn::hash(buf.span()));
+    CHECK(bfn::hash(buf, 1) == bfn::hash(buf.span(), 1));
+}
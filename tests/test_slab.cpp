@@ -0,0 +1,201 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <catch/catch.hpp>
+#include <bfslab.h>
+
+#include <algorithm>
+#include <array>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("size classes")
+{
+    for (auto size : {0ULL, 1ULL, 16ULL, 17ULL, 100ULL, 1000ULL, 2048ULL}) {
+        auto ptr = bfn::slab_alloc(size);
+        REQUIRE(ptr != nullptr);
+
+        auto object_size = bfn::slab_object_size(ptr);
+        CHECK(object_size >= size);
+        CHECK(object_size >= 16);
+        CHECK((object_size & (object_size - 1)) == 0);
+        CHECK((reinterpret_cast<uintptr_t>(ptr) & (object_size - 1)) == 0);
+
+        bfn::slab_free(ptr);
+    }
+}
+
+TEST_CASE("large objects are page backed")
+{
+    for (auto size : {2049ULL, 0x1000ULL, 0x1001ULL, 0x10000ULL}) {
+        auto ptr = bfn::slab_alloc(size);
+        REQUIRE(ptr != nullptr);
+
+        CHECK(bfn::slab_object_size(ptr) == 0);
+        CHECK((reinterpret_cast<uintptr_t>(ptr) & (MAX_PAGE_SIZE - 1)) == 0);
+
+        bfn::slab_free(ptr);
+    }
+}
+
+TEST_CASE("free nullptr")
+{
+    CHECK_NOTHROW(bfn::slab_free(nullptr));
+}
+
+TEST_CASE("free objects are reused")
+{
+    auto ptr1 = bfn::slab_alloc(42);
+    bfn::slab_free(ptr1);
+
+    auto ptr2 = bfn::slab_alloc(42);
+    CHECK(ptr1 == ptr2);
+
+    bfn::slab_free(ptr2);
+}
+
+TEST_CASE("objects do not overlap")
+{
+    std::vector<char *> ptrs;
+    std::set<char *> unique;
+
+    for (auto i = 0ULL; i < 0x4000; i++) {
+        auto size = 1ULL << (i % 8);
+        auto ptr = static_cast<char *>(bfn::slab_alloc(size));
+
+        REQUIRE(ptr != nullptr);
+        std::fill(ptr, ptr + size, static_cast<char>(i));
+
+        ptrs.push_back(ptr);
+        unique.insert(ptr);
+    }
+
+    CHECK(unique.size() == ptrs.size());
+
+    for (auto i = 0ULL; i < ptrs.size(); i++) {
+        auto size = 1ULL << (i % 8);
+        CHECK(std::all_of(ptrs.at(i), ptrs.at(i) + size, [&](char c) { return c == static_cast<char>(i); }));
+        bfn::slab_free(ptrs.at(i));
+    }
+}
+
+TEST_CASE("free from another thread")
+{
+    std::vector<void *> ptrs;
+
+    for (auto i = 0; i < 0x1000; i++) {
+        ptrs.push_back(bfn::slab_alloc(64));
+    }
+
+    std::thread([&] {
+        for (auto ptr : ptrs) {
+            bfn::slab_free(ptr);
+        }
+    }).join();
+
+    // The objects freed by the other thread were returned to the global
+    // free list when it exited, so they can be reused by this thread.
+
+    std::set<void *> freed(ptrs.begin(), ptrs.end());
+    auto ptr = bfn::slab_alloc(64);
+
+    for (auto i = 0; i < 0x1000 && freed.count(ptr) == 0; i++) {
+        bfn::slab_free(ptr);
+        ptr = bfn::slab_alloc(64);
+    }
+
+    CHECK(freed.count(ptr) == 1);
+    bfn::slab_free(ptr);
+}
+
+TEST_CASE("thread safe")
+{
+    constexpr const auto num_threads = 8;
+
+    std::vector<std::thread> threads;
+    std::array<bool, num_threads> valid{};
+
+    for (auto t = 0; t < num_threads; t++) {
+        threads.emplace_back([t, &valid] {
+            std::vector<std::pair<char *, std::size_t>> ptrs;
+            auto ok = true;
+
+            auto check_and_free = [&](const std::pair<char *, std::size_t> &obj) {
+                ok &= std::all_of(obj.first, obj.first + obj.second, [&](char c) {
+                    return c == static_cast<char>(t);
+                });
+
+                bfn::slab_free(obj.first);
+            };
+
+            for (auto i = 0; i < 0x10000; i++) {
+                auto size = static_cast<std::size_t>((i * 7 + t) % 300);
+                auto ptr = static_cast<char *>(bfn::slab_alloc(size));
+
+                std::fill(ptr, ptr + size, static_cast<char>(t));
+                ptrs.emplace_back(ptr, size);
+
+                if (i % 3 == 0) {
+                    auto index = static_cast<std::size_t>(i * 13) % ptrs.size();
+                    auto obj = ptrs.at(index);
+
+                    ptrs.at(index) = ptrs.back();
+                    ptrs.pop_back();
+
+                    check_and_free(obj);
+                }
+            }
+
+            for (const auto &obj : ptrs) {
+                check_and_free(obj);
+            }
+
+            valid.at(static_cast<std::size_t>(t)) = ok;
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (auto ok : valid) {
+        CHECK(ok);
+    }
+}
+
+TEST_CASE("slab allocator")
+{
+    using string_type = std::basic_string<char, std::char_traits<char>, bfn::slab_allocator<char>>;
+    std::vector<string_type, bfn::slab_allocator<string_type>> list;
+
+    for (auto i = 0; i < 0x1000; i++) {
+        list.emplace_back(static_cast<std::size_t>(i % 100) + 20, 'a');
+    }
+
+    CHECK(list.at(42).size() == 62);
+    CHECK(bfn::slab_object_size(list.data()) == 0);
+    CHECK(bfn::slab_object_size(list.at(42).data()) == 64);
+
+    CHECK(bfn::slab_allocator<int>() == bfn::slab_allocator<char>());
+    CHECK_THROWS(bfn::slab_allocator<uint64_t>().allocate(0xFFFFFFFFFFFFFFFF));
+}
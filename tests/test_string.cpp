@@ -22,6 +22,8 @@
 #include <catch/catch.hpp>
 #include <bfstring.h>
 
+#include <limits>
+
 TEST_CASE("string operator")
 {
     CHECK("10"_s == std::string("10"));
@@ -57,6 +59,65 @@ TEST_CASE("base 8")
     CHECK(bfn::to_string(static_cast<unsigned long long>(10), 8) == "012");
 }
 
+TEST_CASE("negative")
+{
+    CHECK(bfn::to_string(static_cast<int>(-10), 10) == "-10");
+    CHECK(bfn::to_string(static_cast<int>(-10), 16) == "0x00000000FFFFFFF6");
+    CHECK(bfn::to_string(static_cast<int>(-10), 8) == "037777777766");
+}
+
+TEST_CASE("zero / max")
+{
+    CHECK(bfn::to_string(0, 10) == "0");
+    CHECK(bfn::to_string(0, 16) == "0x0000000000000000");
+    CHECK(bfn::to_string(0, 8) == "00");
+    CHECK(bfn::to_string(0xFFFFFFFFFFFFFFFFULL, 10) == "18446744073709551615");
+    CHECK(bfn::to_string(0xFFFFFFFFFFFFFFFFULL, 16) == "0xFFFFFFFFFFFFFFFF");
+    CHECK(bfn::to_string(0xFFFFFFFFFFFFFFFFULL, 8) == "01777777777777777777777");
+    CHECK(bfn::to_string(std::numeric_limits<int64_t>::min(), 10) == "-9223372036854775808");
+}
+
+TEST_CASE("to_chars")
+{
+    std::array<char, 64> str{};
+
+    auto ret1 = bfn::to_chars(str.data(), str.data() + str.size(), 42);
+    CHECK(ret1.ec == std::errc());
+    CHECK(std::string(str.data(), ret1.ptr) == "42");
+
+    auto ret2 = bfn::to_chars(str.data(), str.data() + str.size(), -42, 16);
+    CHECK(ret2.ec == std::errc());
+    CHECK(std::string(str.data(), ret2.ptr) == "-2a");
+
+    auto ret3 = bfn::to_chars(str.data(), str.data() + str.size(), 5U, 2);
+    CHECK(ret3.ec == std::errc());
+    CHECK(std::string(str.data(), ret3.ptr) == "101");
+
+    auto ret4 = bfn::to_chars(str.data(), str.data() + 1, 42);
+    CHECK(ret4.ec == std::errc::value_too_large);
+}
+
+TEST_CASE("to_string: caller storage")
+{
+    std::array<char, bfn::to_string_max_size> str{};
+
+    auto ret1 = bfn::to_string(str.data(), str.data() + str.size(), 10, 16);
+    CHECK(ret1.ec == std::errc());
+    CHECK(std::string(str.data(), ret1.ptr) == "0x000000000000000A");
+
+    auto ret2 = bfn::to_string(str.data(), str.data() + str.size(), 10, 8);
+    CHECK(ret2.ec == std::errc());
+    CHECK(std::string(str.data(), ret2.ptr) == "012");
+
+    auto ret3 = bfn::to_string(str.data(), str.data() + str.size(), 10, 10);
+    CHECK(ret3.ec == std::errc());
+    CHECK(std::string(str.data(), ret3.ptr) == "10");
+
+    CHECK(bfn::to_string(str.data(), str.data(), 10, 8).ec == std::errc::value_too_large);
+    CHECK(bfn::to_string(str.data(), str.data() + 17, 10, 16).ec == std::errc::value_too_large);
+    CHECK(bfn::to_string(str.data(), str.data() + 1, 10, 10).ec == std::errc::value_too_large);
+}
+
 TEST_CASE("split")
 {
     std::vector<std::string> empty = {""};